@@ -22,6 +22,10 @@
 #include <QLoggingCategory>
 #include <qtconcurrentrun.h>
 
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
+
 /** \file checksums.cpp
  *
  * \brief Computing and validating file checksums
@@ -215,6 +219,61 @@ void ComputeChecksum::slotCalculationDone()
 }
 
 
+StreamingChecksum::StreamingChecksum(const QByteArray &checksumType)
+    : _checksumType(checksumType)
+    , _adler(false)
+    , _adlerValue(0)
+{
+    if (!checksumComputationEnabled()) {
+        return;
+    }
+    if (checksumType == checkSumMD5C) {
+        _hash.reset(new QCryptographicHash(QCryptographicHash::Md5));
+    } else if (checksumType == checkSumSHA1C) {
+        _hash.reset(new QCryptographicHash(QCryptographicHash::Sha1));
+    }
+#ifdef ZLIB_FOUND
+    else if (checksumType == checkSumAdlerC) {
+        _adler = true;
+        _adlerValue = adler32(0L, Z_NULL, 0);
+    }
+#endif
+}
+
+bool StreamingChecksum::isValid() const
+{
+    return _hash || _adler;
+}
+
+void StreamingChecksum::addData(const char *data, qint64 length)
+{
+    if (_hash) {
+        _hash->addData(data, length);
+    }
+#ifdef ZLIB_FOUND
+    else if (_adler) {
+        // adler32() takes an uInt length
+        while (length > 0) {
+            const uInt part = uInt(qMin(length, qint64(1024 * 1024 * 1024)));
+            _adlerValue = adler32(_adlerValue, reinterpret_cast<const Bytef *>(data), part);
+            data += part;
+            length -= part;
+        }
+    }
+#endif
+}
+
+QByteArray StreamingChecksum::result() const
+{
+    if (_hash) {
+        return _hash->result().toHex();
+    }
+    if (_adler) {
+        return QByteArray::number(qulonglong(_adlerValue), 16);
+    }
+    return QByteArray();
+}
+
 ValidateChecksumHeader::ValidateChecksumHeader(QObject *parent)
     : QObject(parent)
 {
@@ -241,6 +300,23 @@ void ValidateChecksumHeader::start(const QString &filePath, const QByteArray &ch
     calculator->start(filePath);
 }
 
+void ValidateChecksumHeader::startWithComputedChecksum(const QByteArray &checksumHeader,
+    const QByteArray &checksumType, const QByteArray &checksum)
+{
+    if (checksumHeader.isEmpty()) {
+        emit validated(QByteArray(), QByteArray());
+        return;
+    }
+
+    if (!parseChecksumHeader(checksumHeader, &_expectedChecksumType, &_expectedChecksum)) {
+        qCWarning(lcChecksums) << "Checksum header malformed:" << checksumHeader;
+        emit validationFailed(tr("The checksum header is malformed."));
+        return;
+    }
+
+    slotChecksumCalculated(checksumType, checksum);
+}
+
 void ValidateChecksumHeader::slotChecksumCalculated(const QByteArray &checksumType,
     const QByteArray &checksum)
 {
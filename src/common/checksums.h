@@ -22,7 +22,9 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QCryptographicHash>
 #include <QFutureWatcher>
+#include <QScopedPointer>
 
 namespace OCC {
 
@@ -104,6 +106,38 @@ private:
     QFutureWatcher<QByteArray> _watcher;
 };
 
+/**
+ * Computes a checksum over data that is received in pieces, for
+ * example while a file is downloaded.
+ *
+ * The result is the same as the one of ComputeChecksum for a file
+ * holding all the data passed to addData().
+ * \ingroup libsync
+ */
+class OCSYNC_EXPORT StreamingChecksum
+{
+public:
+    explicit StreamingChecksum(const QByteArray &checksumType);
+
+    /// Whether the checksum type is supported
+    bool isValid() const;
+
+    QByteArray checksumType() const { return _checksumType; }
+
+    void addData(const char *data, qint64 length);
+
+    /// The checksum of all the data added so far
+    QByteArray result() const;
+
+private:
+    QByteArray _checksumType;
+    QScopedPointer<QCryptographicHash> _hash;
+    bool _adler;
+    unsigned long _adlerValue;
+
+    Q_DISABLE_COPY(StreamingChecksum)
+};
+
 /**
  * Checks whether a file's checksum matches the expected value.
  * @ingroup libsync
@@ -123,6 +157,15 @@ public:
      */
     void start(const QString &filePath, const QByteArray &checksumHeader);
 
+    /**
+     * Like start(), for a checksum that was already computed, for example
+     * while the file was downloaded.
+     *
+     * The signals are emitted before this function returns.
+     */
+    void startWithComputedChecksum(const QByteArray &checksumHeader,
+        const QByteArray &checksumType, const QByteArray &checksum);
+
 signals:
     void validated(const QByteArray &checksumType, const QByteArray &checksum);
     void validationFailed(const QString &errMsg);
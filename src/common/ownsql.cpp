@@ -27,6 +27,8 @@
 #include "common/utility.h"
 #include "common/asserts.h"
 
+#include <atomic>
+
 #define SQLITE_SLEEP_TIME_USEC 100000
 #define SQLITE_REPEAT_COUNT 20
 
@@ -42,6 +44,8 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcSql, "sync.database.sql", QtInfoMsg)
 
+static std::atomic<quint64> executedStatements{ 0 };
+
 SqlDatabase::SqlDatabase()
     : _db(0)
     , _errId(0)
@@ -275,6 +279,11 @@ bool SqlQuery::isPragma()
     return (!_sql.isEmpty() && _sql.startsWith("PRAGMA", Qt::CaseInsensitive));
 }
 
+quint64 SqlQuery::executedStatementCount()
+{
+    return executedStatements;
+}
+
 bool SqlQuery::exec()
 {
     qCDebug(lcSql) << "SQL exec" << _sql;
@@ -283,6 +292,7 @@ bool SqlQuery::exec()
         qCWarning(lcSql) << "Can't exec query, statement unprepared.";
         return false;
     }
+    ++executedStatements;
 
     // Don't do anything for selects, that is how we use the lib :-|
     if (!isSelect() && !isPragma()) {
@@ -98,6 +98,9 @@ public:
     void reset_and_clear_bindings();
     void finish();
 
+    /// Number of statements executed by all queries so far, for benchmarks
+    static quint64 executedStatementCount();
+
 private:
     sqlite3 *_db;
     sqlite3_stmt *_stmt;
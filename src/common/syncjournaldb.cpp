@@ -18,6 +18,7 @@
 
 #include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
 #include <QStringList>
 #include <QElapsedTimer>
@@ -56,6 +57,14 @@ static void fillFileRecordFromGetQuery(SyncJournalFileRecord &rec, SqlQuery &que
     rec._checksumHeader = query.baValue(9);
 }
 
+// phash(path) in SQL, so statements that change paths can keep the phash column up to date
+static void sqlitePHash(sqlite3_context *context, int, sqlite3_value **argv)
+{
+    const auto path = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+    const int size = sqlite3_value_bytes(argv[0]);
+    sqlite3_result_int64(context, SyncJournalDb::getPHash(QByteArray::fromRawData(path, size)));
+}
+
 static QString defaultJournalMode(const QString &dbPath)
 {
 #ifdef Q_OS_WIN
@@ -79,6 +88,13 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     , _mutex(QMutex::Recursive)
     , _transaction(0)
     , _metadataTableIsEmpty(false)
+    , _fileRecordQueries(0)
+    , _fileRecordQueryNsecs(0)
+    , _lastMaintenanceMsecs(-1)
+    , _maintenanceOk(false)
+    , _maintenancePagesBefore(0)
+    , _maintenanceFreePagesBefore(0)
+    , _renameIndexLookups(0)
 {
     // Allow forcing the journal mode for debugging
     static QString envJournalMode = QString::fromLocal8Bit(qgetenv("OWNCLOUD_SQLITE_JOURNAL_MODE"));
@@ -212,18 +228,203 @@ QString SyncJournalDb::databaseFilePath() const
     return _dbFile;
 }
 
-// Note that this does not change the size of the -wal file, but it is supposed to make
+// SqlQuery::exec() doesn't step PRAGMA statements, do it here until they are done.
+static bool execPragma(SqlQuery &query, const QString &sql)
+{
+    if (query.prepare(sql) != 0 || !query.exec()) {
+        return false;
+    }
+    while (query.next()) {
+    }
+    return query.errorId() == SQLITE_DONE;
+}
+
+static qint64 pragmaValue(SqlDatabase &db, const QString &sql)
+{
+    SqlQuery query(db);
+    if (query.prepare(sql) != 0 || !query.exec() || !query.next()) {
+        return -1;
+    }
+    return query.int64Value(0);
+}
+
+static int tableRowCount(SqlDatabase &db, const QString &table)
+{
+    SqlQuery query(db);
+    if (query.prepare(QLatin1String("SELECT COUNT(*) FROM ") + table) != 0
+        || !query.exec() || !query.next()) {
+        return -1;
+    }
+    return query.intValue(0);
+}
+
+// Note that FULL does not change the size of the -wal file, but it is supposed to make
 // the normal .db faster since the changes from the wal will be incorporated into it.
 // Then the next sync (and the SocketAPI) will have a faster access.
 void SyncJournalDb::walCheckpoint()
+{
+    QMutexLocker locker(&_mutex);
+    if (!_db.isOpen()) {
+        return;
+    }
+    checkpointWal("FULL");
+}
+
+bool SyncJournalDb::checkpointWal(const QByteArray &mode)
 {
     QElapsedTimer t;
     t.start();
     SqlQuery pragma1(_db);
-    pragma1.prepare("PRAGMA wal_checkpoint(FULL);");
-    if (pragma1.exec()) {
-        qCDebug(lcDb) << "took" << t.elapsed() << "msec";
+    if (!execPragma(pragma1, QString("PRAGMA wal_checkpoint(%1);").arg(QString::fromLatin1(mode)))) {
+        qCWarning(lcDb) << "WAL checkpoint" << mode << "failed:" << pragma1.error();
+        return false;
     }
+    qCDebug(lcDb) << "WAL checkpoint" << mode << "took" << t.elapsed() << "msec";
+    return true;
+}
+
+// The free pages reclaimed by one vacuum step, about 4 MB with the default page size
+static const int incrementalVacuumPages = 1000;
+
+// The rows ANALYZE looks at per index, keeps it short on big journals
+static const int analysisLimit = 1000;
+
+bool SyncJournalDb::performMaintenance()
+{
+    MaintenanceStep step = MaintenanceStep::Start;
+    while (step != MaintenanceStep::Done) {
+        step = performMaintenanceStep(step);
+    }
+    return _maintenanceOk;
+}
+
+SyncJournalDb::MaintenanceStep SyncJournalDb::performMaintenanceStep(MaintenanceStep step)
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        _maintenanceOk = false;
+        return MaintenanceStep::Done;
+    }
+    // Runs outside of transactions, so that the mutex is the only lock held between the steps
+    commitInternal("maintenance step", false);
+
+    SqlQuery query(_db);
+    switch (step) {
+    case MaintenanceStep::Start:
+        _maintenanceOk = true;
+        _maintenanceTimer.start();
+        _maintenancePagesBefore = pragmaValue(_db, "PRAGMA page_count;");
+        _maintenanceFreePagesBefore = pragmaValue(_db, "PRAGMA freelist_count;");
+
+        if (query.prepare("DELETE FROM blocksignatures WHERE path NOT IN (SELECT path FROM metadata);") != 0
+            || !query.exec()) {
+            qCWarning(lcDb) << "Could not remove stale block signatures" << query.error();
+        }
+        return MaintenanceStep::Vacuum;
+
+    case MaintenanceStep::Vacuum:
+        // 2 == INCREMENTAL. Journals created by older clients have auto_vacuum
+        // disabled and need a single full VACUUM for the new mode to take effect.
+        if (pragmaValue(_db, "PRAGMA auto_vacuum;") != 2) {
+            qCInfo(lcDb) << "Switching" << _dbFile << "to incremental auto_vacuum";
+            // VACUUM is refused while a transaction or any statement is active.
+            // Closing resets all the cached queries.
+            close();
+            if (!checkConnect()) {
+                _maintenanceOk = false;
+                return MaintenanceStep::Done;
+            }
+            SqlQuery vacuum(_db);
+            if (!execPragma(vacuum, "PRAGMA auto_vacuum = INCREMENTAL;")
+                || vacuum.prepare("VACUUM;") != 0 || !vacuum.exec()) {
+                qCWarning(lcDb) << "Vacuum of" << _dbFile << "failed:" << vacuum.error();
+                _maintenanceOk = false;
+            }
+            return MaintenanceStep::Analyze;
+        }
+        if (pragmaValue(_db, "PRAGMA freelist_count;") <= 0) {
+            return MaintenanceStep::Analyze;
+        }
+        if (!execPragma(query, QString("PRAGMA incremental_vacuum(%1);").arg(incrementalVacuumPages))) {
+            qCWarning(lcDb) << "Vacuum of" << _dbFile << "failed:" << query.error();
+            _maintenanceOk = false;
+            return MaintenanceStep::Analyze;
+        }
+        // Until the free pages are gone
+        return MaintenanceStep::Vacuum;
+
+    case MaintenanceStep::Analyze:
+        execPragma(query, QString("PRAGMA analysis_limit = %1;").arg(analysisLimit));
+        if (query.prepare("ANALYZE;") != 0 || !query.exec()) {
+            qCWarning(lcDb) << "ANALYZE of" << _dbFile << "failed:" << query.error();
+            _maintenanceOk = false;
+        }
+        return MaintenanceStep::Finish;
+
+    case MaintenanceStep::Finish:
+        if (_journalMode.compare(QLatin1String("WAL"), Qt::CaseInsensitive) == 0) {
+            // Unlike the FULL checkpoint done after each sync this also shrinks the -wal file
+            _maintenanceOk = checkpointWal("TRUNCATE") && _maintenanceOk;
+        }
+
+        // Also recorded on failure, retrying right away wouldn't help
+        if (query.prepare("DELETE FROM maintenance;") != 0 || !query.exec()
+            || query.prepare("INSERT INTO maintenance (lastrun) VALUES (?1);") != 0) {
+            qCWarning(lcDb) << "Could not record the maintenance time" << query.error();
+        } else {
+            query.bindValue(1, QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() / 1000);
+            query.exec();
+        }
+
+        _lastMaintenanceMsecs = _maintenanceTimer.elapsed();
+        qCInfo(lcDb) << "Maintenance of" << _dbFile << "took" << _lastMaintenanceMsecs << "msec;"
+                     << "pages:" << _maintenancePagesBefore << "->" << pragmaValue(_db, "PRAGMA page_count;")
+                     << "free pages:" << _maintenanceFreePagesBefore << "->" << pragmaValue(_db, "PRAGMA freelist_count;");
+        return MaintenanceStep::Done;
+
+    case MaintenanceStep::Done:
+        break;
+    }
+    return MaintenanceStep::Done;
+}
+
+QDateTime SyncJournalDb::lastMaintenanceTime()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return QDateTime();
+    }
+
+    SqlQuery query("SELECT lastrun FROM maintenance;", _db);
+    if (!query.next()) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(query.int64Value(0) * 1000, Qt::UTC);
+}
+
+SyncJournalDb::DiagnosticsInfo SyncJournalDb::diagnostics()
+{
+    QMutexLocker locker(&_mutex);
+
+    DiagnosticsInfo info;
+    info._fileRecordQueries = _fileRecordQueries;
+    info._fileRecordQueryNsecs = _fileRecordQueryNsecs;
+    info._lastMaintenanceMsecs = _lastMaintenanceMsecs;
+    info._fileSize = QFileInfo(_dbFile).size();
+    info._walFileSize = QFileInfo(_dbFile + "-wal").size();
+
+    if (!checkConnect()) {
+        return info;
+    }
+
+    info._pageSize = pragmaValue(_db, "PRAGMA page_size;");
+    info._pageCount = pragmaValue(_db, "PRAGMA page_count;");
+    info._freePageCount = pragmaValue(_db, "PRAGMA freelist_count;");
+    info._fileRecordCount = tableRowCount(_db, "metadata");
+    info._downloadInfoCount = tableRowCount(_db, "downloadinfo");
+    info._uploadInfoCount = tableRowCount(_db, "uploadinfo");
+    info._errorBlacklistCount = tableRowCount(_db, "blacklist");
+    return info;
 }
 
 void SyncJournalDb::startTransaction()
@@ -284,6 +485,12 @@ bool SyncJournalDb::checkConnect()
         return false;
     }
 
+    if (sqlite3_create_function(_db.sqliteDb(), "phash", 1, SQLITE_UTF8, nullptr, &sqlitePHash, nullptr, nullptr) != SQLITE_OK) {
+        qCWarning(lcDb) << "Could not register the phash function:" << _db.error();
+        _db.close();
+        return false;
+    }
+
     SqlQuery pragma1(_db);
     pragma1.prepare("SELECT sqlite_version();");
     if (!pragma1.exec()) {
@@ -396,6 +603,18 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("Create table uploadinfo", createQuery);
     }
 
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS blocksignatures("
+                        "path VARCHAR(4096),"
+                        "etag VARCHAR(32),"
+                        "blocksize INTEGER(8),"
+                        "signatures BLOB,"
+                        "PRIMARY KEY(path)"
+                        ");");
+
+    if (!createQuery.exec()) {
+        return sqlFail("Create table blocksignatures", createQuery);
+    }
+
     // create the blacklist table.
     createQuery.prepare("CREATE TABLE IF NOT EXISTS blacklist ("
                         "path VARCHAR(4096),"
@@ -445,6 +664,14 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("Create table datafingerprint", createQuery);
     }
 
+    // The time of the last performMaintenance(), in seconds since the epoch
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS maintenance("
+                        "lastrun INTEGER(8)"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail("Create table maintenance", createQuery);
+    }
+
     createQuery.prepare("CREATE TABLE IF NOT EXISTS version("
                         "major INTEGER(8),"
                         "minor INTEGER(8),"
@@ -547,6 +774,13 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("prepare _getFileRecordQueryByFileId", *_getFileRecordQueryByFileId);
     }
 
+    _getFileRecordQueryByChecksum.reset(new SqlQuery(_db));
+    if (_getFileRecordQueryByChecksum->prepare(
+            GET_FILE_RECORD_QUERY
+            " WHERE contentChecksum=?1 AND contentchecksumtype.name=?2")) {
+        return sqlFail("prepare _getFileRecordQueryByChecksum", *_getFileRecordQueryByChecksum);
+    }
+
     _getFilesBelowPathQuery.reset(new SqlQuery(_db));
     if (_getFilesBelowPathQuery->prepare(
             GET_FILE_RECORD_QUERY
@@ -613,6 +847,24 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("prepare _deleteUploadInfoQuery", *_deleteUploadInfoQuery);
     }
 
+    _getBlockSignaturesQuery.reset(new SqlQuery(_db));
+    if (_getBlockSignaturesQuery->prepare("SELECT etag, blocksize, signatures FROM "
+                                          "blocksignatures WHERE path=?1")) {
+        return sqlFail("prepare _getBlockSignaturesQuery", *_getBlockSignaturesQuery);
+    }
+
+    _setBlockSignaturesQuery.reset(new SqlQuery(_db));
+    if (_setBlockSignaturesQuery->prepare("INSERT OR REPLACE INTO blocksignatures "
+                                          "(path, etag, blocksize, signatures) "
+                                          "VALUES ( ?1 , ?2, ?3, ?4 )")) {
+        return sqlFail("prepare _setBlockSignaturesQuery", *_setBlockSignaturesQuery);
+    }
+
+    _deleteBlockSignaturesQuery.reset(new SqlQuery(_db));
+    if (_deleteBlockSignaturesQuery->prepare("DELETE FROM blocksignatures WHERE path=?1")) {
+        return sqlFail("prepare _deleteBlockSignaturesQuery", *_deleteBlockSignaturesQuery);
+    }
+
 
     _deleteFileRecordPhash.reset(new SqlQuery(_db));
     if (_deleteFileRecordPhash->prepare("DELETE FROM metadata WHERE phash=?1")) {
@@ -624,6 +876,17 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("prepare _deleteFileRecordRecursively", *_deleteFileRecordRecursively);
     }
 
+    // Stale records at the target are replaced
+    _moveFileRecordsQuery.reset(new SqlQuery(_db));
+    if (_moveFileRecordsQuery->prepare(
+            "UPDATE OR REPLACE metadata"
+            " SET path = ?2 || substr(path, length(?1) + 1),"
+            "  phash = phash(?2 || substr(path, length(?1) + 1)),"
+            "  pathlen = pathlen + ?3"
+            " WHERE path > (?1||'/') AND path < (?1||'0')")) {
+        return sqlFail("prepare _moveFileRecordsQuery", *_moveFileRecordsQuery);
+    }
+
     QString sql("SELECT lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory "
                 "FROM blacklist WHERE path=?1");
     if (Utility::fsCasePreserving()) {
@@ -703,6 +966,7 @@ void SyncJournalDb::close()
     _getFileRecordQuery.reset(0);
     _getFileRecordQueryByInode.reset(0);
     _getFileRecordQueryByFileId.reset(0);
+    _getFileRecordQueryByChecksum.reset(0);
     _getFilesBelowPathQuery.reset(0);
     _setFileRecordQuery.reset(0);
     _setFileRecordChecksumQuery.reset(0);
@@ -713,8 +977,12 @@ void SyncJournalDb::close()
     _getUploadInfoQuery.reset(0);
     _setUploadInfoQuery.reset(0);
     _deleteUploadInfoQuery.reset(0);
+    _getBlockSignaturesQuery.reset(0);
+    _setBlockSignaturesQuery.reset(0);
+    _deleteBlockSignaturesQuery.reset(0);
     _deleteFileRecordPhash.reset(0);
     _deleteFileRecordRecursively.reset(0);
+    _moveFileRecordsQuery.reset(0);
     _getErrorBlacklistQuery.reset(0);
     _setErrorBlacklistQuery.reset(0);
     _getSelectiveSyncListQuery.reset(0);
@@ -727,6 +995,7 @@ void SyncJournalDb::close()
 
     _db.close();
     _avoidReadFromDbOnNextSyncFilter.clear();
+    invalidateRenameIndex();
     _metadataTableIsEmpty = false;
 }
 
@@ -804,6 +1073,16 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add path index");
     }
 
+    if (1) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_content_checksum ON metadata(contentChecksum);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index contentChecksum", query);
+            re = false;
+        }
+        commitInternal("update database structure: add contentChecksum index");
+    }
+
     if (columns.indexOf(QLatin1String("ignoredChildrenRemote")) == -1) {
         SqlQuery query(_db);
         query.prepare("ALTER TABLE metadata ADD COLUMN ignoredChildrenRemote INT;");
@@ -932,6 +1211,7 @@ bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
 {
     SyncJournalFileRecord record = _record;
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     if (!_avoidReadFromDbOnNextSyncFilter.isEmpty()) {
         // If we are a directory that should not be read from db next time, don't write the etag
@@ -999,6 +1279,7 @@ bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
 bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
 {
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     if (checkConnect()) {
         // if (!recursively) {
@@ -1026,6 +1307,24 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
     }
 }
 
+bool SyncJournalDb::moveFileRecords(const QByteArray &from, const QByteArray &to)
+{
+    QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
+
+    qCInfo(lcDb) << "Moving the file records below" << from << "to" << to;
+
+    if (!checkConnect()) {
+        qCWarning(lcDb) << "Failed to connect database.";
+        return false;
+    }
+
+    _moveFileRecordsQuery->reset_and_clear_bindings();
+    _moveFileRecordsQuery->bindValue(1, from);
+    _moveFileRecordsQuery->bindValue(2, to);
+    _moveFileRecordsQuery->bindValue(3, to.size() - from.size());
+    return _moveFileRecordsQuery->exec();
+}
 
 bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec)
 {
@@ -1043,6 +1342,9 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
         return false;
 
     if (!filename.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+
         _getFileRecordQuery->reset_and_clear_bindings();
         _getFileRecordQuery->bindValue(1, getPHash(filename));
 
@@ -1061,6 +1363,9 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
                 close();
             }
         }
+
+        ++_fileRecordQueries;
+        _fileRecordQueryNsecs += timer.nsecsElapsed();
     }
     return true;
 }
@@ -1080,6 +1385,13 @@ bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *r
     if (!checkConnect())
         return false;
 
+    if (useRenameIndex()) {
+        auto it = _renameIndex->_byInode.constFind(inode);
+        if (it != _renameIndex->_byInode.constEnd())
+            *rec = _renameIndex->_records.at(*it);
+        return true;
+    }
+
     _getFileRecordQueryByInode->reset_and_clear_bindings();
     _getFileRecordQueryByInode->bindValue(1, inode);
 
@@ -1104,6 +1416,19 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     if (!checkConnect())
         return false;
 
+    if (useRenameIndex()) {
+        // Copied, the callback may change the journal and drop the index
+        const QVector<int> rows = _renameIndex->_byFileId.value(fileId);
+        const QVector<SyncJournalFileRecord> &records = _renameIndex->_records;
+        QVector<SyncJournalFileRecord> matches;
+        matches.reserve(rows.size());
+        foreach (int row, rows)
+            matches.append(records.at(row));
+        foreach (const SyncJournalFileRecord &rec, matches)
+            rowCallback(rec);
+        return true;
+    }
+
     _getFileRecordQueryByFileId->reset_and_clear_bindings();
     _getFileRecordQueryByFileId->bindValue(1, fileId);
 
@@ -1120,6 +1445,89 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     return true;
 }
 
+// Lookups beyond this many since the last change of the metadata table use the rename index
+static const int renameIndexLookupThreshold = 100;
+
+// Callers hold the mutex and made sure the database is open
+bool SyncJournalDb::useRenameIndex()
+{
+    if (_renameIndex)
+        return true;
+    if (++_renameIndexLookups < renameIndexLookupThreshold)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SqlQuery query(_db);
+    if (query.prepare(GET_FILE_RECORD_QUERY) != 0 || !query.exec()) {
+        qCWarning(lcDb) << "Could not read the records for the rename index:" << query.error();
+        _renameIndexLookups = 0;
+        return false;
+    }
+
+    QScopedPointer<RenameIndex> index(new RenameIndex);
+    while (query.next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, query);
+        const bool hasInode = rec._inode && !index->_byInode.contains(rec._inode);
+        if (!hasInode && rec._fileId.isEmpty())
+            continue;
+
+        const int row = index->_records.size();
+        if (hasInode)
+            index->_byInode.insert(rec._inode, row);
+        if (!rec._fileId.isEmpty())
+            index->_byFileId[rec._fileId].append(row);
+        index->_records.append(rec);
+    }
+
+    qCInfo(lcDb) << "Built the rename index of" << index->_records.size() << "records in" << timer.elapsed() << "ms";
+    _renameIndex.swap(index);
+    return true;
+}
+
+void SyncJournalDb::releaseRenameIndex()
+{
+    QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
+}
+
+void SyncJournalDb::invalidateRenameIndex()
+{
+    _renameIndex.reset();
+    _renameIndexLookups = 0;
+}
+
+bool SyncJournalDb::getFileRecordsByChecksum(const QByteArray &checksumHeader, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    QByteArray checksumType;
+    QByteArray checksum;
+    if (!parseChecksumHeader(checksumHeader, &checksumType, &checksum) || checksum.isEmpty() || _metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    _getFileRecordQueryByChecksum->reset_and_clear_bindings();
+    _getFileRecordQueryByChecksum->bindValue(1, checksum);
+    _getFileRecordQueryByChecksum->bindValue(2, checksumType);
+
+    if (!_getFileRecordQueryByChecksum->exec()) {
+        return false;
+    }
+
+    while (_getFileRecordQueryByChecksum->next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, *_getFileRecordQueryByChecksum);
+        rowCallback(rec);
+    }
+
+    return true;
+}
+
 bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
@@ -1146,10 +1554,11 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
     return true;
 }
 
-bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
+bool SyncJournalDb::postSyncCleanup(const QSet<QByteArray> &filepathsToKeep,
     const QSet<QString> &prefixesToKeep)
 {
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     if (!checkConnect()) {
         return false;
@@ -1165,9 +1574,10 @@ bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
     QByteArrayList superfluousItems;
 
     while (query.next()) {
-        const QString file = query.baValue(1);
-        bool keep = filepathsToKeep.contains(file);
-        if (!keep) {
+        const QByteArray fileUtf8 = query.baValue(1);
+        bool keep = filepathsToKeep.contains(fileUtf8);
+        if (!keep && !prefixesToKeep.isEmpty()) {
+            const QString file = QString::fromUtf8(fileUtf8);
             foreach (const QString &prefix, prefixesToKeep) {
                 if (file.startsWith(prefix)) {
                     keep = true;
@@ -1220,6 +1630,7 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
     const QByteArray &contentChecksumType)
 {
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     qCInfo(lcDb) << "Updating file checksum" << filename << contentChecksum << contentChecksumType;
 
@@ -1249,6 +1660,7 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
 
 {
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     qCInfo(lcDb) << "Updating local metadata for:" << filename << modtime << size << inode;
 
@@ -1515,6 +1927,51 @@ QVector<uint> SyncJournalDb::deleteStaleUploadInfos(const QSet<QString> &keep)
     return ids;
 }
 
+SyncJournalDb::BlockSignatures SyncJournalDb::getBlockSignatures(const QString &file)
+{
+    QMutexLocker locker(&_mutex);
+
+    BlockSignatures res;
+
+    if (checkConnect()) {
+        _getBlockSignaturesQuery->reset_and_clear_bindings();
+        _getBlockSignaturesQuery->bindValue(1, file);
+
+        if (!_getBlockSignaturesQuery->exec()) {
+            return res;
+        }
+
+        if (_getBlockSignaturesQuery->next()) {
+            res._etag = _getBlockSignaturesQuery->baValue(0);
+            res._blockSize = _getBlockSignaturesQuery->int64Value(1);
+            res._signatures = _getBlockSignaturesQuery->baValue(2);
+        }
+    }
+    return res;
+}
+
+void SyncJournalDb::setBlockSignatures(const QString &file, const BlockSignatures &signatures)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect()) {
+        return;
+    }
+
+    if (signatures.isValid()) {
+        _setBlockSignaturesQuery->reset_and_clear_bindings();
+        _setBlockSignaturesQuery->bindValue(1, file);
+        _setBlockSignaturesQuery->bindValue(2, signatures._etag);
+        _setBlockSignaturesQuery->bindValue(3, signatures._blockSize);
+        _setBlockSignaturesQuery->bindValue(4, signatures._signatures);
+        _setBlockSignaturesQuery->exec();
+    } else {
+        _deleteBlockSignaturesQuery->reset_and_clear_bindings();
+        _deleteBlockSignaturesQuery->bindValue(1, file);
+        _deleteBlockSignaturesQuery->exec();
+    }
+}
+
 SyncJournalErrorBlacklistRecord SyncJournalDb::errorBlacklistEntry(const QString &file)
 {
     QMutexLocker locker(&_mutex);
@@ -1774,6 +2231,7 @@ void SyncJournalDb::setSelectiveSyncList(SyncJournalDb::SelectiveSyncListType ty
 void SyncJournalDb::avoidRenamesOnNextSync(const QByteArray &path)
 {
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     if (!checkConnect()) {
         return;
@@ -1797,6 +2255,7 @@ void SyncJournalDb::avoidReadFromDbOnNextSync(const QByteArray &fileName)
     // We achieve that by clearing the etag of the parents directory recursively
 
     QMutexLocker locker(&_mutex);
+    invalidateRenameIndex();
 
     if (!checkConnect()) {
         return;
@@ -1827,6 +2286,7 @@ void SyncJournalDb::forceRemoteDiscoveryNextSync()
 void SyncJournalDb::forceRemoteDiscoveryNextSyncLocked()
 {
     qCInfo(lcDb) << "Forcing remote re-discovery by deleting folder Etags";
+    invalidateRenameIndex();
     SqlQuery deleteRemoteFolderEtagsQuery(_db);
     deleteRemoteFolderEtagsQuery.prepare("UPDATE metadata SET md5='_invalid_' WHERE type=2;");
     deleteRemoteFolderEtagsQuery.exec();
@@ -1918,6 +2378,7 @@ void SyncJournalDb::setDataFingerprint(const QByteArray &dataFingerprint)
 void SyncJournalDb::clearFileTable()
 {
     QMutexLocker lock(&_mutex);
+    invalidateRenameIndex();
     SqlQuery query(_db);
     query.prepare("DELETE FROM metadata;");
     query.exec();
@@ -22,7 +22,9 @@
 #include <QObject>
 #include <qmutex.h>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QHash>
+#include <QVector>
 #include <functional>
 
 #include "common/utility.h"
@@ -59,6 +61,8 @@ public:
     bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /// The records whose content checksum matches \a checksumHeader, of the form "type:checksum"
+    bool getFileRecordsByChecksum(const QByteArray &checksumHeader, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool setFileRecord(const SyncJournalFileRecord &record);
 
@@ -66,6 +70,12 @@ public:
     bool setFileRecordMetadata(const SyncJournalFileRecord &record);
 
     bool deleteFileRecord(const QString &filename, bool recursively = false);
+
+    /**
+     * Moves all records below the directory \a from below \a to, in a
+     * single statement. The record of \a from itself is left alone.
+     */
+    bool moveFileRecords(const QByteArray &from, const QByteArray &to);
     bool updateFileRecordChecksum(const QString &filename,
         const QByteArray &contentChecksum,
         const QByteArray &contentChecksumType);
@@ -74,6 +84,78 @@ public:
     bool exists();
     void walCheckpoint();
 
+    /// Frees the in-memory rename lookup index, called once rename detection is over
+    void releaseRenameIndex();
+
+    /// The parts of the journal maintenance, in the order they run
+    enum class MaintenanceStep {
+        Start, ///< drops the stale block signatures
+        Vacuum, ///< repeated until the free pages are gone
+        Analyze,
+        Finish, ///< truncates the -wal file and records the time
+        Done
+    };
+
+    /**
+     * Housekeeping for long-lived journals: reclaims free pages with an
+     * incremental vacuum, refreshes the query planner statistics with
+     * ANALYZE and truncates the -wal file. Block signatures of files that
+     * are no longer in the journal are dropped.
+     *
+     * Runs \a step and returns the one to run next. Each step is short and
+     * holds the journal lock only while it runs, so the steps can be spread
+     * out and the sequence given up between any two of them. Must not be
+     * called while a sync is running.
+     */
+    MaintenanceStep performMaintenanceStep(MaintenanceStep step);
+
+    /// Runs all the maintenance steps at once, returns whether all succeeded
+    bool performMaintenance();
+
+    /// When performMaintenance() last ran on this journal, invalid if it never did
+    QDateTime lastMaintenanceTime();
+
+    /// Size and usage statistics of the journal, see diagnostics()
+    struct DiagnosticsInfo
+    {
+        DiagnosticsInfo()
+            : _fileSize(0)
+            , _walFileSize(0)
+            , _pageSize(0)
+            , _pageCount(0)
+            , _freePageCount(0)
+            , _fileRecordCount(0)
+            , _downloadInfoCount(0)
+            , _uploadInfoCount(0)
+            , _errorBlacklistCount(0)
+            , _fileRecordQueries(0)
+            , _fileRecordQueryNsecs(0)
+            , _lastMaintenanceMsecs(-1)
+        {
+        }
+        qint64 _fileSize;
+        qint64 _walFileSize;
+        qint64 _pageSize;
+        qint64 _pageCount;
+        qint64 _freePageCount;
+        int _fileRecordCount;
+        int _downloadInfoCount;
+        int _uploadInfoCount;
+        int _errorBlacklistCount;
+        // getFileRecord() lookups since this object was created
+        quint64 _fileRecordQueries;
+        qint64 _fileRecordQueryNsecs;
+        // Duration of the last performMaintenance(), -1 if it never ran
+        qint64 _lastMaintenanceMsecs;
+
+    // State of the maintenance between its steps
+    bool _maintenanceOk;
+    QElapsedTimer _maintenanceTimer;
+    qint64 _maintenancePagesBefore;
+    qint64 _maintenanceFreePagesBefore;
+    };
+    DiagnosticsInfo diagnostics();
+
     QString databaseFilePath() const;
 
     static qint64 getPHash(const QByteArray &);
@@ -114,6 +196,21 @@ public:
         bool _valid;
     };
 
+    /** Block signatures of the remote version of a file, see DeltaSync */
+    struct BlockSignatures
+    {
+        BlockSignatures()
+            : _blockSize(0)
+        {
+        }
+        /// The etag of the version the signatures describe
+        QByteArray _etag;
+        qint64 _blockSize;
+        QByteArray _signatures;
+
+        bool isValid() const { return _blockSize > 0 && !_signatures.isEmpty(); }
+    };
+
     struct PollInfo
     {
         QString _file;
@@ -131,6 +228,10 @@ public:
     // Return the list of transfer ids that were removed.
     QVector<uint> deleteStaleUploadInfos(const QSet<QString> &keep);
 
+    BlockSignatures getBlockSignatures(const QString &file);
+    /// Stores the signatures, or removes them if they are not valid
+    void setBlockSignatures(const QString &file, const BlockSignatures &signatures);
+
     SyncJournalErrorBlacklistRecord errorBlacklistEntry(const QString &);
     bool deleteStaleErrorBlacklistEntries(const QSet<QString> &keep);
 
@@ -179,7 +280,8 @@ public:
      */
     void forceRemoteDiscoveryNextSync();
 
-    bool postSyncCleanup(const QSet<QString> &filepathsToKeep,
+    /// filepathsToKeep are UTF-8 encoded, like the paths in the database
+    bool postSyncCleanup(const QSet<QByteArray> &filepathsToKeep,
         const QSet<QString> &prefixesToKeep);
 
     /* Because sqlite transactions are really slow, we encapsulate everything in big transactions
@@ -224,6 +326,7 @@ private:
     void commitTransaction();
     QStringList tableColumns(const QString &table);
     bool checkConnect();
+    bool checkpointWal(const QByteArray &mode);
 
     // Same as forceRemoteDiscoveryNextSync but without acquiring the lock
     void forceRemoteDiscoveryNextSyncLocked();
@@ -239,10 +342,16 @@ private:
     int _transaction;
     bool _metadataTableIsEmpty;
 
+    // Timing statistics reported by diagnostics()
+    quint64 _fileRecordQueries;
+    qint64 _fileRecordQueryNsecs;
+    qint64 _lastMaintenanceMsecs;
+
     // NOTE! when adding a query, don't forget to reset it in SyncJournalDb::close
     QScopedPointer<SqlQuery> _getFileRecordQuery;
     QScopedPointer<SqlQuery> _getFileRecordQueryByInode;
     QScopedPointer<SqlQuery> _getFileRecordQueryByFileId;
+    QScopedPointer<SqlQuery> _getFileRecordQueryByChecksum;
     QScopedPointer<SqlQuery> _getFilesBelowPathQuery;
     QScopedPointer<SqlQuery> _setFileRecordQuery;
     QScopedPointer<SqlQuery> _setFileRecordChecksumQuery;
@@ -253,8 +362,12 @@ private:
     QScopedPointer<SqlQuery> _getUploadInfoQuery;
     QScopedPointer<SqlQuery> _setUploadInfoQuery;
     QScopedPointer<SqlQuery> _deleteUploadInfoQuery;
+    QScopedPointer<SqlQuery> _getBlockSignaturesQuery;
+    QScopedPointer<SqlQuery> _setBlockSignaturesQuery;
+    QScopedPointer<SqlQuery> _deleteBlockSignaturesQuery;
     QScopedPointer<SqlQuery> _deleteFileRecordPhash;
     QScopedPointer<SqlQuery> _deleteFileRecordRecursively;
+    QScopedPointer<SqlQuery> _moveFileRecordsQuery;
     QScopedPointer<SqlQuery> _getErrorBlacklistQuery;
     QScopedPointer<SqlQuery> _setErrorBlacklistQuery;
     QScopedPointer<SqlQuery> _getSelectiveSyncListQuery;
@@ -265,6 +378,22 @@ private:
     QScopedPointer<SqlQuery> _setDataFingerprintQuery1;
     QScopedPointer<SqlQuery> _setDataFingerprintQuery2;
 
+    /* Rename detection looks up every new file by inode or file id. Once
+     * there were many such lookups, the records are read with a single table
+     * scan and looked up in memory. Any change to the metadata table drops
+     * the index again.
+     */
+    struct RenameIndex
+    {
+        QVector<SyncJournalFileRecord> _records;
+        QHash<quint64, int> _byInode;
+        QHash<QByteArray, QVector<int>> _byFileId;
+    };
+    bool useRenameIndex();
+    void invalidateRenameIndex();
+    QScopedPointer<RenameIndex> _renameIndex;
+    int _renameIndexLookups;
+
     /* This is the list of paths we called avoidReadFromDbOnNextSync on.
      * It means that they should not be written to the DB in any case since doing
      * that would write the etag and would void the purpose of avoidReadFromDbOnNextSync
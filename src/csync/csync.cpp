@@ -313,7 +313,10 @@ int csync_s::reinitialize() {
   status_code = CSYNC_STATUS_OK;
 
   remote.read_from_db = 0;
+  local.read_from_db = false;
   read_remote_from_db = true;
+  local_discovery_incomplete = false;
+  local_changed_dirs.clear();
 
   local.files.clear();
   remote.files.clear();
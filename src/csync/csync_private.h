@@ -38,6 +38,8 @@
 #include <stdbool.h>
 #include <sqlite3.h>
 #include <map>
+#include <atomic>
+#include <functional>
 
 #include "common/syncjournaldb.h"
 #include "config_csync.h"
@@ -162,6 +164,7 @@ struct OCSYNC_EXPORT csync_s {
   struct {
     char *uri = nullptr;
     FileMap files;
+    bool read_from_db = false;
   } local;
 
   struct {
@@ -190,6 +193,25 @@ struct OCSYNC_EXPORT csync_s {
    */
   bool read_remote_from_db = false;
 
+  /**
+   * If set, local directories that are unchanged according to the database and
+   * for which this returns false are read from the database instead of the disk.
+   */
+  std::function<bool(const QByteArray &)> should_discover_locally_fn;
+
+  /**
+   * Set by the reconciler when an entry read from the database differs from the disk
+   * and a full local discovery is needed to decide what to do with it.
+   */
+  std::atomic<bool> local_discovery_incomplete{ false };
+
+  /**
+   * Whether the subtree of a local directory read from the database differs from the
+   * disk, filled by the reconciler so that each directory is listed only once.
+   * Only used by the entries that are reconciled serially.
+   */
+  QHash<QByteArray, bool> local_changed_dirs;
+
   bool ignore_hidden_files = true;
 
   csync_s(const char *localUri, OCC::SyncJournalDb *statedb);
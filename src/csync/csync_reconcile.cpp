@@ -27,8 +27,17 @@
 #include "csync_rename.h"
 #include "common/c_jhash.h"
 #include "common/asserts.h"
+#include "common/utility.h"
 
+#include <QDirIterator>
+#include <QFileInfo>
 #include <QLoggingCategory>
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include <atomic>
+#include <vector>
+
 Q_LOGGING_CATEGORY(lcReconcile, "sync.csync.reconciler", QtInfoMsg)
 
 // Needed for PRIu64 on MinGW in C++ mode.
@@ -91,6 +100,53 @@ static csync_file_stat_t *_csync_check_ignored(csync_s::FileMap *tree, const Byt
  * (timestamp is newer), it is not overwritten. If both files, on the
  * source and the destination, have been changed, the newer file wins.
  */
+/* Whether a local entry that was read from the database is different on disk:
+ * a file that was modified, or a directory containing anything the database does
+ * not know about, like ignored files, or a modified file.
+ * A missing entry is not a difference, it is about to be removed anyway. */
+static bool _csync_local_file_changed(const QFileInfo &info, const csync_file_stat_t *fs)
+{
+    return info.size() != fs->size
+        || OCC::Utility::qDateTimeToTime_t(info.lastModified()) != fs->modtime;
+}
+
+/* Lists the directory and its sub directories once, the result is cached in ctx->local_changed_dirs
+ * because every entry below a removed directory asks for it. */
+static bool _csync_local_dir_changed(CSYNC *ctx, const QString &root, const QByteArray &path)
+{
+    auto cached = ctx->local_changed_dirs.constFind(path);
+    if (cached != ctx->local_changed_dirs.constEnd()) {
+        return cached.value();
+    }
+
+    bool changed = false;
+    QDirIterator it(root + QString::fromUtf8(path), QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (!changed && it.hasNext()) {
+        it.next();
+        const QByteArray childPath = path + '/' + it.fileName().toUtf8();
+        csync_file_stat_t *fs = ctx->local.files.findFile(childPath);
+        if (!fs || it.fileInfo().isDir() != (fs->type == CSYNC_FTW_TYPE_DIR)) {
+            changed = true;
+        } else if (fs->type == CSYNC_FTW_TYPE_DIR) {
+            changed = _csync_local_dir_changed(ctx, root, childPath);
+        } else {
+            changed = _csync_local_file_changed(it.fileInfo(), fs);
+        }
+    }
+    ctx->local_changed_dirs.insert(path, changed);
+    return changed;
+}
+
+static bool _csync_local_entry_changed(CSYNC *ctx, csync_file_stat_t *cur)
+{
+    const QString root = QString::fromUtf8(ctx->local.uri) + QLatin1Char('/');
+    if (cur->type == CSYNC_FTW_TYPE_DIR) {
+        return _csync_local_dir_changed(ctx, root, cur->path);
+    }
+    const QFileInfo info(root + QString::fromUtf8(cur->path));
+    return info.exists() && _csync_local_file_changed(info, cur);
+}
+
 static int _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx) {
     csync_s::FileMap *our_tree = nullptr;
     csync_s::FileMap *other_tree = nullptr;
@@ -135,6 +191,12 @@ static int _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx) {
                 /* Do not remove a directory that has ignored files */
                 break;
             }
+            if (cur->from_db && _csync_local_entry_changed(ctx, cur)) {
+                /* The disk was not looked at, let a full local discovery decide */
+                qCInfo(lcReconcile, "%s differs from the database, not removing it", cur->path.constData());
+                ctx->local_discovery_incomplete = true;
+                break;
+            }
             if (cur->child_modified) {
                 /* re-create directory that has modified contents */
                 cur->instruction = CSYNC_INSTRUCTION_NEW;
@@ -418,25 +480,97 @@ static int _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx) {
     return 0;
 }
 
+/* Smaller trees are reconciled on the calling thread. The
+ * OWNCLOUD_PARALLEL_RECONCILE_THRESHOLD environment variable overrides it. */
+static size_t _csync_parallel_reconcile_threshold()
+{
+  bool ok = false;
+  const int threshold = qEnvironmentVariableIntValue("OWNCLOUD_PARALLEL_RECONCILE_THRESHOLD", &ok);
+  return ok && threshold >= 0 ? threshold : 10000;
+}
+
+/* Whether reconciling cur may touch entries of other top-level subtrees:
+ * rename detection and lookups through renamed parent directories. Entries
+ * read from the database without a match may be checked against the disk,
+ * which fills the ctx->local_changed_dirs cache. */
+static bool _csync_reconcile_needs_serial(csync_file_stat_t *cur, CSYNC *ctx, csync_s::FileMap *other_tree)
+{
+  if (cur->instruction == CSYNC_INSTRUCTION_EVAL_RENAME) {
+    return true;
+  }
+  if (!ctx->renames.folder_renamed_to.empty() || cur->from_db) {
+    return !other_tree->findFile(cur->path);
+  }
+  return false;
+}
+
 int csync_reconcile_updates(CSYNC *ctx) {
   csync_s::FileMap *tree = nullptr;
+  csync_s::FileMap *other_tree = nullptr;
 
   switch (ctx->current) {
     case LOCAL_REPLICA:
       tree = &ctx->local.files;
+      other_tree = &ctx->remote.files;
       break;
     case REMOTE_REPLICA:
       tree = &ctx->remote.files;
+      other_tree = &ctx->local.files;
       break;
     default:
       break;
   }
 
+  const int threads = QThread::idealThreadCount();
+  if (tree->size() < _csync_parallel_reconcile_threshold() || threads < 2) {
+    for (auto &pair : *tree) {
+      if (_csync_merge_algorithm_visitor(pair.second.get(), ctx) < 0) {
+        ctx->status_code = CSYNC_STATUS_RECONCILE_ERROR;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  /* Apart from renames, reconciling an entry only looks at the same path and
+   * its parents in the other tree. Those all share the top-level directory,
+   * so the top-level subtrees can be reconciled concurrently. More buckets
+   * than threads even out subtrees of different sizes. The entries that may
+   * reach into other subtrees are reconciled afterwards, one by one. */
+  std::vector<std::vector<csync_file_stat_t *>> buckets(threads * 4);
+  std::vector<csync_file_stat_t *> serial;
   for (auto &pair : *tree) {
-    if (_csync_merge_algorithm_visitor(pair.second.get(), ctx) < 0) {
-      ctx->status_code = CSYNC_STATUS_RECONCILE_ERROR;
-      return -1;
+    csync_file_stat_t *cur = pair.second.get();
+    if (_csync_reconcile_needs_serial(cur, ctx, other_tree)) {
+      serial.push_back(cur);
+      continue;
+    }
+    int topLevelSize = cur->path.indexOf('/');
+    if (topLevelSize < 0) {
+      topLevelSize = cur->path.size();
+    }
+    buckets[qHashBits(cur->path.constData(), topLevelSize) % buckets.size()].push_back(cur);
+  }
+
+  std::atomic<bool> failed(false);
+  QtConcurrent::blockingMap(buckets, [ctx, &failed](const std::vector<csync_file_stat_t *> &bucket) {
+    for (csync_file_stat_t *cur : bucket) {
+      if (failed || _csync_merge_algorithm_visitor(cur, ctx) < 0) {
+        failed = true;
+        return;
+      }
     }
+  });
+  for (csync_file_stat_t *cur : serial) {
+    if (failed || _csync_merge_algorithm_visitor(cur, ctx) < 0) {
+      failed = true;
+      break;
+    }
+  }
+
+  if (failed) {
+    ctx->status_code = CSYNC_STATUS_RECONCILE_ERROR;
+    return -1;
   }
   return 0;
 }
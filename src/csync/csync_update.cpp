@@ -209,6 +209,15 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
 
           goto out;
       }
+      if (fs->type == CSYNC_FTW_TYPE_DIR && ctx->current == LOCAL_REPLICA
+              && base._type == fs->type && fs->inode == base._inode
+              && ctx->should_discover_locally_fn && !ctx->should_discover_locally_fn(fs->path)) {
+          /* Nothing changed below this directory according to the file watcher.
+           * The mtime of directories is not synced, so it is not compared here.
+           */
+          qCDebug(lcUpdate, "Reading local entries from database: %s", fs->path.constData());
+          ctx->local.read_from_db = true;
+      }
       if (ctx->current == LOCAL_REPLICA &&
               (!_csync_mtime_equal(fs->modtime, base._modtime)
                // zero size in statedb can happen during migration
@@ -474,15 +483,18 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
 {
     int64_t count = 0;
     QByteArray skipbase;
-    auto rowCallback = [ctx, &count, &skipbase](const OCC::SyncJournalFileRecord &rec) {
+    const bool local = ctx->current == LOCAL_REPLICA;
+    csync_s::FileMap &files = local ? ctx->local.files : ctx->remote.files;
+    auto rowCallback = [ctx, local, &files, &count, &skipbase](const OCC::SyncJournalFileRecord &rec) {
         /* When selective sync is used, the database may have subtrees with a parent
          * whose etag (md5) is _invalid_. These are ignored and shall not appear in the
          * remote tree.
          * Sometimes folders that are not ignored by selective sync get marked as
          * _invalid_, but that is not a problem as the next discovery will retrieve
          * their correct etags again and we don't run into this case.
+         * The etag says nothing about the local tree, where such folders exist.
          */
-        if( rec._etag == "_invalid_") {
+        if (!local && rec._etag == "_invalid_") {
             qCDebug(lcUpdate, "%s selective sync excluded", rec._path.constData());
             skipbase = rec._path;
             skipbase += '/';
@@ -499,6 +511,11 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
         }
 
         std::unique_ptr<csync_file_stat_t> st = csync_file_stat_t::fromSyncJournalFileRecord(rec);
+        if (local) {
+            /* The ignored files of the server are not the local ones */
+            st->has_ignored_files = false;
+            st->from_db = true;
+        }
 
         /* Check for exclusion from the tree.
          * Note that this is only a safety net in case the ignore list changes
@@ -516,7 +533,7 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
         }
 
         /* store into result list. */
-        ctx->remote.files[rec._path] = std::move(st);
+        files[rec._path] = std::move(st);
         ++count;
     };
 
@@ -558,9 +575,11 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   std::unique_ptr<csync_file_stat_t> dirent;
   csync_file_stat_t *previous_fs = NULL;
   int read_from_db = 0;
+  bool local_read_from_db = false;
   int rc = 0;
 
-  bool do_read_from_db = (ctx->current == REMOTE_REPLICA && ctx->remote.read_from_db);
+  bool do_read_from_db = (ctx->current == REMOTE_REPLICA && ctx->remote.read_from_db)
+      || (ctx->current == LOCAL_REPLICA && ctx->local.read_from_db);
 
   if (!depth) {
     mark_current_item_ignored(ctx, previous_fs, CSYNC_STATUS_INDIVIDUAL_TOO_DEEP);
@@ -568,11 +587,15 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   }
 
   read_from_db = ctx->remote.read_from_db;
+  local_read_from_db = ctx->local.read_from_db;
 
   // if the etag of this dir is still the same, its content is restored from the
-  // database.
+  // database. Locally the same happens for directories the file watcher did not
+  // report changes for.
   if( do_read_from_db ) {
-      if( ! fill_tree_from_db(ctx, uri) ) {
+      // The local uri is absolute, the database has paths relative to the sync root
+      const char *path = ctx->current == LOCAL_REPLICA ? uri + strlen(ctx->local.uri) + 1 : uri;
+      if( ! fill_tree_from_db(ctx, path) ) {
         errno = ENOENT;
         ctx->status_code = CSYNC_STATUS_OPENDIR_ERROR;
         goto error;
@@ -717,6 +740,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
 
     ctx->current_fs = previous_fs;
     ctx->remote.read_from_db = read_from_db;
+    ctx->local.read_from_db = local_read_from_db;
   }
 
   csync_vio_closedir(ctx, dh);
@@ -726,6 +750,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
 
 error:
   ctx->remote.read_from_db = read_from_db;
+  ctx->local.read_from_db = local_read_from_db;
   if (dh != NULL) {
     csync_vio_closedir(ctx, dh);
   }
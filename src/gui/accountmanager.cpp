@@ -66,6 +66,7 @@ bool AccountManager::restore()
         settings->beginGroup(accountId);
         if (auto acc = loadAccountHelper(*settings)) {
             acc->_id = accountId;
+            acc->restoreTlsSession();
             if (auto accState = AccountState::loadFromSettings(acc, *settings)) {
                 addAccountState(accState);
             }
@@ -214,6 +215,7 @@ void AccountManager::saveAccountHelper(Account *acc, QSettings &settings, bool s
             jar->save(acc->cookieJarPath());
         }
     }
+    acc->saveTlsSession();
 }
 
 AccountPtr AccountManager::loadAccountHelper(QSettings &settings)
@@ -305,9 +307,10 @@ void AccountManager::deleteAccount(AccountState *account)
     auto copy = *it; // keep a reference to the shared pointer so it does not delete it just yet
     _accounts.erase(it);
 
-    // Forget account credentials, cookies
+    // Forget account credentials, cookies, TLS session
     account->account()->credentials()->forgetSensitiveData();
     QFile::remove(account->account()->cookieJarPath());
+    QFile::remove(account->account()->tlsSessionPath());
 
     auto settings = ConfigFile::settingsWithGroup(QLatin1String(accountsC));
     settings->remove(account->account()->id());
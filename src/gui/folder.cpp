@@ -31,10 +31,12 @@
 #include "theme.h"
 #include "filesystem.h"
 #include "excludedfiles.h"
+#include "folderwatcher.h"
 
 #include "creds/abstractcredentials.h"
 
 #include <QTimer>
+#include <qtconcurrentrun.h>
 #include <QUrl>
 #include <QDir>
 #include <QSettings>
@@ -54,12 +56,17 @@ Folder::Folder(const FolderDefinition &definition,
     , _definition(definition)
     , _csyncUnavail(false)
     , _proxyDirty(true)
+    , _journalMaintenanceStep(SyncJournalDb::MaintenanceStep::Done)
+    , _journalMaintenanceInterrupted(false)
+    , _lastJournalMaintenanceRead(false)
     , _lastSyncDuration(0)
     , _consecutiveFailingSyncs(0)
     , _consecutiveFollowUpSyncs(0)
+    , _fullLocalDiscoveryRunning(false)
     , _journal(_definition.absoluteJournalPath())
     , _fileLog(new SyncRunFileLog)
     , _saveBackwardsCompatible(false)
+    , _hasPendingProgress(false)
 {
     _timeSinceLastSyncStart.start();
     _timeSinceLastSyncDone.start();
@@ -88,6 +95,7 @@ Folder::Folder(const FolderDefinition &definition,
     connect(_engine.data(), &SyncEngine::started, this, &Folder::slotSyncStarted, Qt::QueuedConnection);
     connect(_engine.data(), &SyncEngine::finished, this, &Folder::slotSyncFinished, Qt::QueuedConnection);
     connect(_engine.data(), &SyncEngine::csyncUnavailable, this, &Folder::slotCsyncUnavailable, Qt::QueuedConnection);
+    connect(&_journalMaintenanceWatcher, &QFutureWatcherBase::finished, this, &Folder::slotJournalMaintenanceStepFinished);
 
     //direct connection so the message box is blocking the sync.
     connect(_engine.data(), &SyncEngine::aboutToRemoveAllFiles,
@@ -108,12 +116,23 @@ Folder::Folder(const FolderDefinition &definition,
     _scheduleSelfTimer.setInterval(SyncEngine::minimumFileAgeForUpload);
     connect(&_scheduleSelfTimer, &QTimer::timeout,
         this, &Folder::slotScheduleThisFolder);
+
+    _progressTimer.setSingleShot(true);
+    connect(&_progressTimer, &QTimer::timeout, this, &Folder::slotEmitPendingProgress);
+
+    // Completed items reach the views in batches, about once per frame
+    _completedItemsTimer.setSingleShot(true);
+    _completedItemsTimer.setInterval(16);
+    connect(&_completedItemsTimer, &QTimer::timeout, this, &Folder::slotEmitCompletedItems);
 }
 
 Folder::~Folder()
 {
     // Reset then engine first as it will abort and try to access members of the Folder
     _engine.reset();
+
+    // The journal must outlive the maintenance thread
+    _journalMaintenanceWatcher.waitForFinished();
 }
 
 
@@ -211,6 +230,64 @@ bool Folder::isBusy() const
     return _engine->isSyncRunning();
 }
 
+qint64 Folder::msecSinceLastJournalMaintenance()
+{
+    // Stored in the journal so that it survives restarts of the client,
+    // only read once since the scheduler asks all the time
+    if (!_lastJournalMaintenanceRead) {
+        _lastJournalMaintenance = _journal.lastMaintenanceTime();
+        _lastJournalMaintenanceRead = true;
+    }
+    if (!_lastJournalMaintenance.isValid())
+        return -1;
+    return qMax<qint64>(0, _lastJournalMaintenance.msecsTo(QDateTime::currentDateTimeUtc()));
+}
+
+void Folder::runJournalMaintenance()
+{
+    if (isBusy() || isJournalMaintenanceRunning()) {
+        qCInfo(lcFolder) << "Not running journal maintenance for" << alias() << "while it is busy";
+        return;
+    }
+
+    qCInfo(lcFolder) << "Running journal maintenance for" << alias();
+    _journalMaintenanceInterrupted = false;
+    startJournalMaintenanceStep(SyncJournalDb::MaintenanceStep::Start);
+}
+
+void Folder::interruptJournalMaintenance()
+{
+    if (isJournalMaintenanceRunning()) {
+        _journalMaintenanceInterrupted = true;
+    }
+}
+
+void Folder::startJournalMaintenanceStep(SyncJournalDb::MaintenanceStep step)
+{
+    _journalMaintenanceStep = step;
+    _journalMaintenanceWatcher.setFuture(QtConcurrent::run(&_journal, &SyncJournalDb::performMaintenanceStep, step));
+}
+
+void Folder::slotJournalMaintenanceStepFinished()
+{
+    SyncJournalDb::MaintenanceStep next = _journalMaintenanceWatcher.result();
+    if (next == SyncJournalDb::MaintenanceStep::Done) {
+        _lastJournalMaintenance = QDateTime::currentDateTimeUtc();
+        _lastJournalMaintenanceRead = true;
+    } else if (_journalMaintenanceInterrupted || isBusy()) {
+        // Started over from the beginning the next time the folder is idle
+        qCInfo(lcFolder) << "Journal maintenance for" << alias() << "interrupted before" << int(next);
+        next = SyncJournalDb::MaintenanceStep::Done;
+    } else {
+        // Through the event loop, so that the socket api gets the journal in between
+        startJournalMaintenanceStep(next);
+        return;
+    }
+
+    _journalMaintenanceStep = next;
+    emit journalMaintenanceFinished();
+}
+
 QString Folder::remotePath() const
 {
     return _definition.targetPath;
@@ -476,6 +553,10 @@ void Folder::slotWatchedPathChanged(const QString &path)
         }
     }
 
+    if (path.startsWith(this->path())) {
+        _localDiscoveryPaths.insert(path.mid(this->path().size()).toUtf8());
+    }
+
     emit watchedFileChangedExternally(path);
 
     // Also schedule this folder for a sync, but only after some delay:
@@ -483,6 +564,34 @@ void Folder::slotWatchedPathChanged(const QString &path)
     scheduleThisFolderSoon();
 }
 
+void Folder::slotNextSyncFullLocalDiscovery()
+{
+    _timeSinceLastFullLocalDiscovery.invalidate();
+}
+
+void Folder::setFolderWatcher(FolderWatcher *watcher)
+{
+    _folderWatcher = watcher;
+    // Changes may have been missed before
+    slotNextSyncFullLocalDiscovery();
+    connect(watcher, &FolderWatcher::error, this, &Folder::slotNextSyncFullLocalDiscovery);
+    connect(watcher, &FolderWatcher::lostChanges, this, &Folder::slotNextSyncFullLocalDiscovery);
+    connect(watcher, &FolderWatcher::lostChanges, this, &Folder::scheduleThisFolderSoon);
+}
+
+bool Folder::needsFullLocalDiscovery() const
+{
+    // Seconds between two syncs that read all local directories from the disk
+    static const qint64 fullLocalDiscoveryInterval = [] {
+        QByteArray env = qgetenv("OWNCLOUD_FULL_LOCAL_DISCOVERY_INTERVAL");
+        return env.isEmpty() ? 3600 : env.toLongLong();
+    }();
+
+    return !_folderWatcher
+        || !_timeSinceLastFullLocalDiscovery.isValid()
+        || _timeSinceLastFullLocalDiscovery.hasExpired(fullLocalDiscoveryInterval * 1000);
+}
+
 void Folder::saveToSettings() const
 {
     // Remove first to make sure we don't get duplicates
@@ -647,6 +756,16 @@ void Folder::startSync(const QStringList &pathList)
 
     _engine->setIgnoreHiddenFiles(_definition.ignoreHiddenFiles);
 
+    // Changes reported from now on are for the next sync
+    _fullLocalDiscoveryRunning = needsFullLocalDiscovery();
+    if (_fullLocalDiscoveryRunning) {
+        qCInfo(lcFolder) << "Reading all local directories from the disk";
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+    } else {
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, std::move(_localDiscoveryPaths));
+    }
+    _localDiscoveryPaths.clear();
+
     QMetaObject::invokeMethod(_engine.data(), "startSync", Qt::QueuedConnection);
 
     emit syncStarted();
@@ -752,6 +871,7 @@ void Folder::slotSyncFinished(bool success)
     }
     _fileLog->finish();
     showSyncResultPopup();
+    slotEmitCompletedItems();
 
     auto anotherSyncNeeded = _engine->isAnotherSyncNeeded();
 
@@ -778,6 +898,15 @@ void Folder::slotSyncFinished(bool success)
         qCInfo(lcFolder) << "the last" << _consecutiveFailingSyncs << "syncs failed";
     }
 
+    // The reported paths were handed to the engine: without a successful
+    // sync, the next one must look at everything
+    if (!success || _engine->isLocalDiscoveryIncomplete()
+        || (_syncResult.status() != SyncResult::Success && _syncResult.status() != SyncResult::Problem)) {
+        slotNextSyncFullLocalDiscovery();
+    } else if (_fullLocalDiscoveryRunning) {
+        _timeSinceLastFullLocalDiscovery.start();
+    }
+
     if (_syncResult.status() == SyncResult::Success && success) {
         // Clear the white list as all the folders that should be on that list are sync-ed
         journalDb()->setSelectiveSyncList(SyncJournalDb::SelectiveSyncWhiteList, QStringList());
@@ -834,10 +963,38 @@ void Folder::slotEmitFinishedDelayed()
 // and hand the result over to the progress dispatcher.
 void Folder::slotTransmissionProgress(const ProgressInfo &pi)
 {
+    static const qint64 progressIntervalMs = 100;
+
+    // Status changes are shown right away, the progress of running transfers
+    // and completed items is coalesced. The views get each completed item
+    // through ProgressDispatcher::itemsCompleted.
+    bool isPropagationProgress = pi._status == ProgressInfo::Propagation;
+    if (isPropagationProgress && _timeSinceLastProgress.isValid()
+        && _timeSinceLastProgress.elapsed() < progressIntervalMs) {
+        _pendingProgress.copyProgressFrom(pi);
+        _hasPendingProgress = true;
+        if (!_progressTimer.isActive())
+            _progressTimer.start(progressIntervalMs - _timeSinceLastProgress.elapsed());
+        return;
+    }
+
+    _progressTimer.stop();
+    _hasPendingProgress = false;
+    _timeSinceLastProgress.start();
     emit progressInfo(pi);
     ProgressDispatcher::instance()->setProgressInfo(alias(), pi);
 }
 
+void Folder::slotEmitPendingProgress()
+{
+    if (!_hasPendingProgress)
+        return;
+    _hasPendingProgress = false;
+    _timeSinceLastProgress.start();
+    emit progressInfo(_pendingProgress);
+    ProgressDispatcher::instance()->setProgressInfo(alias(), _pendingProgress);
+}
+
 // a item is completed: count the errors and forward to the ProgressDispatcher
 void Folder::slotItemCompleted(const SyncFileItemPtr &item)
 {
@@ -846,6 +1003,12 @@ void Folder::slotItemCompleted(const SyncFileItemPtr &item)
         return;
     }
 
+    // The next sync must look at what failed, even if nothing changes on disk
+    if (item->hasErrorStatus()) {
+        _localDiscoveryPaths.insert(item->_file.toUtf8());
+        _localDiscoveryPaths.insert(item->destination().toUtf8());
+    }
+
     // add new directories or remove gone away dirs to the watcher
     if (item->isDirectory() && item->_instruction == CSYNC_INSTRUCTION_NEW) {
         FolderMan::instance()->addMonitorPath(alias(), path() + item->_file);
@@ -857,7 +1020,20 @@ void Folder::slotItemCompleted(const SyncFileItemPtr &item)
     _syncResult.processCompletedItem(item);
 
     _fileLog->logItem(*item);
-    emit ProgressDispatcher::instance()->itemCompleted(alias(), item);
+
+    _pendingCompletedItems.append(item);
+    if (!_completedItemsTimer.isActive())
+        _completedItemsTimer.start();
+}
+
+void Folder::slotEmitCompletedItems()
+{
+    _completedItemsTimer.stop();
+    if (_pendingCompletedItems.isEmpty())
+        return;
+    SyncFileItemVector items;
+    items.swap(_pendingCompletedItems);
+    emit ProgressDispatcher::instance()->itemsCompleted(alias(), items);
 }
 
 void Folder::slotNewBigFolderDiscovered(const QString &newF, bool isExternal)
@@ -26,8 +26,12 @@
 #include <csync.h>
 
 #include <QObject>
+#include <QFutureWatcher>
+#include <QPointer>
 #include <QStringList>
 
+#include <set>
+
 class QThread;
 class QSettings;
 
@@ -36,6 +40,7 @@ namespace OCC {
 class SyncEngine;
 class AccountState;
 class SyncRunFileLog;
+class FolderWatcher;
 
 /**
  * @brief The FolderDefinition class
@@ -195,6 +200,23 @@ public:
     int consecutiveFollowUpSyncs() const { return _consecutiveFollowUpSyncs; }
     int consecutiveFailingSyncs() const { return _consecutiveFailingSyncs; }
 
+    /// Milliseconds since the journal maintenance last ran, -1 if it never did
+    qint64 msecSinceLastJournalMaintenance();
+
+    /**
+     * Vacuums and analyzes the sync journal in a worker thread, one
+     * SyncJournalDb::performMaintenanceStep() at a time.
+     *
+     * Does nothing while the folder is syncing. No sync may start before
+     * journalMaintenanceFinished() was emitted.
+     */
+    void runJournalMaintenance();
+
+    /// Gives up the running maintenance after its current step, it starts over the next time
+    void interruptJournalMaintenance();
+
+    bool isJournalMaintenanceRunning() const { return _journalMaintenanceStep != SyncJournalDb::MaintenanceStep::Done; }
+
     /// Saves the folder data in the account's settings.
     void saveToSettings() const;
     /// Removes the folder from the account's settings.
@@ -235,6 +257,7 @@ signals:
     void newBigFolderDiscovered(const QString &); // A new folder bigger than the threshold was discovered
     void syncPausedChanged(Folder *, bool paused);
     void canSyncChanged();
+    void journalMaintenanceFinished();
 
     /**
      * Fires for each change inside this folder that wasn't caused
@@ -276,6 +299,16 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path);
 
+    /**
+     * Read all local directories from the disk in the next sync, instead
+     * of relying on the folder watcher. For example when the ignore list
+     * changed or the folder watcher failed.
+     */
+    void slotNextSyncFullLocalDiscovery();
+
+    /// Called by the FolderMan when it starts watching this folder
+    void setFolderWatcher(FolderWatcher *watcher);
+
 private slots:
     void slotSyncStarted();
     void slotSyncFinished(bool);
@@ -287,7 +320,9 @@ private slots:
     void slotCsyncUnavailable();
 
     void slotTransmissionProgress(const ProgressInfo &pi);
+    void slotEmitPendingProgress();
     void slotItemCompleted(const SyncFileItemPtr &);
+    void slotEmitCompletedItems();
 
     void slotRunEtagJob();
     void etagRetreived(const QString &);
@@ -304,6 +339,9 @@ private slots:
      */
     void slotScheduleThisFolder();
 
+    /// Runs the next maintenance step unless the maintenance is done or interrupted
+    void slotJournalMaintenanceStepFinished();
+
 private:
     bool setIgnoredFiles();
 
@@ -313,6 +351,11 @@ private:
 
     void setSyncOptions();
 
+    void startJournalMaintenanceStep(SyncJournalDb::MaintenanceStep step);
+
+    /// Whether the next sync must read all local directories from the disk
+    bool needsFullLocalDiscovery() const;
+
     enum LogStatus {
         LogStatusRemove,
         LogStatusRename,
@@ -338,6 +381,25 @@ private:
     QString _lastEtag;
     QElapsedTimer _timeSinceLastSyncDone;
     QElapsedTimer _timeSinceLastSyncStart;
+    QFutureWatcher<SyncJournalDb::MaintenanceStep> _journalMaintenanceWatcher;
+    /// The step that runs, Done if the maintenance doesn't
+    SyncJournalDb::MaintenanceStep _journalMaintenanceStep;
+    bool _journalMaintenanceInterrupted;
+    /// Cache of SyncJournalDb::lastMaintenanceTime(), valid once _lastJournalMaintenanceRead
+    QDateTime _lastJournalMaintenance;
+    bool _lastJournalMaintenanceRead;
+
+    /// Invalid when the next sync must be a full local discovery
+    QElapsedTimer _timeSinceLastFullLocalDiscovery;
+
+    /**
+     * The paths, relative to the folder, that the folder watcher reported
+     * since the start of the last sync. The others are read from the
+     * journal, see SyncEngine::setLocalDiscoveryOptions().
+     */
+    std::set<QByteArray> _localDiscoveryPaths;
+
+    QPointer<FolderWatcher> _folderWatcher;
     qint64 _lastSyncDuration;
 
     /// The number of syncs that failed in a row.
@@ -348,6 +410,9 @@ private:
     /// Reset when no follow-up is requested.
     int _consecutiveFollowUpSyncs;
 
+    /// Whether the running sync reads all local directories from the disk
+    bool _fullLocalDiscoveryRunning;
+
     SyncJournalDb _journal;
 
     ClientProxy _clientProxy;
@@ -356,6 +421,21 @@ private:
 
     QTimer _scheduleSelfTimer;
 
+    /**
+     * Progress of the propagation is forwarded to the GUI at most
+     * every progressIntervalMs, so that a slow GUI does not hold up
+     * the network jobs that run in the same event loop.
+     */
+    QElapsedTimer _timeSinceLastProgress;
+    QTimer _progressTimer;
+    /// Copy of the latest progress that was held back, valid if _hasPendingProgress
+    ProgressInfo _pendingProgress;
+    bool _hasPendingProgress;
+
+    /// Completed items not yet delivered to ProgressDispatcher::itemsCompleted()
+    SyncFileItemVector _pendingCompletedItems;
+    QTimer _completedItemsTimer;
+
     /**
      * When the same local path is synced to multiple accounts, only one
      * of them can be stored in the settings in a way that's compatible
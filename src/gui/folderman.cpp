@@ -23,6 +23,7 @@
 #include "accountmanager.h"
 #include "filesystem.h"
 #include "lockwatcher.h"
+#include "changenotifier.h"
 #include "common/asserts.h"
 #include <syncengine.h>
 
@@ -42,6 +43,9 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcFolderMan, "gui.folder.manager", QtInfoMsg)
 
+// How much less often folders are polled while their server notifies of changes
+static const int notifiedPollIntervalFactor = 10;
+
 FolderMan *FolderMan::_instance = 0;
 
 FolderMan::FolderMan(QObject *parent)
@@ -73,6 +77,12 @@ FolderMan::FolderMan(QObject *parent)
         this, &FolderMan::slotScheduleFolderByTime);
     _timeScheduler.start();
 
+    _journalMaintenanceTimer.setInterval(10 * 60 * 1000);
+    _journalMaintenanceTimer.setSingleShot(false);
+    connect(&_journalMaintenanceTimer, &QTimer::timeout,
+        this, &FolderMan::slotRunJournalMaintenance);
+    _journalMaintenanceTimer.start();
+
     connect(AccountManager::instance(), &AccountManager::accountRemoved,
         this, &FolderMan::slotRemoveFoldersForAccount);
 
@@ -164,6 +174,7 @@ void FolderMan::registerFolderMonitor(Folder *folder)
         // to the signal mapper which maps to the folder alias. The changed path
         // is lost this way, but we do not need it for the current implementation.
         connect(fw, &FolderWatcher::pathChanged, folder, &Folder::slotWatchedPathChanged);
+        folder->setFolderWatcher(fw);
 
         _folderWatchers.insert(folder->alias(), fw);
     }
@@ -586,38 +597,53 @@ void FolderMan::slotScheduleETagJob(const QString & /*alias*/, RequestEtagJob *j
 {
     QObject::connect(job, &QObject::destroyed, this, &FolderMan::slotEtagJobDestroyed);
     QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
-    // maybe: add to queue
 }
 
 void FolderMan::slotEtagJobDestroyed(QObject * /*o*/)
 {
-    // _currentEtagJob is automatically cleared
-    // maybe: remove from queue
+    // the QPointer in _runningEtagJobs is automatically cleared
     QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
 }
 
+// The etag checks of an account run concurrently on its access manager, where
+// they reuse the kept alive connections and TLS sessions of the sync jobs.
+// Stay below the six connections per host that Qt opens over HTTP/1.1 so a
+// poll cycle never starves a running sync; HTTP/2 multiplexes on one connection.
+static int maximumEtagJobs(const AccountPtr &account)
+{
+    return account->isHttp2Supported() ? 16 : 4;
+}
+
 void FolderMan::slotRunOneEtagJob()
 {
-    if (_currentEtagJob.isNull()) {
-        Folder *folder;
-        foreach (Folder *f, _folderMap) {
-            if (f->etagJob()) {
-                // Caveat: always grabs the first folder with a job, but we think this is Ok for now and avoids us having a seperate queue.
-                _currentEtagJob = f->etagJob();
-                folder = f;
-                break;
-            }
+    _runningEtagJobs.removeAll(QPointer<RequestEtagJob>());
+
+    QHash<Account *, int> runningPerAccount;
+    foreach (const QPointer<RequestEtagJob> &job, _runningEtagJobs) {
+        ++runningPerAccount[job->account().data()];
+    }
+
+    foreach (Folder *f, _folderMap) {
+        RequestEtagJob *job = f->etagJob();
+        if (!job || _runningEtagJobs.contains(job)) {
+            continue;
+        }
+        int &running = runningPerAccount[job->account().data()];
+        if (running >= maximumEtagJobs(job->account())) {
+            continue;
         }
-        if (_currentEtagJob.isNull()) {
-            //qCDebug(lcFolderMan) << "No more remote ETag check jobs to schedule.";
+        ++running;
+        _runningEtagJobs.append(job);
+        qCDebug(lcFolderMan) << "Scheduling" << f->remoteUrl().toString() << "to check remote ETag";
+        job->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+    }
 
-            /* now it might be a good time to check for restarting... */
-            if (_currentSyncFolder == NULL && _appRestartRequired) {
-                restartApplication();
-            }
-        } else {
-            qCDebug(lcFolderMan) << "Scheduling" << folder->remoteUrl().toString() << "to check remote ETag";
-            _currentEtagJob->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+    if (_runningEtagJobs.isEmpty()) {
+        //qCDebug(lcFolderMan) << "No more remote ETag check jobs to schedule.";
+
+        /* now it might be a good time to check for restarting... */
+        if (_currentSyncFolder == NULL && _appRestartRequired) {
+            restartApplication();
         }
     }
 }
@@ -640,10 +666,21 @@ void FolderMan::slotAccountStateChanged()
                 scheduleFolder(f);
             }
         }
+
+        auto &notifier = _changeNotifiers[accountState];
+        if (!notifier) {
+            notifier = new ChangeNotifier(accountState->account(), accountState);
+            connect(notifier.data(), &ChangeNotifier::remoteChanged, this, &FolderMan::slotRemoteChanged);
+        }
+        notifier->start();
     } else {
         qCInfo(lcFolderMan) << "Account" << accountName << "disconnected or paused, "
                                                            "terminating or descheduling sync folders";
 
+        if (auto notifier = _changeNotifiers.value(accountState)) {
+            notifier->stop();
+        }
+
         if (_currentSyncFolder
             && _currentSyncFolder->accountState() == accountState) {
             _currentSyncFolder->slotTerminateSync();
@@ -724,6 +761,18 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
+    // Scheduled again once the maintenance is done. It only runs while
+    // the client is idle: a waiting sync makes it stop after its current step.
+    foreach (Folder *f, _folderMap) {
+        if (f->isJournalMaintenanceRunning()) {
+            qCInfo(lcFolderMan) << "Journal maintenance of" << f->alias() << "is running, wait for finish!";
+            if (!_scheduledFolders.isEmpty()) {
+                f->interruptJournalMaintenance();
+            }
+            return;
+        }
+    }
+
     if (!_syncEnabled) {
         qCInfo(lcFolderMan) << "FolderMan: Syncing is disabled, no scheduling.";
         return;
@@ -778,13 +827,63 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (f->etagJob() || f->isBusy() || !f->canSync()) {
             continue;
         }
-        if (f->msecSinceLastSync() < polltime) {
+        // While the server notifies of changes, polling is only a safety net
+        int folderPollTime = polltime;
+        if (isChangeNotifierHealthy(f->accountState())) {
+            folderPollTime *= notifiedPollIntervalFactor;
+        }
+        if (f->msecSinceLastSync() < folderPollTime) {
             continue;
         }
         QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
     }
 }
 
+bool FolderMan::isChangeNotifierHealthy(AccountState *accountState) const
+{
+    auto notifier = _changeNotifiers.value(accountState);
+    return notifier && notifier->isHealthy();
+}
+
+static QString normalizedRemotePath(QString path)
+{
+    if (!path.startsWith(QLatin1Char('/'))) {
+        path.prepend(QLatin1Char('/'));
+    }
+    while (path.size() > 1 && path.endsWith(QLatin1Char('/'))) {
+        path.chop(1);
+    }
+    return path;
+}
+
+static bool isSameOrBelow(const QString &path, const QString &parent)
+{
+    return parent == QLatin1String("/") || path == parent || path.startsWith(parent + QLatin1Char('/'));
+}
+
+void FolderMan::slotRemoteChanged(const QStringList &paths)
+{
+    auto notifier = qobject_cast<ChangeNotifier *>(sender());
+    if (!notifier) {
+        return;
+    }
+
+    foreach (Folder *f, _folderMap) {
+        if (!f || _changeNotifiers.value(f->accountState()) != notifier) {
+            continue;
+        }
+        const QString folderPath = normalizedRemotePath(f->remotePath());
+        foreach (const QString &changed, paths) {
+            const QString changedPath = normalizedRemotePath(changed);
+            if (isSameOrBelow(changedPath, folderPath) || isSameOrBelow(folderPath, changedPath)) {
+                qCInfo(lcFolderMan) << "Server announced changes below" << changedPath << "for" << f->alias();
+                scheduleFolder(f);
+                break;
+            }
+        }
+    }
+}
+
 void FolderMan::slotRemoveFoldersForAccount(AccountState *accountState)
 {
     QVarLengthArray<Folder *, 16> foldersToRemove;
@@ -877,6 +976,38 @@ void FolderMan::slotScheduleFolderByTime()
     }
 }
 
+void FolderMan::slotRunJournalMaintenance()
+{
+    // The maintenance keeps syncs from starting until its current step is
+    // done: never interfere with a running or imminent sync.
+    if (_currentSyncFolder || !_scheduledFolders.isEmpty() || _startScheduledSyncTimer.isActive()) {
+        return;
+    }
+    foreach (Folder *f, _folderMap) {
+        if (f->isJournalMaintenanceRunning())
+            return;
+    }
+
+    const quint64 interval = ConfigFile().journalMaintenanceInterval();
+    foreach (Folder *f, _folderMap) {
+        if (f->isBusy() || f->etagJob()) {
+            continue;
+        }
+        // Give the socket api a quiet period after a sync
+        if (f->msecSinceLastSync() < 60 * 1000) {
+            continue;
+        }
+        qint64 msecsSinceMaintenance = f->msecSinceLastJournalMaintenance();
+        if (msecsSinceMaintenance >= 0 && quint64(msecsSinceMaintenance) < interval) {
+            continue;
+        }
+
+        // One folder per timeout to keep the ui responsive
+        f->runJournalMaintenance();
+        return;
+    }
+}
+
 void FolderMan::slotFolderSyncStarted()
 {
     qCInfo(lcFolderMan, ">========== Sync started for folder [%s] of account [%s] with remote [%s]",
@@ -959,6 +1090,7 @@ Folder *FolderMan::addFolderInternal(FolderDefinition folderDefinition,
     connect(folder, &Folder::syncStateChange, this, &FolderMan::slotForwardFolderSyncStateChange);
     connect(folder, &Folder::syncPausedChanged, this, &FolderMan::slotFolderSyncPaused);
     connect(folder, &Folder::canSyncChanged, this, &FolderMan::slotFolderCanSyncChanged);
+    connect(folder, &Folder::journalMaintenanceFinished, this, &FolderMan::startScheduledSyncSoon);
     connect(&folder->syncEngine().syncFileStatusTracker(), &SyncFileStatusTracker::fileStatusChanged,
         _socketApi.data(), &SocketApi::broadcastStatusPushMessage);
     connect(folder, &Folder::watchedFileChangedExternally,
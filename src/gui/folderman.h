@@ -32,6 +32,7 @@ class Application;
 class SyncResult;
 class SocketApi;
 class LockWatcher;
+class ChangeNotifier;
 
 /**
  * @brief The FolderMan class
@@ -244,6 +245,9 @@ private slots:
     void slotStartScheduledFolderSync();
     void slotEtagPollTimerTimeout();
 
+    /// Schedules the folders of the notifying account that contain or are below the paths
+    void slotRemoteChanged(const QStringList &paths);
+
     void slotRemoveFoldersForAccount(AccountState *accountState);
 
     // Wraps the Folder::syncStateChange() signal into the
@@ -268,6 +272,13 @@ private slots:
      */
     void slotScheduleFolderByTime();
 
+    /**
+     * Runs the journal maintenance of one folder that is due for it.
+     *
+     * Only happens when no sync is running or scheduled.
+     */
+    void slotRunJournalMaintenance();
+
 private:
     /** Adds a new folder, does not add it to the account settings and
      *  does not set an account on the new folder.
@@ -281,6 +292,9 @@ private:
     /** Will start a sync after a bit of delay. */
     void startScheduledSyncSoon();
 
+    /// Whether the server notifies the account of remote changes at the moment
+    bool isChangeNotifierHealthy(AccountState *accountState) const;
+
     // finds all folder configuration files
     // and create the folders
     QString getBackupName(QString fullPathName) const;
@@ -303,8 +317,10 @@ private:
 
     /// Starts regular etag query jobs
     QTimer _etagPollTimer;
-    /// The currently running etag query
-    QPointer<RequestEtagJob> _currentEtagJob;
+    /// The currently running etag queries, several per account
+    QList<QPointer<RequestEtagJob>> _runningEtagJobs;
+    /// Announce the remote changes of the connected accounts, if their servers can
+    QMap<AccountState *, QPointer<ChangeNotifier>> _changeNotifiers;
 
     /// Watches files that couldn't be synced due to locks
     QScopedPointer<LockWatcher> _lockWatcher;
@@ -312,6 +328,9 @@ private:
     /// Occasionally schedules folders
     QTimer _timeScheduler;
 
+    /// Occasionally vacuums and analyzes the journals of idle folders
+    QTimer _journalMaintenanceTimer;
+
     /// Scheduled folders that should be synced as soon as possible
     QQueue<Folder *> _scheduledFolders;
 
@@ -888,10 +888,7 @@ void FolderStatusModel::slotSetProgress(const ProgressInfo &progress)
 
     // Status is Starting, Propagation or Done
 
-    if (!progress._lastCompletedItem.isEmpty()
-        && Progress::isWarningKind(progress._lastCompletedItem._status)) {
-        pi->_warningCount++;
-    }
+    pi->_warningCount = static_cast<int>(progress.warningCount());
 
     // find the single item to display:  This is going to be the bigger item, or the last completed
     // item if no items are in progress.
@@ -909,9 +906,9 @@ void FolderStatusModel::slotSetProgress(const ProgressInfo &progress)
             biggerItemSize = citm._item._size;
         }
         if (citm._item._direction != SyncFileItem::Up) {
-            estimatedDownBw += progress.fileProgress(citm._item).estimatedBandwidth;
+            estimatedDownBw += citm._progress.estimates().estimatedBandwidth;
         } else {
-            estimatedUpBw += progress.fileProgress(citm._item).estimatedBandwidth;
+            estimatedUpBw += citm._progress.estimates().estimatedBandwidth;
         }
         auto fileName = QFileInfo(citm._item._file).fileName();
         if (allFilenames.length() > 0) {
@@ -80,6 +80,12 @@ signals:
     /** Emitted if an error occurs */
     void error(const QString &error);
 
+    /**
+     * Emitted when changes may have been missed, for example because
+     * the event buffer of the system overflowed.
+     */
+    void lostChanges();
+
 protected slots:
     // called from the implementations to indicate a change in path
     void changeDetected(const QString &path);
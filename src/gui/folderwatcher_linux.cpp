@@ -20,6 +20,7 @@
 #include "folderwatcher_linux.h"
 
 #include <cerrno>
+#include <cstring>
 #include <QStringList>
 #include <QObject>
 #include <QVarLengthArray>
@@ -78,6 +79,11 @@ void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
             IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
         if (wd > -1) {
             _watches.insert(wd, path);
+        } else {
+            // The changes below this directory can't be seen, ENOSPC if there are too many watches
+            const QString message = QString::fromLocal8Bit(strerror(errno));
+            qCWarning(lcFolderWatcher) << "inotify_add_watch failed for" << path << ":" << message;
+            emit _parent->error(tr("Could not watch %1 for changes: %2").arg(path, message));
         }
     }
 }
@@ -157,6 +163,11 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
             continue;
         }
 
+        if (event->mask & IN_Q_OVERFLOW) {
+            qCWarning(lcFolderWatcher) << "inotify event queue overflowed, changes were lost";
+            emit _parent->lostChanges();
+        }
+
         // Fire event for the path that was changed.
         if (event->len > 0 && event->wd > -1) {
             QByteArray fileName(event->name);
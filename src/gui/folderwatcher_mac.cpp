@@ -57,6 +57,12 @@ static void callback(
         | kFSEventStreamEventFlagItemModified; // for content change
     //We ignore other flags, e.g. for owner change, xattr change, Finder label change etc
 
+    // The events below a directory were coalesced or dropped
+    const FSEventStreamEventFlags c_lostChangesFlags = kFSEventStreamEventFlagMustScanSubDirs
+        | kFSEventStreamEventFlagUserDropped
+        | kFSEventStreamEventFlagKernelDropped;
+    bool lostChanges = false;
+
     qCDebug(lcFolderWatcher) << "FolderWatcherPrivate::callback by OS X";
 
     QStringList paths;
@@ -70,6 +76,11 @@ static void callback(
         CFStringGetCharacters(path, CFRangeMake(0, pathLength), reinterpret_cast<UniChar *>(qstring.data()));
         QString fn = qstring.normalized(QString::NormalizationForm_C);
 
+        if (eventFlags[i] & c_lostChangesFlags) {
+            qCWarning(lcFolderWatcher) << "Changes were lost below" << fn;
+            lostChanges = true;
+        }
+
         if (!(eventFlags[i] & c_interestingFlags)) {
             qCDebug(lcFolderWatcher) << "Ignoring non-content changes for" << fn;
             continue;
@@ -78,7 +89,10 @@ static void callback(
         paths.append(fn);
     }
 
-    reinterpret_cast<FolderWatcherPrivate *>(clientCallBackInfo)->doNotifyParent(paths);
+    auto watcher = reinterpret_cast<FolderWatcherPrivate *>(clientCallBackInfo);
+    if (lostChanges)
+        watcher->doNotifyLostChanges();
+    watcher->doNotifyParent(paths);
 }
 
 void FolderWatcherPrivate::startWatching()
@@ -110,5 +124,10 @@ void FolderWatcherPrivate::doNotifyParent(const QStringList &paths)
     _parent->changeDetected(paths);
 }
 
+void FolderWatcherPrivate::doNotifyLostChanges()
+{
+    emit _parent->lostChanges();
+}
+
 
 } // ns mirall
@@ -53,6 +53,8 @@ protected:
 
 signals:
     void changed(const QString &path);
+    void lostChanges();
+    void error(const QString &error);
 
 private:
     QString _path;
@@ -26,6 +26,7 @@
 #include "openfilemanager.h"
 #include "activityitemdelegate.h"
 #include "protocolwidget.h"
+#include "protocolitemmodel.h"
 #include "accountstate.h"
 #include "account.h"
 #include "accountmanager.h"
@@ -39,8 +40,7 @@
 namespace OCC {
 
 /**
- * If more issues are reported than this they will not show up
- * to avoid performance issues around sorting this many issues.
+ * If more issues are reported than this the oldest ones are dropped.
  */
 static const int maxIssueCount = 50000;
 
@@ -50,14 +50,28 @@ IssuesWidget::IssuesWidget(QWidget *parent)
 {
     _ui->setupUi(this);
 
+    // Adjust copyToClipboard() when making changes here!
+    QStringList header;
+    header << tr("Time");
+    header << tr("File");
+    header << tr("Folder");
+    header << tr("Issue");
+
+    _model = new ProtocolItemModel(maxIssueCount, header, this);
+    _sortModel = new ProtocolSortFilterModel(_model, this);
+    _sortModel->setItemFilter([this](const ProtocolItem &item) {
+        return shouldBeVisible(item, currentAccountFilter(), currentFolderFilter());
+    });
+    _ui->_treeView->setModel(_sortModel);
+
     connect(ProgressDispatcher::instance(), &ProgressDispatcher::progressInfo,
         this, &IssuesWidget::slotProgressInfo);
-    connect(ProgressDispatcher::instance(), &ProgressDispatcher::itemCompleted,
-        this, &IssuesWidget::slotItemCompleted);
+    connect(ProgressDispatcher::instance(), &ProgressDispatcher::itemsCompleted,
+        this, &IssuesWidget::slotItemsCompleted);
     connect(ProgressDispatcher::instance(), &ProgressDispatcher::syncError,
         this, &IssuesWidget::addError);
 
-    connect(_ui->_treeWidget, &QTreeWidget::itemActivated, this, &IssuesWidget::slotOpenFile);
+    connect(_ui->_treeView, &QTreeView::activated, this, &IssuesWidget::slotOpenFile);
     connect(_ui->copyIssuesButton, &QAbstractButton::clicked, this, &IssuesWidget::copyToClipboard);
 
     connect(_ui->showIgnores, &QAbstractButton::toggled, this, &IssuesWidget::slotRefreshIssues);
@@ -75,41 +89,27 @@ IssuesWidget::IssuesWidget(QWidget *parent)
     connect(FolderMan::instance(), &FolderMan::folderListChanged,
         this, &IssuesWidget::slotUpdateFolderFilters);
 
-
-    // Adjust copyToClipboard() when making changes here!
-    QStringList header;
-    header << tr("Time");
-    header << tr("File");
-    header << tr("Folder");
-    header << tr("Issue");
-
     int timestampColumnExtra = 0;
 #ifdef Q_OS_WIN
     timestampColumnExtra = 20; // font metrics are broken on Windows, see #4721
 #endif
 
-    _ui->_treeWidget->setHeaderLabels(header);
     int timestampColumnWidth =
         ActivityItemDelegate::rowHeight() // icon
-        + _ui->_treeWidget->fontMetrics().width(ProtocolWidget::timeString(QDateTime::currentDateTime()))
+        + _ui->_treeView->fontMetrics().width(ProtocolItemModel::timeString(QDateTime::currentDateTime()))
         + timestampColumnExtra;
-    _ui->_treeWidget->setColumnWidth(0, timestampColumnWidth);
-    _ui->_treeWidget->setColumnWidth(1, 180);
-    _ui->_treeWidget->setColumnCount(4);
-    _ui->_treeWidget->setRootIsDecorated(false);
-    _ui->_treeWidget->setTextElideMode(Qt::ElideMiddle);
-    _ui->_treeWidget->header()->setObjectName("ActivityErrorListHeader");
+    _ui->_treeView->setColumnWidth(0, timestampColumnWidth);
+    _ui->_treeView->setColumnWidth(1, 180);
+    _ui->_treeView->setRootIsDecorated(false);
+    _ui->_treeView->setTextElideMode(Qt::ElideMiddle);
+    _ui->_treeView->header()->setObjectName("ActivityErrorListHeader");
 #if defined(Q_OS_MAC)
-    _ui->_treeWidget->setMinimumWidth(400);
+    _ui->_treeView->setMinimumWidth(400);
 #endif
 
-    _reenableSorting.setInterval(5000);
-    connect(&_reenableSorting, &QTimer::timeout, this,
-        [this]() { _ui->_treeWidget->setSortingEnabled(true); });
-
     _ui->_tooManyIssuesWarning->hide();
     connect(this, &IssuesWidget::issueCountUpdated, this,
-        [this](int count) { _ui->_tooManyIssuesWarning->setVisible(count >= maxIssueCount); });
+        [this](int) { _ui->_tooManyIssuesWarning->setVisible(_model->isFull()); });
 }
 
 IssuesWidget::~IssuesWidget()
@@ -120,16 +120,16 @@ IssuesWidget::~IssuesWidget()
 void IssuesWidget::showEvent(QShowEvent *ev)
 {
     ConfigFile cfg;
-    cfg.restoreGeometryHeader(_ui->_treeWidget->header());
+    cfg.restoreGeometryHeader(_ui->_treeView->header());
 
     // Sorting by section was newly enabled. But if we restore the header
     // from a state where sorting was disabled, both of these flags will be
     // false and sorting will be impossible!
-    _ui->_treeWidget->header()->setSectionsClickable(true);
-    _ui->_treeWidget->header()->setSortIndicatorShown(true);
+    _ui->_treeView->header()->setSectionsClickable(true);
+    _ui->_treeView->header()->setSortIndicatorShown(true);
 
     // Switch back to "first important, then by time" ordering
-    _ui->_treeWidget->sortByColumn(0, Qt::DescendingOrder);
+    _ui->_treeView->sortByColumn(0, Qt::DescendingOrder);
 
     QWidget::showEvent(ev);
 }
@@ -137,64 +137,24 @@ void IssuesWidget::showEvent(QShowEvent *ev)
 void IssuesWidget::hideEvent(QHideEvent *ev)
 {
     ConfigFile cfg;
-    cfg.saveGeometryHeader(_ui->_treeWidget->header());
+    cfg.saveGeometryHeader(_ui->_treeView->header());
     QWidget::hideEvent(ev);
 }
 
 void IssuesWidget::cleanItems(const QString &folder)
 {
-    _ui->_treeWidget->setSortingEnabled(false);
-
     // The issue list is a state, clear it and let the next sync fill it
     // with ignored files and propagation errors.
-    int itemCnt = _ui->_treeWidget->topLevelItemCount();
-    for (int cnt = itemCnt - 1; cnt >= 0; cnt--) {
-        QTreeWidgetItem *item = _ui->_treeWidget->topLevelItem(cnt);
-        QString itemFolder = item->data(2, Qt::UserRole).toString();
-        if (itemFolder == folder) {
-            delete item;
-        }
-    }
-
-    _ui->_treeWidget->setSortingEnabled(true);
+    _model->removeItems([&folder](const ProtocolItem &item) { return item._folder == folder; });
 
     // update the tabtext
-    emit(issueCountUpdated(_ui->_treeWidget->topLevelItemCount()));
+    emit(issueCountUpdated(_model->rowCount()));
 }
 
-void IssuesWidget::addItem(QTreeWidgetItem *item)
+void IssuesWidget::slotOpenFile(const QModelIndex &index)
 {
-    if (!item)
-        return;
-
-    int count = _ui->_treeWidget->topLevelItemCount();
-    if (count >= maxIssueCount)
-        return;
-
-    _ui->_treeWidget->setSortingEnabled(false);
-    _reenableSorting.start();
-
-    // Insert item specific errors behind the others
-    int insertLoc = 0;
-    if (!item->text(1).isEmpty()) {
-        for (int i = 0; i < count; ++i) {
-            if (_ui->_treeWidget->topLevelItem(i)->text(1).isEmpty()) {
-                insertLoc = i + 1;
-            } else {
-                break;
-            }
-        }
-    }
-
-    _ui->_treeWidget->insertTopLevelItem(insertLoc, item);
-    item->setHidden(!shouldBeVisible(item, currentAccountFilter(), currentFolderFilter()));
-    emit issueCountUpdated(_ui->_treeWidget->topLevelItemCount());
-}
-
-void IssuesWidget::slotOpenFile(QTreeWidgetItem *item, int)
-{
-    QString folderName = item->data(2, Qt::UserRole).toString();
-    QString fileName = item->text(1);
+    QString folderName = _sortModel->item(index)._folder;
+    QString fileName = index.sibling(index.row(), 1).data().toString();
 
     Folder *folder = FolderMan::instance()->folder(folderName);
     if (folder) {
@@ -214,28 +174,36 @@ void IssuesWidget::slotProgressInfo(const QString &folder, const ProgressInfo &p
     }
 }
 
-void IssuesWidget::slotItemCompleted(const QString &folder, const SyncFileItemPtr &item)
+void IssuesWidget::slotItemsCompleted(const QString &folder, const SyncFileItemVector &items)
 {
-    if (!item->showInIssuesTab())
+    if (!FolderMan::instance()->folder(folder))
         return;
-    QTreeWidgetItem *line = ProtocolWidget::createCompletedTreewidgetItem(folder, *item);
-    if (!line)
+
+    QVector<ProtocolItem> lines;
+    for (const auto &item : items) {
+        if (item->showInIssuesTab())
+            lines.append(ProtocolItem::fromSyncFileItem(folder, *item));
+    }
+    if (lines.isEmpty())
         return;
-    addItem(line);
+    _model->addItems(lines);
+    emit issueCountUpdated(_model->rowCount());
 }
 
 void IssuesWidget::slotRefreshIssues()
 {
-    auto tree = _ui->_treeWidget;
-    auto filterFolderAlias = currentFolderFilter();
-    auto filterAccount = currentAccountFilter();
-
-    for (int i = 0; i < tree->topLevelItemCount(); ++i) {
-        auto item = tree->topLevelItem(i);
-        item->setHidden(!shouldBeVisible(item, filterAccount, filterFolderAlias));
+    _sortModel->invalidateFilter();
+
+    // The view drops the widgets of lines that were filtered out
+    for (int row = 0; row < _sortModel->rowCount(); ++row) {
+        QModelIndex index = _sortModel->index(row, 3);
+        if (_sortModel->item(index)._category != ErrorCategory::Normal
+            && !_ui->_treeView->indexWidget(index)) {
+            addErrorWidget(index);
+        }
     }
 
-    _ui->_treeWidget->setColumnHidden(2, !filterFolderAlias.isEmpty());
+    _ui->_treeView->setColumnHidden(2, !currentFolderFilter().isEmpty());
 }
 
 void IssuesWidget::slotAccountAdded(AccountState *account)
@@ -271,17 +239,17 @@ QString IssuesWidget::currentFolderFilter() const
     return _ui->filterFolder->currentData().toString();
 }
 
-bool IssuesWidget::shouldBeVisible(QTreeWidgetItem *item, AccountState *filterAccount,
+bool IssuesWidget::shouldBeVisible(const ProtocolItem &item, AccountState *filterAccount,
     const QString &filterFolderAlias) const
 {
     bool visible = true;
-    auto status = item->data(3, Qt::UserRole);
+    auto status = item._status;
     visible &= (_ui->showIgnores->isChecked() || status != SyncFileItem::FileIgnored);
     visible &= (_ui->showWarnings->isChecked()
         || (status != SyncFileItem::SoftError
                && status != SyncFileItem::Restoration));
 
-    auto folderalias = item->data(2, Qt::UserRole).toString();
+    const auto &folderalias = item._folder;
     if (filterAccount) {
         auto folder = FolderMan::instance()->folder(folderalias);
         visible &= folder && folder->accountState() == filterAccount;
@@ -337,34 +305,32 @@ void IssuesWidget::slotUpdateFolderFilters()
 
 void IssuesWidget::storeSyncIssues(QTextStream &ts)
 {
-    int topLevelItems = _ui->_treeWidget->topLevelItemCount();
+    int rowCount = _sortModel->rowCount();
 
-    for (int i = 0; i < topLevelItems; i++) {
-        QTreeWidgetItem *child = _ui->_treeWidget->topLevelItem(i);
-        if (child->isHidden())
-            continue;
+    for (int i = 0; i < rowCount; i++) {
+        auto child = [&](int column) { return _sortModel->index(i, column); };
         ts << right
            // time stamp
            << qSetFieldWidth(20)
-           << child->data(0, Qt::DisplayRole).toString()
+           << child(0).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // file name
            << qSetFieldWidth(64)
-           << child->data(1, Qt::DisplayRole).toString()
+           << child(1).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // folder
            << qSetFieldWidth(30)
-           << child->data(2, Qt::DisplayRole).toString()
+           << child(2).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // action
            << qSetFieldWidth(15)
-           << child->data(3, Qt::DisplayRole).toString()
+           << child(3).data(Qt::DisplayRole).toString()
            << qSetFieldWidth(0)
            << endl;
     }
@@ -391,55 +357,38 @@ void IssuesWidget::addError(const QString &folderAlias, const QString &message,
     if (!folder)
         return;
 
-    QStringList columns;
-    QDateTime timestamp = QDateTime::currentDateTime();
-    const QString timeStr = ProtocolWidget::timeString(timestamp);
-    const QString longTimeStr = ProtocolWidget::timeString(timestamp, QLocale::LongFormat);
-
-    columns << timeStr;
-    columns << ""; // no "File" entry
-    columns << folder->shortGuiLocalPath();
-    columns << message;
-
-    QIcon icon = Theme::instance()->syncStateIcon(SyncResult::Error);
-
-    QTreeWidgetItem *twitem = new SortedTreeWidgetItem(columns);
-    twitem->setData(0, Qt::SizeHintRole, QSize(0, ActivityItemDelegate::rowHeight()));
-    twitem->setData(0, Qt::UserRole, timestamp);
-    twitem->setIcon(0, icon);
-    twitem->setToolTip(0, longTimeStr);
-    twitem->setData(2, Qt::UserRole, folderAlias);
-    twitem->setToolTip(3, message);
-    twitem->setData(3, Qt::UserRole, SyncFileItem::NormalError);
-
-    addItem(twitem);
-    addErrorWidget(twitem, message, category);
+    _model->addItems(QVector<ProtocolItem>() << ProtocolItem::fromError(folderAlias, message, category));
+    emit issueCountUpdated(_model->rowCount());
+
+    // The line was added last
+    QModelIndex index = _sortModel->mapFromSource(_model->index(_model->rowCount() - 1, 3));
+    if (index.isValid())
+        addErrorWidget(index);
 }
 
-void IssuesWidget::addErrorWidget(QTreeWidgetItem *item, const QString &message, ErrorCategory category)
+void IssuesWidget::addErrorWidget(const QModelIndex &index)
 {
+    const ProtocolItem &item = _sortModel->item(index);
     QWidget *widget = 0;
-    if (category == ErrorCategory::InsufficientRemoteStorage) {
+    if (item._category == ErrorCategory::InsufficientRemoteStorage) {
         widget = new QWidget;
         auto layout = new QHBoxLayout;
         widget->setLayout(layout);
 
-        auto label = new ElidedLabel(message, widget);
+        auto label = new ElidedLabel(item._message, widget);
         label->setElideMode(Qt::ElideMiddle);
         layout->addWidget(label);
 
         auto button = new QPushButton("Retry all uploads", widget);
         button->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Expanding);
-        auto folderAlias = item->data(2, Qt::UserRole).toString();
+        auto folderAlias = item._folder;
         connect(button, &QPushButton::clicked,
             this, [this, folderAlias]() { retryInsufficentRemoteStorageErrors(folderAlias); });
         layout->addWidget(button);
     }
 
-    if (widget) {
-        item->setText(3, QString());
-    }
-    _ui->_treeWidget->setItemWidget(item, 3, widget);
+    if (widget)
+        _ui->_treeView->setIndexWidget(index.sibling(index.row(), 3), widget);
 }
 
 void IssuesWidget::retryInsufficentRemoteStorageErrors(const QString &folderAlias)
@@ -18,7 +18,6 @@
 #include <QDialog>
 #include <QDateTime>
 #include <QLocale>
-#include <QTimer>
 
 #include "progressdispatcher.h"
 #include "owncloudgui.h"
@@ -29,6 +28,9 @@ class QPushButton;
 
 namespace OCC {
 class SyncResult;
+struct ProtocolItem;
+class ProtocolItemModel;
+class ProtocolSortFilterModel;
 
 namespace Ui {
     class ProtocolWidget;
@@ -53,8 +55,8 @@ public:
 public slots:
     void addError(const QString &folderAlias, const QString &message, ErrorCategory category);
     void slotProgressInfo(const QString &folder, const ProgressInfo &progress);
-    void slotItemCompleted(const QString &folder, const SyncFileItemPtr &item);
-    void slotOpenFile(QTreeWidgetItem *item, int);
+    void slotItemsCompleted(const QString &folder, const SyncFileItemVector &items);
+    void slotOpenFile(const QModelIndex &index);
 
 protected:
     void showEvent(QShowEvent *);
@@ -74,21 +76,19 @@ private:
     void updateAccountChoiceVisibility();
     AccountState *currentAccountFilter() const;
     QString currentFolderFilter() const;
-    bool shouldBeVisible(QTreeWidgetItem *item, AccountState *filterAccount,
+    bool shouldBeVisible(const ProtocolItem &item, AccountState *filterAccount,
         const QString &filterFolderAlias) const;
     void cleanItems(const QString &folder);
-    void addItem(QTreeWidgetItem *item);
 
-    /// Add the special error widget for the category, if any
-    void addErrorWidget(QTreeWidgetItem *item, const QString &message, ErrorCategory category);
+    /// Add the special error widget for the category of the line, if any
+    void addErrorWidget(const QModelIndex &index);
 
     /// Wipes all insufficient remote storgage blacklist entries
     void retryInsufficentRemoteStorageErrors(const QString &folderAlias);
 
-    /// Each insert disables sorting, this timer reenables it
-    QTimer _reenableSorting;
-
     Ui::IssuesWidget *_ui;
+    ProtocolItemModel *_model;
+    ProtocolSortFilterModel *_sortModel;
 };
 }
 
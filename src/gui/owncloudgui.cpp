@@ -81,6 +81,8 @@ ownCloudGui::ownCloudGui(Application *parent)
     ProgressDispatcher *pd = ProgressDispatcher::instance();
     connect(pd, &ProgressDispatcher::progressInfo, this,
         &ownCloudGui::slotUpdateProgress);
+    connect(pd, &ProgressDispatcher::itemsCompleted, this,
+        &ownCloudGui::slotItemsCompleted);
 
     FolderMan *folderMan = FolderMan::instance();
     connect(folderMan, &FolderMan::folderSyncStateChange,
@@ -800,40 +802,52 @@ void ownCloudGui::slotUpdateProgress(const QString &folder, const ProgressInfo &
         }
         _actionStatus->setText(msg);
     }
+}
 
-    _actionRecent->setIcon(QIcon()); // Fixme: Set a "in-progress"-item eventually.
+void ownCloudGui::slotItemsCompleted(const QString &folder, const SyncFileItemVector &items)
+{
+    static const int maxRecentItems = 6;
 
-    if (!progress._lastCompletedItem.isEmpty()
-        && shouldShowInRecentsMenu(progress._lastCompletedItem)) {
-        if (Progress::isWarningKind(progress._lastCompletedItem._status)) {
-            // display a warn icon if warnings happened.
-            QIcon warnIcon(":/client/resources/warning");
-            _actionRecent->setIcon(warnIcon);
-        }
+    QList<const SyncFileItem *> recentItems;
+    bool hasWarnings = false;
+    for (const auto &item : items) {
+        if (!shouldShowInRecentsMenu(*item))
+            continue;
+        hasWarnings |= Progress::isWarningKind(item->_status);
+        recentItems.append(item.data());
+        if (recentItems.size() > maxRecentItems)
+            recentItems.removeFirst();
+    }
+    if (recentItems.isEmpty())
+        return;
+
+    // display a warn icon if warnings happened.
+    _actionRecent->setIcon(hasWarnings ? QIcon(":/client/resources/warning") : QIcon());
 
-        QString kindStr = Progress::asResultString(progress._lastCompletedItem);
-        QString timeStr = QTime::currentTime().toString("hh:mm");
-        QString actionText = tr("%1 (%2, %3)").arg(progress._lastCompletedItem._file, kindStr, timeStr);
+    QString timeStr = QTime::currentTime().toString("hh:mm");
+    Folder *f = FolderMan::instance()->folder(folder);
+    for (const SyncFileItem *item : recentItems) {
+        QString kindStr = Progress::asResultString(*item);
+        QString actionText = tr("%1 (%2, %3)").arg(item->_file, kindStr, timeStr);
         QAction *action = new QAction(actionText, this);
-        Folder *f = FolderMan::instance()->folder(folder);
         if (f) {
-            QString fullPath = f->path() + '/' + progress._lastCompletedItem._file;
+            QString fullPath = f->path() + '/' + item->_file;
             if (QFile(fullPath).exists()) {
                 connect(action, &QAction::triggered, this, [this, fullPath] { this->slotOpenPath(fullPath); });
             } else {
                 action->setEnabled(false);
             }
         }
-        if (_recentItemsActions.length() > 5) {
+        if (_recentItemsActions.length() >= maxRecentItems) {
             _recentItemsActions.takeFirst()->deleteLater();
         }
         _recentItemsActions.append(action);
+    }
 
-        // Update the "Recent" menu if the context menu is being shown,
-        // otherwise it'll be updated later, when the context menu is opened.
-        if (updateWhileVisible() && contextMenuVisible()) {
-            slotRebuildRecentMenus();
-        }
+    // Update the "Recent" menu if the context menu is being shown,
+    // otherwise it'll be updated later, when the context menu is opened.
+    if (updateWhileVisible() && contextMenuVisible()) {
+        slotRebuildRecentMenus();
     }
 }
 
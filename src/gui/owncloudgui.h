@@ -71,6 +71,7 @@ public slots:
     void slotFolderOpenAction(const QString &alias);
     void slotRebuildRecentMenus();
     void slotUpdateProgress(const QString &folder, const ProgressInfo &progress);
+    void slotItemsCompleted(const QString &folder, const SyncFileItemVector &items);
     void slotShowGuiMessage(const QString &title, const QString &message);
     void slotFoldersChanged();
     void slotShowSettings();
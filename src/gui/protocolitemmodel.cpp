@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "protocolitemmodel.h"
+#include "activityitemdelegate.h"
+#include "folderman.h"
+#include "folder.h"
+#include "syncresult.h"
+#include "theme.h"
+#include "common/utility.h"
+
+#include <QDateTime>
+#include <QIcon>
+#include <QRegExp>
+#include <QSize>
+
+#include <algorithm>
+#include <tuple>
+
+namespace OCC {
+
+// Orders the lines that were created within the same millisecond
+static quint64 nextSequence()
+{
+    static quint64 sequence = 0;
+    return ++sequence;
+}
+
+ProtocolItem ProtocolItem::fromSyncFileItem(const QString &folder, const SyncFileItem &item)
+{
+    ProtocolItem line;
+    line._timestamp = QDateTime::currentMSecsSinceEpoch();
+    line._sequence = nextSequence();
+    line._folder = folder;
+    line._file = item._file;
+    line._originalFile = item._originalFile;
+    line._renameTarget = item._renameTarget;
+    // If the error string is set, it's prefered because it is a useful user message.
+    line._message = item._errorString;
+    if (ProgressInfo::isSizeDependent(item)) {
+        line._size = item._size;
+    }
+    line._status = item._status;
+    line._instruction = item._instruction;
+    line._direction = item._direction;
+    return line;
+}
+
+ProtocolItem ProtocolItem::fromError(const QString &folder, const QString &message, ErrorCategory category)
+{
+    ProtocolItem line;
+    line._timestamp = QDateTime::currentMSecsSinceEpoch();
+    line._sequence = nextSequence();
+    line._folder = folder;
+    line._message = message;
+    line._status = SyncFileItem::NormalError;
+    line._category = category;
+    return line;
+}
+
+static QString messageText(const ProtocolItem &line)
+{
+    if (!line._message.isEmpty()) {
+        return line._message;
+    }
+    SyncFileItem item;
+    item._instruction = line._instruction;
+    item._direction = line._direction;
+    item._renameTarget = line._renameTarget;
+    return Progress::asResultString(item);
+}
+
+static QIcon statusIcon(SyncFileItem::Status status)
+{
+    if (status == SyncFileItem::NormalError
+        || status == SyncFileItem::FatalError
+        || status == SyncFileItem::DetailError
+        || status == SyncFileItem::BlacklistedError) {
+        return Theme::instance()->syncStateIcon(SyncResult::Error);
+    } else if (Progress::isWarningKind(status)) {
+        return Theme::instance()->syncStateIcon(SyncResult::Problem);
+    }
+    return QIcon();
+}
+
+QString ProtocolItemModel::timeString(QDateTime dt, QLocale::FormatType format)
+{
+    const QLocale loc = QLocale::system();
+    QString dtFormat = loc.dateTimeFormat(format);
+    static const QRegExp re("(HH|H|hh|h):mm(?!:s)");
+    dtFormat.replace(re, "\\1:mm:ss");
+    return loc.toString(dt, dtFormat);
+}
+
+ProtocolItemModel::ProtocolItemModel(int capacity, const QStringList &headers, QObject *parent)
+    : QAbstractTableModel(parent)
+    , _start(0)
+    , _count(0)
+    , _capacity(capacity)
+    , _headers(headers)
+{
+}
+
+int ProtocolItemModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : _count;
+}
+
+int ProtocolItemModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : _headers.size();
+}
+
+QVariant ProtocolItemModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return _headers.value(section);
+    }
+    return QVariant();
+}
+
+QVariant ProtocolItemModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= _count) {
+        return QVariant();
+    }
+
+    const ProtocolItem &line = item(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case 0:
+            return timeString(QDateTime::fromMSecsSinceEpoch(line._timestamp));
+        case 1:
+            return Utility::fileNameForGuiUse(line._originalFile);
+        case 2: {
+            auto folder = FolderMan::instance()->folder(line._folder);
+            return folder ? folder->shortGuiLocalPath() : QString();
+        }
+        case 3:
+            // The other categories are shown by a widget of the view
+            return line._category == ErrorCategory::Normal ? messageText(line) : QString();
+        case 4:
+            return line._size >= 0 ? Utility::octetsToString(line._size) : QString();
+        }
+        break;
+    case Qt::ToolTipRole:
+        switch (index.column()) {
+        case 0:
+            return timeString(QDateTime::fromMSecsSinceEpoch(line._timestamp), QLocale::LongFormat);
+        case 1:
+            return line._file;
+        case 3:
+            return messageText(line);
+        }
+        break;
+    case Qt::DecorationRole:
+        if (index.column() == 0) {
+            QIcon icon = statusIcon(line._status);
+            if (!icon.isNull())
+                return icon;
+        }
+        break;
+    case Qt::SizeHintRole:
+        if (index.column() == 0) {
+            return QSize(0, ActivityItemDelegate::rowHeight());
+        }
+        break;
+    case Qt::UserRole:
+        switch (index.column()) {
+        case 0:
+            return QDateTime::fromMSecsSinceEpoch(line._timestamp);
+        case 2:
+            return line._folder;
+        case 3:
+            return line._status;
+        }
+        break;
+    }
+    return QVariant();
+}
+
+void ProtocolItemModel::addItems(const QVector<ProtocolItem> &items)
+{
+    // Only the newest lines fit
+    int next = qMax(0, items.size() - _capacity);
+
+    // Fill the free space
+    int freeCount = qMin(items.size() - next, _capacity - _items.size());
+    if (freeCount > 0) {
+        // _start is 0 until the buffer is full
+        beginInsertRows(QModelIndex(), _items.size(), _items.size() + freeCount - 1);
+        _items.reserve(_items.size() + freeCount);
+        for (int i = 0; i < freeCount; ++i) {
+            _items.append(items.at(next++));
+        }
+        _count = _items.size();
+        endInsertRows();
+    }
+
+    // Replace the oldest lines
+    int replaceCount = items.size() - next;
+    if (replaceCount > 0) {
+        beginRemoveRows(QModelIndex(), 0, replaceCount - 1);
+        _start = (_start + replaceCount) % _capacity;
+        _count -= replaceCount;
+        endRemoveRows();
+
+        beginInsertRows(QModelIndex(), _count, _capacity - 1);
+        while (_count < _capacity) {
+            _items[(_start + _count++) % _capacity] = items.at(next++);
+        }
+        endInsertRows();
+    }
+}
+
+void ProtocolItemModel::removeItems(const std::function<bool(const ProtocolItem &)> &filter)
+{
+    // Make the rows contiguous so that ranges can be erased
+    std::rotate(_items.begin(), _items.begin() + _start, _items.end());
+    _start = 0;
+
+    int row = _items.size() - 1;
+    while (row >= 0) {
+        if (!filter(_items.at(row))) {
+            --row;
+            continue;
+        }
+        int last = row;
+        while (row > 0 && filter(_items.at(row - 1))) {
+            --row;
+        }
+        beginRemoveRows(QModelIndex(), row, last);
+        _items.erase(_items.begin() + row, _items.begin() + last + 1);
+        _count = _items.size();
+        endRemoveRows();
+        --row;
+    }
+}
+
+ProtocolSortFilterModel::ProtocolSortFilterModel(ProtocolItemModel *model, QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , _model(model)
+{
+    setSourceModel(model);
+    setDynamicSortFilter(true);
+}
+
+void ProtocolSortFilterModel::setItemFilter(std::function<bool(const ProtocolItem &)> filter)
+{
+    _filter = std::move(filter);
+    invalidateFilter();
+}
+
+const ProtocolItem &ProtocolSortFilterModel::item(const QModelIndex &index) const
+{
+    return _model->item(mapToSource(index).row());
+}
+
+bool ProtocolSortFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &) const
+{
+    return !_filter || _filter(_model->item(sourceRow));
+}
+
+bool ProtocolSortFilterModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+    if (left.column() != 0) {
+        return QSortFilterProxyModel::lessThan(left, right);
+    }
+
+    // Items with empty "File" column are larger than others,
+    // otherwise sort by time, then by creation (this uses lexicographic ordering)
+    const ProtocolItem &l = _model->item(left.row());
+    const ProtocolItem &r = _model->item(right.row());
+    return std::make_tuple(!l.isFileItem(), l._timestamp, l._sequence)
+        < std::make_tuple(!r.isFileItem(), r._timestamp, r._sequence);
+}
+}
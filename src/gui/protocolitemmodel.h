@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef PROTOCOLITEMMODEL_H
+#define PROTOCOLITEMMODEL_H
+
+#include <QAbstractTableModel>
+#include <QDateTime>
+#include <QLocale>
+#include <QSortFilterProxyModel>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+#include "progressdispatcher.h"
+#include "syncfileitem.h"
+
+namespace OCC {
+
+/**
+ * @brief One line of the protocol or issues view
+ *
+ * Only what is needed to show the line is kept, the texts are built
+ * when the view asks for them.
+ *
+ * @ingroup gui
+ */
+struct ProtocolItem
+{
+    /// Builds the line for an item completed by a job
+    static ProtocolItem fromSyncFileItem(const QString &folder, const SyncFileItem &item);
+
+    /// Builds the line for a folder-wide error, with an empty file name
+    static ProtocolItem fromError(const QString &folder, const QString &message, ErrorCategory category);
+
+    bool isFileItem() const { return !_originalFile.isEmpty(); }
+
+    qint64 _timestamp = 0; // msecs since epoch
+    quint64 _sequence = 0; // creation order, a batch of lines shares the timestamp
+    QString _folder; // alias
+    QString _file;
+    QString _originalFile;
+    QString _renameTarget;
+    QString _message; // error string, the result of the instruction is shown if empty
+    qint64 _size = -1; // only for size dependent items
+    SyncFileItem::Status _status = SyncFileItem::NoStatus;
+    csync_instructions_e _instruction = CSYNC_INSTRUCTION_NONE;
+    SyncFileItem::Direction _direction = SyncFileItem::None;
+    ErrorCategory _category = ErrorCategory::Normal;
+};
+
+/**
+ * @brief Model of the protocol and issues views
+ *
+ * The lines are kept in a ring buffer: once the capacity is reached,
+ * each new line replaces the oldest one. Rows are in the order the
+ * lines were added, the views sort them through ProtocolSortFilterModel.
+ *
+ * Columns: time, file, folder, action or issue, and the size if there
+ * are five headers.
+ *
+ * @ingroup gui
+ */
+class ProtocolItemModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    ProtocolItemModel(int capacity, const QStringList &headers, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex &index, int role) const Q_DECL_OVERRIDE;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const Q_DECL_OVERRIDE;
+
+    /// The time as shown in the views, shared with their column widths
+    static QString timeString(QDateTime dt, QLocale::FormatType format = QLocale::NarrowFormat);
+
+    const ProtocolItem &item(int row) const { return _items.at((_start + row) % _items.size()); }
+    int capacity() const { return _capacity; }
+    bool isFull() const { return _count == _capacity; }
+
+    /// Adds the lines, dropping the oldest ones if there is no space left
+    void addItems(const QVector<ProtocolItem> &items);
+
+    /// Removes all lines for which \a filter returns true
+    void removeItems(const std::function<bool(const ProtocolItem &)> &filter);
+
+private:
+    QVector<ProtocolItem> _items;
+    int _start; // row 0, the oldest line
+    int _count; // only differs from _items.size() while lines are replaced
+    int _capacity;
+    QStringList _headers;
+};
+
+/**
+ * @brief Sorting and filtering of a ProtocolItemModel
+ *
+ * Sorting by time puts the folder-wide errors, without a file name,
+ * after the others.
+ *
+ * @ingroup gui
+ */
+class ProtocolSortFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit ProtocolSortFilterModel(ProtocolItemModel *model, QObject *parent = 0);
+
+    /// Only lines for which \a filter returns true are shown, call invalidateFilter() when it changes
+    void setItemFilter(std::function<bool(const ProtocolItem &)> filter);
+    using QSortFilterProxyModel::invalidateFilter;
+
+    const ProtocolItem &item(const QModelIndex &index) const;
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const Q_DECL_OVERRIDE;
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const Q_DECL_OVERRIDE;
+
+private:
+    ProtocolItemModel *_model;
+    std::function<bool(const ProtocolItem &)> _filter;
+};
+}
+
+#endif // PROTOCOLITEMMODEL_H
@@ -16,6 +16,7 @@
 #include <QtWidgets>
 
 #include "protocolwidget.h"
+#include "protocolitemmodel.h"
 #include "configfile.h"
 #include "syncresult.h"
 #include "logger.h"
@@ -32,18 +33,10 @@
 
 namespace OCC {
 
-bool SortedTreeWidgetItem::operator<(const QTreeWidgetItem &other) const
-{
-    int column = treeWidget()->sortColumn();
-    if (column != 0) {
-        return QTreeWidgetItem::operator<(other);
-    }
-
-    // Items with empty "File" column are larger than others,
-    // otherwise sort by time (this uses lexicographic ordering)
-    return std::forward_as_tuple(text(1).isEmpty(), data(0, Qt::UserRole).toDateTime())
-        < std::forward_as_tuple(other.text(1).isEmpty(), other.data(0, Qt::UserRole).toDateTime());
-}
+/**
+ * Only the newest lines are kept, older ones are dropped.
+ */
+static const int maxItemCount = 2000;
 
 ProtocolWidget::ProtocolWidget(QWidget *parent)
     : QWidget(parent)
@@ -51,11 +44,6 @@ ProtocolWidget::ProtocolWidget(QWidget *parent)
 {
     _ui->setupUi(this);
 
-    connect(ProgressDispatcher::instance(), &ProgressDispatcher::itemCompleted,
-        this, &ProtocolWidget::slotItemCompleted);
-
-    connect(_ui->_treeWidget, &QTreeWidget::itemActivated, this, &ProtocolWidget::slotOpenFile);
-
     // Adjust copyToClipboard() when making changes here!
     QStringList header;
     header << tr("Time");
@@ -64,23 +52,30 @@ ProtocolWidget::ProtocolWidget(QWidget *parent)
     header << tr("Action");
     header << tr("Size");
 
+    _model = new ProtocolItemModel(maxItemCount, header, this);
+    _sortModel = new ProtocolSortFilterModel(_model, this);
+    _ui->_treeView->setModel(_sortModel);
+
+    connect(ProgressDispatcher::instance(), &ProgressDispatcher::itemsCompleted,
+        this, &ProtocolWidget::slotItemsCompleted);
+
+    connect(_ui->_treeView, &QTreeView::activated, this, &ProtocolWidget::slotOpenFile);
+
     int timestampColumnExtra = 0;
 #ifdef Q_OS_WIN
     timestampColumnExtra = 20; // font metrics are broken on Windows, see #4721
 #endif
 
-    _ui->_treeWidget->setHeaderLabels(header);
     int timestampColumnWidth =
-        _ui->_treeWidget->fontMetrics().width(timeString(QDateTime::currentDateTime()))
+        _ui->_treeView->fontMetrics().width(ProtocolItemModel::timeString(QDateTime::currentDateTime()))
         + timestampColumnExtra;
-    _ui->_treeWidget->setColumnWidth(0, timestampColumnWidth);
-    _ui->_treeWidget->setColumnWidth(1, 180);
-    _ui->_treeWidget->setColumnCount(5);
-    _ui->_treeWidget->setRootIsDecorated(false);
-    _ui->_treeWidget->setTextElideMode(Qt::ElideMiddle);
-    _ui->_treeWidget->header()->setObjectName("ActivityListHeader");
+    _ui->_treeView->setColumnWidth(0, timestampColumnWidth);
+    _ui->_treeView->setColumnWidth(1, 180);
+    _ui->_treeView->setRootIsDecorated(false);
+    _ui->_treeView->setTextElideMode(Qt::ElideMiddle);
+    _ui->_treeView->header()->setObjectName("ActivityListHeader");
 #if defined(Q_OS_MAC)
-    _ui->_treeWidget->setMinimumWidth(400);
+    _ui->_treeView->setMinimumWidth(400);
 #endif
     _ui->_headerLabel->setText(tr("Local sync protocol"));
 
@@ -98,16 +93,16 @@ ProtocolWidget::~ProtocolWidget()
 void ProtocolWidget::showEvent(QShowEvent *ev)
 {
     ConfigFile cfg;
-    cfg.restoreGeometryHeader(_ui->_treeWidget->header());
+    cfg.restoreGeometryHeader(_ui->_treeView->header());
 
     // Sorting by section was newly enabled. But if we restore the header
     // from a state where sorting was disabled, both of these flags will be
     // false and sorting will be impossible!
-    _ui->_treeWidget->header()->setSectionsClickable(true);
-    _ui->_treeWidget->header()->setSortIndicatorShown(true);
+    _ui->_treeView->header()->setSectionsClickable(true);
+    _ui->_treeView->header()->setSortIndicatorShown(true);
 
     // Switch back to "by time" ordering
-    _ui->_treeWidget->sortByColumn(0, Qt::DescendingOrder);
+    _ui->_treeView->sortByColumn(0, Qt::DescendingOrder);
 
     QWidget::showEvent(ev);
 }
@@ -115,24 +110,14 @@ void ProtocolWidget::showEvent(QShowEvent *ev)
 void ProtocolWidget::hideEvent(QHideEvent *ev)
 {
     ConfigFile cfg;
-    cfg.saveGeometryHeader(_ui->_treeWidget->header());
+    cfg.saveGeometryHeader(_ui->_treeView->header());
     QWidget::hideEvent(ev);
 }
 
-
-QString ProtocolWidget::timeString(QDateTime dt, QLocale::FormatType format)
-{
-    const QLocale loc = QLocale::system();
-    QString dtFormat = loc.dateTimeFormat(format);
-    static const QRegExp re("(HH|H|hh|h):mm(?!:s)");
-    dtFormat.replace(re, "\\1:mm:ss");
-    return loc.toString(dt, dtFormat);
-}
-
-void ProtocolWidget::slotOpenFile(QTreeWidgetItem *item, int)
+void ProtocolWidget::slotOpenFile(const QModelIndex &index)
 {
-    QString folderName = item->data(2, Qt::UserRole).toString();
-    QString fileName = item->text(1);
+    QString folderName = _sortModel->item(index)._folder;
+    QString fileName = index.sibling(index.row(), 1).data().toString();
 
     Folder *folder = FolderMan::instance()->folder(folderName);
     if (folder) {
@@ -144,105 +129,53 @@ void ProtocolWidget::slotOpenFile(QTreeWidgetItem *item, int)
     }
 }
 
-QTreeWidgetItem *ProtocolWidget::createCompletedTreewidgetItem(const QString &folder, const SyncFileItem &item)
+void ProtocolWidget::slotItemsCompleted(const QString &folder, const SyncFileItemVector &items)
 {
-    auto f = FolderMan::instance()->folder(folder);
-    if (!f) {
-        return 0;
-    }
-
-    QStringList columns;
-    QDateTime timestamp = QDateTime::currentDateTime();
-    const QString timeStr = timeString(timestamp);
-    const QString longTimeStr = timeString(timestamp, QLocale::LongFormat);
-
-    columns << timeStr;
-    columns << Utility::fileNameForGuiUse(item._originalFile);
-    columns << f->shortGuiLocalPath();
-
-    // If the error string is set, it's prefered because it is a useful user message.
-    QString message = item._errorString;
-    if (message.isEmpty()) {
-        message = Progress::asResultString(item);
-    }
-    columns << message;
-
-    QIcon icon;
-    if (item._status == SyncFileItem::NormalError
-        || item._status == SyncFileItem::FatalError
-        || item._status == SyncFileItem::DetailError
-        || item._status == SyncFileItem::BlacklistedError) {
-        icon = Theme::instance()->syncStateIcon(SyncResult::Error);
-    } else if (Progress::isWarningKind(item._status)) {
-        icon = Theme::instance()->syncStateIcon(SyncResult::Problem);
-    }
-
-    if (ProgressInfo::isSizeDependent(item)) {
-        columns << Utility::octetsToString(item._size);
-    }
-
-    QTreeWidgetItem *twitem = new SortedTreeWidgetItem(columns);
-    twitem->setData(0, Qt::SizeHintRole, QSize(0, ActivityItemDelegate::rowHeight()));
-    twitem->setData(0, Qt::UserRole, timestamp);
-    twitem->setIcon(0, icon);
-    twitem->setToolTip(0, longTimeStr);
-    twitem->setToolTip(1, item._file);
-    twitem->setData(2, Qt::UserRole, folder);
-    twitem->setToolTip(3, message);
-    twitem->setData(3, Qt::UserRole, item._status);
-    return twitem;
-}
-
-void ProtocolWidget::slotItemCompleted(const QString &folder, const SyncFileItemPtr &item)
-{
-    if (!item->showInProtocolTab())
+    if (!FolderMan::instance()->folder(folder))
         return;
-    QTreeWidgetItem *line = createCompletedTreewidgetItem(folder, *item);
-    if (line) {
-        // Limit the number of items
-        int itemCnt = _ui->_treeWidget->topLevelItemCount();
-        while (itemCnt > 2000) {
-            delete _ui->_treeWidget->takeTopLevelItem(itemCnt - 1);
-            itemCnt--;
-        }
-        _ui->_treeWidget->insertTopLevelItem(0, line);
+
+    QVector<ProtocolItem> lines;
+    for (const auto &item : items) {
+        if (item->showInProtocolTab())
+            lines.append(ProtocolItem::fromSyncFileItem(folder, *item));
     }
+    _model->addItems(lines);
 }
 
 void ProtocolWidget::storeSyncActivity(QTextStream &ts)
 {
-    int topLevelItems = _ui->_treeWidget->topLevelItemCount();
+    int rowCount = _sortModel->rowCount();
 
-    for (int i = 0; i < topLevelItems; i++) {
-        QTreeWidgetItem *child = _ui->_treeWidget->topLevelItem(i);
+    for (int i = 0; i < rowCount; i++) {
+        auto child = [&](int column) { return _sortModel->index(i, column); };
         ts << right
            // time stamp
            << qSetFieldWidth(20)
-           << child->data(0, Qt::DisplayRole).toString()
+           << child(0).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // file name
            << qSetFieldWidth(64)
-           << child->data(1, Qt::DisplayRole).toString()
+           << child(1).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // folder
            << qSetFieldWidth(30)
-           << child->data(2, Qt::DisplayRole).toString()
+           << child(2).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // action
            << qSetFieldWidth(15)
-           << child->data(3, Qt::DisplayRole).toString()
+           << child(3).data(Qt::DisplayRole).toString()
            // separator
            << qSetFieldWidth(0) << ","
 
            // size
            << qSetFieldWidth(10)
-           << child->data(4, Qt::DisplayRole).toString()
+           << child(4).data(Qt::DisplayRole).toString()
            << qSetFieldWidth(0)
            << endl;
     }
@@ -28,27 +28,14 @@ class QPushButton;
 
 namespace OCC {
 class SyncResult;
+class ProtocolItemModel;
+class ProtocolSortFilterModel;
 
 namespace Ui {
     class ProtocolWidget;
 }
 class Application;
 
-/**
- * A QTreeWidgetItem with special sorting.
- *
- * It allows items for global entries to be moved to the top if the
- * sorting section is the "Time" column.
- */
-class SortedTreeWidgetItem : public QTreeWidgetItem
-{
-public:
-    using QTreeWidgetItem::QTreeWidgetItem;
-
-private:
-    bool operator<(const QTreeWidgetItem &other) const override;
-};
-
 /**
  * @brief The ProtocolWidget class
  * @ingroup gui
@@ -63,13 +50,9 @@ public:
 
     void storeSyncActivity(QTextStream &ts);
 
-    // Shared with IssueWidget
-    static QTreeWidgetItem *createCompletedTreewidgetItem(const QString &folder, const SyncFileItem &item);
-    static QString timeString(QDateTime dt, QLocale::FormatType format = QLocale::NarrowFormat);
-
 public slots:
-    void slotItemCompleted(const QString &folder, const SyncFileItemPtr &item);
-    void slotOpenFile(QTreeWidgetItem *item, int);
+    void slotItemsCompleted(const QString &folder, const SyncFileItemVector &items);
+    void slotOpenFile(const QModelIndex &index);
 
 protected:
     void showEvent(QShowEvent *);
@@ -80,6 +63,8 @@ signals:
 
 private:
     Ui::ProtocolWidget *_ui;
+    ProtocolItemModel *_model;
+    ProtocolSortFilterModel *_sortModel;
 };
 }
 #endif // PROTOCOLWIDGET_H
@@ -380,6 +380,8 @@ void SocketApi::command_RETRIEVE_FILE_STATUS(const QString &argument, SocketList
 
         QString relativePath = systemPath.mid(syncFolder->cleanPath().length() + 1);
         SyncFileStatus fileStatus = syncFolder->syncEngine().syncFileStatusTracker().fileStatus(relativePath);
+        // Propagate what the user is looking at first
+        syncFolder->syncEngine().prioritizePath(relativePath);
         statusString = fileStatus.toSocketAPIString();
     }
 
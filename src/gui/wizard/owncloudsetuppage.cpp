@@ -322,6 +322,7 @@ void OwncloudSetupPage::slotCertificateAccepted()
 
         // to re-create the session ticket because we added a key/cert
         acc->setSslConfiguration(QSslConfiguration());
+        acc->_sessionTicket.clear();
         QSslConfiguration sslConfiguration = acc->getOrCreateSslConfig();
 
         // We're stuffing the certificate into the configuration form here. Later the
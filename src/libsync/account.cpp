@@ -29,10 +29,12 @@
 #include <QNetworkAccessManager>
 #include <QSslSocket>
 #include <QNetworkCookieJar>
+#include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QSslKey>
 #include <QAuthenticator>
+#include <QNetworkProxy>
 
 namespace OCC {
 
@@ -169,6 +171,8 @@ void Account::setCredentials(AbstractCredentials *cred)
         this, &Account::slotCredentialsFetched);
     connect(_credentials.data(), &AbstractCredentials::asked,
         this, &Account::slotCredentialsAsked);
+
+    setupTransferLanes();
 }
 
 QUrl Account::davUrl() const
@@ -210,6 +214,34 @@ QString Account::cookieJarPath()
     return cfg.configPath() + "/cookies" + id() + ".db";
 }
 
+QString Account::tlsSessionPath()
+{
+    ConfigFile cfg;
+    return cfg.configPath() + "/tlssession" + id() + ".bin";
+}
+
+void Account::saveTlsSession()
+{
+    if (_sessionTicket.isEmpty()) {
+        return;
+    }
+    // The session contains the keys of the connection: only the user may read it
+    QFile file(tlsSessionPath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || !file.setPermissions(QFile::ReadOwner | QFile::WriteOwner)
+        || file.write(_sessionTicket) != _sessionTicket.size()) {
+        qCWarning(lcAccount) << "Could not save the TLS session to" << file.fileName() << file.errorString();
+    }
+}
+
+void Account::restoreTlsSession()
+{
+    QFile file(tlsSessionPath());
+    if (file.open(QIODevice::ReadOnly)) {
+        _sessionTicket = file.readAll();
+    }
+}
+
 void Account::resetNetworkAccessManager()
 {
     if (!_credentials || !_am) {
@@ -228,6 +260,55 @@ void Account::resetNetworkAccessManager()
         SLOT(slotHandleSslErrors(QNetworkReply *, QList<QSslError>)));
     connect(_am.data(), &QNetworkAccessManager::proxyAuthenticationRequired,
         this, &Account::proxyAuthenticationRequired);
+
+    setupTransferLanes();
+}
+
+void Account::setupTransferLanes()
+{
+    _transferAms.clear();
+    const int count = ConfigFile().transferNetworkManagers();
+    for (int i = 0; i < count; ++i) {
+        QNetworkAccessManager *am = _credentials->createQNAM();
+        bool duplicate = am == _am.data();
+        foreach (const auto &other, _transferAms)
+            duplicate = duplicate || am == other.data();
+        if (duplicate) {
+            // Some credentials hand out a single access manager
+            qCInfo(lcAccount) << "No separate access managers available for transfers";
+            break;
+        }
+        QSharedPointer<QNetworkAccessManager> transferAm(am, &QObject::deleteLater);
+        lendCookieJarTo(am);
+        connect(am, SIGNAL(sslErrors(QNetworkReply *, QList<QSslError>)),
+            SLOT(slotHandleSslErrors(QNetworkReply *, QList<QSslError>)));
+        connect(am, &QNetworkAccessManager::proxyAuthenticationRequired,
+            this, &Account::proxyAuthenticationRequired);
+        _transferAms.append(transferAm);
+    }
+    // Keep the statistics across resets
+    while (_transferLaneStats.size() < _transferAms.size()) {
+        QSharedPointer<NetworkLaneStats> stats(new NetworkLaneStats);
+        stats->_name = QStringLiteral("transfer %1").arg(_transferLaneStats.size() + 1);
+        _transferLaneStats.append(stats);
+    }
+    _transferLaneStats.resize(_transferAms.size());
+}
+
+QVector<NetworkLaneStats> Account::networkLaneStats() const
+{
+    QVector<NetworkLaneStats> result;
+    auto add = [&result](const QSharedPointer<NetworkLaneStats> &stats) {
+        NetworkLaneStats copy = *stats;
+        if (copy._busyTimer.isValid())
+            copy._busyMsecs += copy._busyTimer.elapsed();
+        result.append(copy);
+    };
+    if (_metadataLaneStats)
+        add(_metadataLaneStats);
+    foreach (const auto &stats, _transferLaneStats)
+        add(stats);
+    return result;
 }
 
 QNetworkAccessManager *Account::networkAccessManager()
@@ -240,22 +321,80 @@ QSharedPointer<QNetworkAccessManager> Account::sharedNetworkAccessManager()
     return _am;
 }
 
-QNetworkReply *Account::sendRawRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
+static QNetworkReply *sendWith(QNetworkAccessManager *am, const QByteArray &verb, const QNetworkRequest &req, QIODevice *data)
 {
-    req.setUrl(url);
-    req.setSslConfiguration(this->getOrCreateSslConfig());
     if (verb == "HEAD" && !data) {
-        return _am->head(req);
+        return am->head(req);
     } else if (verb == "GET" && !data) {
-        return _am->get(req);
+        return am->get(req);
     } else if (verb == "POST") {
-        return _am->post(req, data);
+        return am->post(req, data);
     } else if (verb == "PUT") {
-        return _am->put(req, data);
+        return am->put(req, data);
     } else if (verb == "DELETE" && !data) {
-        return _am->deleteResource(req);
+        return am->deleteResource(req);
     }
-    return _am->sendCustomRequest(req, verb, data);
+    return am->sendCustomRequest(req, verb, data);
+}
+
+static bool isTransferRequest(const QByteArray &verb, QIODevice *data)
+{
+    return verb == "GET" || verb == "PUT" || (data && data->size() > 1024 * 1024);
+}
+
+static const char laneBytesSentC[] = "owncloud-lane-bytes-sent";
+static const char laneBytesReceivedC[] = "owncloud-lane-bytes-received";
+
+static void trackRequest(QNetworkReply *reply, const QSharedPointer<NetworkLaneStats> &stats)
+{
+    if (stats->_activeRequests++ == 0)
+        stats->_busyTimer.start();
+    stats->_requests++;
+
+    QObject::connect(reply, &QNetworkReply::uploadProgress, reply, [reply, stats](qint64 sent, qint64) {
+        stats->_bytesSent += sent - reply->property(laneBytesSentC).toLongLong();
+        reply->setProperty(laneBytesSentC, sent);
+    });
+    QObject::connect(reply, &QNetworkReply::downloadProgress, reply, [reply, stats](qint64 received, qint64) {
+        stats->_bytesReceived += received - reply->property(laneBytesReceivedC).toLongLong();
+        reply->setProperty(laneBytesReceivedC, received);
+    });
+    QObject::connect(reply, &QNetworkReply::finished, reply, [stats]() {
+        if (--stats->_activeRequests == 0) {
+            stats->_busyMsecs += stats->_busyTimer.elapsed();
+            stats->_busyTimer.invalidate();
+        }
+    });
+}
+
+QNetworkReply *Account::sendRawRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
+{
+    req.setUrl(url);
+    req.setSslConfiguration(this->getOrCreateSslConfig());
+
+    if (!_transferAms.isEmpty() && isTransferRequest(verb, data)) {
+        // Use the least busy transfer lane
+        int lane = 0;
+        for (int i = 1; i < _transferAms.size(); ++i) {
+            if (_transferLaneStats[i]->_activeRequests < _transferLaneStats[lane]->_activeRequests)
+                lane = i;
+        }
+        QNetworkAccessManager *am = _transferAms[lane].data();
+        // The proxy may be changed on the main access manager at any time
+        if (am->proxy() != _am->proxy())
+            am->setProxy(_am->proxy());
+        QNetworkReply *reply = sendWith(am, verb, req, data);
+        trackRequest(reply, _transferLaneStats[lane]);
+        return reply;
+    }
+
+    if (!_metadataLaneStats) {
+        _metadataLaneStats.reset(new NetworkLaneStats);
+        _metadataLaneStats->_name = QStringLiteral("metadata");
+    }
+    QNetworkReply *reply = sendWith(_am.data(), verb, req, data);
+    trackRequest(reply, _metadataLaneStats);
+    return reply;
 }
 
 SimpleNetworkJob *Account::sendRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
@@ -287,6 +426,12 @@ QSslConfiguration Account::getOrCreateSslConfig()
     sslConfig.setSslOption(QSsl::SslOptionDisableSessionSharing, false);
     sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
 
+    // Resuming the last session, possibly from before a restart, saves the
+    // round trips and the key exchange of a full handshake
+    if (!_sessionTicket.isEmpty()) {
+        sslConfig.setSessionTicket(_sessionTicket);
+    }
+
     return sslConfig;
 }
 
@@ -377,6 +522,7 @@ void Account::slotHandleSslErrors(QNetworkReply *reply, QList<QSslError> errors)
     // Keep a ref here on our stackframe to make sure that it doesn't get deleted before
     // handleErrors returns.
     QSharedPointer<QNetworkAccessManager> qnamLock = _am;
+    auto transferQnamLock = _transferAms;
     QPointer<QObject> guard = reply;
 
     if (_sslErrorHandler->handleErrors(errors, reply->sslConfiguration(), &approvedCerts, sharedFromThis())) {
@@ -427,6 +573,8 @@ void Account::handleInvalidCredentials()
 void Account::clearQNAMCache()
 {
     _am->clearAccessCache();
+    foreach (const auto &am, _transferAms)
+        am->clearAccessCache();
 }
 
 const Capabilities &Account::capabilities() const
@@ -26,6 +26,8 @@
 #include <QSslCipher>
 #include <QSslError>
 #include <QSharedPointer>
+#include <QElapsedTimer>
+#include <QVector>
 
 #ifndef TOKEN_AUTH_ONLY
 #include <QPixmap>
@@ -61,6 +63,35 @@ public:
     virtual bool handleErrors(QList<QSslError>, const QSslConfiguration &conf, QList<QSslCertificate> *, AccountPtr) = 0;
 };
 
+/**
+ * @brief Usage of one network access manager of an account
+ *
+ * Each access manager opens its own connections to the server, see
+ * Account::sendRawRequest().
+ * @ingroup libsync
+ */
+struct NetworkLaneStats
+{
+    NetworkLaneStats()
+        : _activeRequests(0)
+        , _requests(0)
+        , _bytesSent(0)
+        , _bytesReceived(0)
+        , _busyMsecs(0)
+    {
+    }
+
+    QString _name;
+    int _activeRequests;
+    qint64 _requests;
+    qint64 _bytesSent;
+    qint64 _bytesReceived;
+    /// Time during which at least one request was active
+    qint64 _busyMsecs;
+    /// Running while requests are active
+    QElapsedTimer _busyTimer;
+};
+
 /**
  * @brief The Account class represents an account on an ownCloud Server
  * @ingroup libsync
@@ -135,6 +166,10 @@ public:
      * Network requests in AbstractNetworkJobs are created through
      * this function. Other places should prefer to use jobs or
      * sendRequest().
+     *
+     * File transfers (GET, PUT and big request bodies) are spread over the
+     * transfer access managers, if any are configured, so that they don't
+     * take the connections that metadata requests need.
      */
     QNetworkReply *sendRawRequest(const QByteArray &verb,
         const QUrl &url,
@@ -226,10 +261,23 @@ public:
     void lendCookieJarTo(QNetworkAccessManager *guest);
     QString cookieJarPath();
 
+    /** Where the TLS session is kept across restarts, next to the cookies */
+    QString tlsSessionPath();
+    /// Writes _sessionTicket to tlsSessionPath()
+    void saveTlsSession();
+    /// Loads the session that getOrCreateSslConfig() offers to the server for resumption
+    void restoreTlsSession();
+
     void resetNetworkAccessManager();
     QNetworkAccessManager *networkAccessManager();
     QSharedPointer<QNetworkAccessManager> sharedNetworkAccessManager();
 
+    /** Usage of the network access managers, the metadata one first.
+     *
+     * See ConfigFile::transferNetworkManagers()
+     */
+    QVector<NetworkLaneStats> networkLaneStats() const;
+
     /// Called by network jobs on credential errors, emits invalidCredentials()
     void handleInvalidCredentials();
 
@@ -267,6 +315,9 @@ private:
     Account(QObject *parent = 0);
     void setSharedThis(AccountPtr sharedThis);
 
+    /// (Re)creates the transfer access managers after _am changed
+    void setupTransferLanes();
+
     QWeakPointer<Account> _sharedThis;
     QString _id;
     QString _davUser;
@@ -292,6 +343,10 @@ private:
     QScopedPointer<AbstractSslErrorHandler> _sslErrorHandler;
     QuotaInfo *_quotaInfo;
     QSharedPointer<QNetworkAccessManager> _am;
+    QSharedPointer<NetworkLaneStats> _metadataLaneStats;
+    // Extra access managers for the file transfers, see setupTransferLanes()
+    QVector<QSharedPointer<QNetworkAccessManager>> _transferAms;
+    QVector<QSharedPointer<NetworkLaneStats>> _transferLaneStats;
     QScopedPointer<AbstractCredentials> _credentials;
     bool _http2Supported = false;
 
@@ -26,370 +26,316 @@
 #include <QLoggingCategory>
 #include <QTimer>
 #include <QObject>
+#include <QSet>
 
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcBandwidthManager, "sync.bandwidthmanager", QtInfoMsg)
 
+// Quota is handed out this often: short enough for smooth traffic, long
+// enough for the transfers to read a useful amount each time.
+static const int refillIntervalMsec = 50;
+
+// The bucket holds the tokens of this long, but at least one read buffer
+static const qint64 burstMsec = 200;
+static const qint64 minimumBurst = 16 * 1024;
+
+// For relative limits: how long a capacity probe lasts and how often it runs.
 // Because of the many layers of buffering inside Qt (and probably the OS and the network)
-// we cannot lower this value much more. If we do, the estimated bw will be very high
+// a probe cannot be much shorter. If it is, the estimated bw will be very high
 // because the buffers fill fast while the actual network algorithms are not relevant yet.
-static qint64 relativeLimitMeasuringTimerIntervalMsec = 1000 * 2;
+static const qint64 probeDurationMsec = 1000;
+static const qint64 probeIntervalMsec = 30 * 1000;
 // See also WritingState in http://code.woboq.org/qt5/qtbase/src/network/access/qhttpprotocolhandler.cpp.html#_ZN20QHttpProtocolHandler11sendRequestEv
 
-// FIXME At some point:
-//  * Register device only after the QNR received its metaDataChanged() signal
-//  * Incorporate Qt buffer fill state (it's a negative absolute delta).
-//  * Incorporate SSL overhead (percentage)
-//  * For relative limiting, do less measuring and more delaying+giving quota
-//  * For relative limiting, smoothen measurements
+// Don't let a bad measurement stall the transfers
+static const qint64 minimumRelativeRate = 10 * 1024;
+
+TokenBucket::TokenBucket()
+    : _rate(0)
+    , _tokens(0)
+{
+    _lastRefill.start();
+}
+
+void TokenBucket::setRate(qint64 bytesPerSecond)
+{
+    _rate = qMax(qint64(0), bytesPerSecond);
+    _tokens = qMin(_tokens, double(capacity()));
+}
+
+qint64 TokenBucket::capacity() const
+{
+    return qMax(minimumBurst, _rate * burstMsec / 1000);
+}
+
+void TokenBucket::refill()
+{
+    const double seconds = _lastRefill.nsecsElapsed() / 1e9;
+    _lastRefill.start();
+    _tokens = qMin(double(capacity()), _tokens + _rate * seconds);
+}
+
+void TokenBucket::refillFor(qint64 msecs)
+{
+    _tokens = qMin(double(capacity()), _tokens + _rate * msecs / 1000.0);
+}
+
+qint64 TokenBucket::take(qint64 wanted)
+{
+    if (_rate == 0)
+        return wanted;
+    const qint64 taken = qBound(qint64(0), wanted, qint64(_tokens));
+    _tokens -= taken;
+    return taken;
+}
+
+void TokenBucket::giveBack(qint64 tokens)
+{
+    if (_rate == 0 || tokens <= 0)
+        return;
+    _tokens = qMin(double(capacity()), _tokens + tokens);
+}
+
+// The limits apply to the client as a whole, not to each folder: the managers
+// that currently have transfers in a direction split its limit equally.
+static QSet<BandwidthManager *> &uploadingManagers()
+{
+    static QSet<BandwidthManager *> managers;
+    return managers;
+}
+
+static QSet<BandwidthManager *> &downloadingManagers()
+{
+    static QSet<BandwidthManager *> managers;
+    return managers;
+}
+
+// The configured share of the link for relative limits, in percent
+static qint64 relativeLimitPercent(qint64 limit)
+{
+    // don't use too extreme values
+    return qBound(qint64(10), -limit, qint64(90));
+}
 
 BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     : QObject()
     , _propagator(p)
-    , _relativeLimitCurrentMeasuredDevice(0)
-    , _relativeUploadLimitProgressAtMeasuringRestart(0)
     , _currentUploadLimit(0)
-    , _relativeLimitCurrentMeasuredJob(0)
     , _currentDownloadLimit(0)
 {
     _currentUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
     _currentDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
 
-    QObject::connect(&_switchingTimer, &QTimer::timeout, this, &BandwidthManager::switchingTimerExpired);
-    _switchingTimer.setInterval(10 * 1000);
-    _switchingTimer.start();
-    QMetaObject::invokeMethod(this, "switchingTimerExpired", Qt::QueuedConnection);
-
-    // absolute uploads/downloads
-    QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
-
-    // Relative uploads
-    QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadMeasuringTimerExpired);
-    _relativeUploadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeUploadMeasuringTimer.start();
-    _relativeUploadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeUploadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadDelayTimerExpired);
-    _relativeUploadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
-
-    // Relative downloads
-    QObject::connect(&_relativeDownloadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadMeasuringTimerExpired);
-    _relativeDownloadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeDownloadMeasuringTimer.start();
-    _relativeDownloadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeDownloadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadDelayTimerExpired);
-    _relativeDownloadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
+    QObject::connect(&_refillTimer, &QTimer::timeout, this, &BandwidthManager::refillTimerExpired);
+    _refillTimer.setInterval(refillIntervalMsec);
 }
 
 BandwidthManager::~BandwidthManager()
 {
+    uploadingManagers().remove(this);
+    downloadingManagers().remove(this);
 }
 
 void BandwidthManager::registerUploadDevice(UploadDevice *p)
 {
-    _absoluteUploadDeviceList.append(p);
-    _relativeUploadDeviceList.append(p);
+    _uploadDeviceList.append(p);
+    uploadingManagers().insert(this);
     QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
 
-    if (usingAbsoluteUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(false);
-    } else if (usingRelativeUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(true);
-    } else {
-        p->setBandwidthLimited(false);
-        p->setChoked(false);
-    }
+    // A limited device waits for its first quota
+    p->setBandwidthLimited(usingAbsoluteUploadLimit()
+        || (usingRelativeUploadLimit() && !_uploadEstimate._probing));
+    p->setChoked(false);
+    updateRefillTimer();
 }
 
 void BandwidthManager::unregisterUploadDevice(QObject *o)
 {
     auto p = reinterpret_cast<UploadDevice *>(o); // note, we might already be in the ~QObject
-    _absoluteUploadDeviceList.removeAll(p);
-    _relativeUploadDeviceList.removeAll(p);
-    if (p == _relativeLimitCurrentMeasuredDevice) {
-        _relativeLimitCurrentMeasuredDevice = 0;
-        _relativeUploadLimitProgressAtMeasuringRestart = 0;
+    _uploadDeviceList.removeAll(p);
+    if (_uploadDeviceList.isEmpty()) {
+        uploadingManagers().remove(this);
     }
 }
 
 void BandwidthManager::registerDownloadJob(GETFileJob *j)
 {
     _downloadJobList.append(j);
+    downloadingManagers().insert(this);
     QObject::connect(j, &QObject::destroyed, this, &BandwidthManager::unregisterDownloadJob);
 
-    if (usingAbsoluteDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(false);
-    } else if (usingRelativeDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(true);
-    } else {
-        j->setBandwidthLimited(false);
-        j->setChoked(false);
-    }
+    j->setBandwidthLimited(usingAbsoluteDownloadLimit()
+        || (usingRelativeDownloadLimit() && !_downloadEstimate._probing));
+    j->setChoked(false);
+    updateRefillTimer();
 }
 
 void BandwidthManager::unregisterDownloadJob(QObject *o)
 {
     GETFileJob *j = reinterpret_cast<GETFileJob *>(o); // note, we might already be in the ~QObject
     _downloadJobList.removeAll(j);
-    if (_relativeLimitCurrentMeasuredJob == j) {
-        _relativeLimitCurrentMeasuredJob = 0;
-        _relativeDownloadLimitProgressAtMeasuringRestart = 0;
+    if (_downloadJobList.isEmpty()) {
+        downloadingManagers().remove(this);
     }
 }
 
-void BandwidthManager::relativeUploadMeasuringTimerExpired()
+void BandwidthManager::updateRefillTimer()
 {
-    if (!usingRelativeUploadLimit() || _relativeUploadDeviceList.count() == 0) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
-        return;
-    }
-    if (_relativeLimitCurrentMeasuredDevice == 0) {
-        qCDebug(lcBandwidthManager) << "No device set, just waiting 1 sec";
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
-        return;
+    if ((!_uploadDeviceList.isEmpty() || !_downloadJobList.isEmpty()) && !_refillTimer.isActive()) {
+        _refillTimer.start();
     }
-
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                               + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeUploadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeUploadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredDevice->_readWithProgress << _relativeLimitCurrentMeasuredDevice->_read
-                                << qAbs(_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                       - _relativeLimitCurrentMeasuredDevice->_read)
-                                << ")";
-
-    qint64 uploadLimitPercent = -_currentUploadLimit;
-    // don't use too extreme values
-    uploadLimitPercent = qMin(uploadLimitPercent, qint64(90));
-    uploadLimitPercent = qMax(qint64(10), uploadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / uploadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << uploadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any upload to timeout
-    _relativeUploadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeUploadDelayTimer.start();
-
-    int deviceCount = _relativeUploadDeviceList.count();
-    qint64 quotaPerDevice = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) / deviceCount + 1.0;
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-        ud->setBandwidthLimited(true);
-        ud->setChoked(false);
-        ud->giveBandwidthQuota(quotaPerDevice);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerDevice / 1024.0 << "kB to" << ud;
-    }
-    _relativeLimitCurrentMeasuredDevice = 0;
 }
 
-void BandwidthManager::relativeUploadDelayTimerExpired()
+void BandwidthManager::refillTimerExpired()
 {
-    // Switch to measuring state
-    _relativeUploadMeasuringTimer.start(); // always start to continue the cycle
+    updateLimits();
 
-    if (!usingRelativeUploadLimit()) {
-        return; // oh, not actually needed
-    }
-
-    if (_relativeUploadDeviceList.isEmpty()) {
+    if (_uploadDeviceList.isEmpty() && _downloadJobList.isEmpty()) {
+        _refillTimer.stop();
         return;
     }
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting measuring";
-
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredDevice = _relativeUploadDeviceList.takeFirst();
-    _relativeUploadDeviceList.append(_relativeLimitCurrentMeasuredDevice);
-
-    _relativeUploadLimitProgressAtMeasuringRestart = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                                         + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    _relativeLimitCurrentMeasuredDevice->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredDevice->setChoked(false);
+    distributeUploadQuota();
+    distributeDownloadQuota();
+}
 
-    // choke all other UploadDevices
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-        if (ud != _relativeLimitCurrentMeasuredDevice) {
-            ud->setBandwidthLimited(true);
-            ud->setChoked(true);
+void BandwidthManager::updateLimits()
+{
+    qint64 newUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
+    if (newUploadLimit != _currentUploadLimit) {
+        qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
+        _currentUploadLimit = newUploadLimit;
+        _uploadEstimate = LinkEstimate();
+        Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+            ud->setBandwidthLimited(newUploadLimit != 0);
+            ud->setChoked(false);
+        }
+    }
+    qint64 newDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
+    if (newDownloadLimit != _currentDownloadLimit) {
+        qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
+        _currentDownloadLimit = newDownloadLimit;
+        _downloadEstimate = LinkEstimate();
+        Q_FOREACH (GETFileJob *j, _downloadJobList) {
+            j->setBandwidthLimited(newDownloadLimit != 0);
+            j->setChoked(false);
         }
     }
-
-    // now we're in measuring state
 }
 
-// for downloads:
-void BandwidthManager::relativeDownloadMeasuringTimerExpired()
+bool BandwidthManager::updateEstimate(LinkEstimate &estimate, const QHash<QObject *, qint64> &positions)
 {
-    if (!usingRelativeDownloadLimit() || _downloadJobList.count() == 0) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
+    if (!estimate._probing) {
+        if (estimate._capacity > 0 && estimate._phase.elapsed() < probeIntervalMsec) {
+            return false;
+        }
+        qCDebug(lcBandwidthManager) << "Measuring the link capacity with" << positions.size() << "transfers";
+        estimate._probing = true;
+        estimate._phase.start();
+        estimate._startPositions = positions;
+        return true;
     }
-    if (_relativeLimitCurrentMeasuredJob == 0) {
-        qCDebug(lcBandwidthManager) << "No job set, just waiting 1 sec";
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
+    const qint64 elapsed = estimate._phase.elapsed();
+    if (elapsed < probeDurationMsec) {
+        return true;
     }
 
-    qCDebug(lcBandwidthManager) << _downloadJobList.count() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeDownloadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeDownloadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-
-    qint64 downloadLimitPercent = -_currentDownloadLimit;
-    // don't use too extreme values
-    downloadLimitPercent = qMin(downloadLimitPercent, qint64(90));
-    downloadLimitPercent = qMax(qint64(10), downloadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / downloadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << downloadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any download to timeout
-    _relativeDownloadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeDownloadDelayTimer.start();
-
-    int jobCount = _downloadJobList.count();
-    qint64 quota = relativeLimitProgressDifference * (downloadLimitPercent / 100.0);
-    if (quota > 20 * 1024) {
-        qCInfo(lcBandwidthManager) << "ADJUSTING QUOTA FROM " << quota << " TO " << quota - 20 * 1024;
-        quota -= 20 * 1024;
-    }
-    qint64 quotaPerJob = quota / jobCount + 1.0;
-    Q_FOREACH (GETFileJob *gfj, _downloadJobList) {
-        gfj->setBandwidthLimited(true);
-        gfj->setChoked(false);
-        gfj->giveBandwidthQuota(quotaPerJob);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerJob / 1024.0 << "kB to" << gfj;
+    qint64 transferred = 0;
+    for (auto it = positions.constBegin(); it != positions.constEnd(); ++it) {
+        auto start = estimate._startPositions.constFind(it.key());
+        if (start != estimate._startPositions.constEnd()) {
+            transferred += qMax(qint64(0), it.value() - start.value());
+        }
     }
-    _relativeLimitCurrentMeasuredDevice = 0;
+    const qint64 measured = transferred * 1000 / elapsed;
+    // Smoothen: a single probe may have waited for the server
+    estimate._capacity = estimate._capacity > 0 ? (estimate._capacity + measured) / 2 : measured;
+    qCInfo(lcBandwidthManager) << "Measured" << measured / 1024 << "kB/s, link capacity estimate" << estimate._capacity / 1024 << "kB/s";
+
+    estimate._probing = false;
+    estimate._phase.start();
+    estimate._startPositions.clear();
+    return false;
 }
 
-void BandwidthManager::relativeDownloadDelayTimerExpired()
+void BandwidthManager::distributeUploadQuota()
 {
-    // Switch to measuring state
-    _relativeDownloadMeasuringTimer.start(); // always start to continue the cycle
-
-    if (!usingRelativeDownloadLimit()) {
-        return; // oh, not actually needed
-    }
-
-    if (_downloadJobList.isEmpty()) {
-        qCDebug(lcBandwidthManager) << _downloadJobList.count() << "No jobs?";
+    if (_currentUploadLimit == 0 || _uploadDeviceList.isEmpty()) {
         return;
     }
 
-    qCDebug(lcBandwidthManager) << _downloadJobList.count() << "Starting measuring";
-
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredJob = _downloadJobList.takeFirst();
-    _downloadJobList.append(_relativeLimitCurrentMeasuredJob);
-
-    _relativeDownloadLimitProgressAtMeasuringRestart = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    _relativeLimitCurrentMeasuredJob->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredJob->setChoked(false);
-
-    // choke all other download jobs
-    Q_FOREACH (GETFileJob *gfj, _downloadJobList) {
-        if (gfj != _relativeLimitCurrentMeasuredJob) {
-            gfj->setBandwidthLimited(true);
-            gfj->setChoked(true);
+    TokenBucket &bucket = _uploadBucket;
+    const int managers = qMax(1, uploadingManagers().size());
+    if (usingRelativeUploadLimit()) {
+        QHash<QObject *, qint64> positions;
+        Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+            positions.insert(ud, (ud->_readWithProgress + ud->_read) / 2);
         }
+        const bool probing = updateEstimate(_uploadEstimate, positions);
+        Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+            if (ud->isBandwidthLimited() == probing) {
+                ud->setBandwidthLimited(!probing);
+            }
+        }
+        if (probing) {
+            return;
+        }
+        bucket.setRate(qMax(minimumRelativeRate,
+            _uploadEstimate._capacity * relativeLimitPercent(_currentUploadLimit) / 100 / managers));
+    } else {
+        bucket.setRate(_currentUploadLimit / managers);
     }
 
-    // now we're in measuring state
+    // Unused quota goes back into the bucket, then all devices get an equal share
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+        bucket.giveBack(ud->_bandwidthQuota);
+    }
+    bucket.refill();
+    int remaining = _uploadDeviceList.count();
+    Q_FOREACH (UploadDevice *ud, _uploadDeviceList) {
+        ud->giveBandwidthQuota(bucket.take(bucket.available() / remaining--));
+    }
+    // Round robin the remainder of the division
+    _uploadDeviceList.append(_uploadDeviceList.takeFirst());
 }
 
-// end downloads
-
-void BandwidthManager::switchingTimerExpired()
+void BandwidthManager::distributeDownloadQuota()
 {
-    qint64 newUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
-    if (newUploadLimit != _currentUploadLimit) {
-        qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
-        _currentUploadLimit = newUploadLimit;
-        Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-            if (newUploadLimit == 0) {
-                ud->setBandwidthLimited(false);
-                ud->setChoked(false);
-            } else if (newUploadLimit > 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(false);
-            } else if (newUploadLimit < 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(true);
-            }
-        }
+    if (_currentDownloadLimit == 0 || _downloadJobList.isEmpty()) {
+        return;
     }
-    qint64 newDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
-    if (newDownloadLimit != _currentDownloadLimit) {
-        qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
-        _currentDownloadLimit = newDownloadLimit;
+
+    TokenBucket &bucket = _downloadBucket;
+    const int managers = qMax(1, downloadingManagers().size());
+    if (usingRelativeDownloadLimit()) {
+        QHash<QObject *, qint64> positions;
         Q_FOREACH (GETFileJob *j, _downloadJobList) {
-            if (usingAbsoluteDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(false);
-            } else if (usingRelativeDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(true);
-            } else {
-                j->setBandwidthLimited(false);
-                j->setChoked(false);
+            positions.insert(j, j->currentDownloadPosition());
+        }
+        const bool probing = updateEstimate(_downloadEstimate, positions);
+        Q_FOREACH (GETFileJob *j, _downloadJobList) {
+            if (j->isBandwidthLimited() == probing) {
+                j->setBandwidthLimited(!probing);
             }
         }
+        if (probing) {
+            return;
+        }
+        bucket.setRate(qMax(minimumRelativeRate,
+            _downloadEstimate._capacity * relativeLimitPercent(_currentDownloadLimit) / 100 / managers));
+    } else {
+        bucket.setRate(_currentDownloadLimit / managers);
     }
-}
 
-void BandwidthManager::absoluteLimitTimerExpired()
-{
-    if (usingAbsoluteUploadLimit() && _absoluteUploadDeviceList.count() > 0) {
-        qint64 quotaPerDevice = _currentUploadLimit / qMax(1, _absoluteUploadDeviceList.count());
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.count() << _currentUploadLimit;
-        Q_FOREACH (UploadDevice *device, _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
-        }
+    Q_FOREACH (GETFileJob *j, _downloadJobList) {
+        bucket.giveBack(j->bandwidthQuota());
     }
-    if (usingAbsoluteDownloadLimit() && _downloadJobList.count() > 0) {
-        qint64 quotaPerJob = _currentDownloadLimit / qMax(1, _downloadJobList.count());
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.count() << _currentDownloadLimit;
-        Q_FOREACH (GETFileJob *j, _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << j;
-        }
+    bucket.refill();
+    int remaining = _downloadJobList.count();
+    Q_FOREACH (GETFileJob *j, _downloadJobList) {
+        j->giveBandwidthQuota(bucket.take(bucket.available() / remaining--));
     }
+    _downloadJobList.append(_downloadJobList.takeFirst());
 }
 }
@@ -15,6 +15,10 @@
 #ifndef BANDWIDTHMANAGER_H
 #define BANDWIDTHMANAGER_H
 
+#include "owncloudlib.h"
+
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QLinkedList>
 #include <QTimer>
@@ -26,8 +30,57 @@ class UploadDevice;
 class GETFileJob;
 class OwncloudPropagator;
 
+/**
+ * @brief Token bucket for one direction of traffic
+ *
+ * The tokens are bytes. They accumulate at the rate of the limit, up to
+ * a small burst, and a transfer may only move the bytes it took.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT TokenBucket
+{
+public:
+    TokenBucket();
+
+    /// The rate in bytes per second, 0 if there is no limit
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const { return _rate; }
+
+    /// The most tokens the bucket holds
+    qint64 capacity() const;
+    qint64 available() const { return qint64(_tokens); }
+
+    /// Adds the tokens that accumulated since the last refill
+    void refill();
+    /// Adds the tokens that accumulate in \a msecs
+    void refillFor(qint64 msecs);
+
+    /// Takes up to \a wanted tokens and returns how many were taken
+    qint64 take(qint64 wanted);
+    /// Puts back tokens that were taken but not used
+    void giveBack(qint64 tokens);
+
+private:
+    qint64 _rate;
+    double _tokens;
+    QElapsedTimer _lastRefill;
+};
+
 /**
  * @brief The BandwidthManager class
+ *
+ * Every few milliseconds the tokens of the bucket of each direction are
+ * shared between the transfers, which use them as their quota. The limits
+ * apply to the client as a whole: the managers of all folders that have
+ * transfers in a direction each fill their own bucket at an equal share
+ * of the limit.
+ *
+ * With a relative limit the capacity of the link is measured by letting
+ * the transfers run unlimited for a moment from time to time. The rest of
+ * the time the rate is the configured share of that capacity, leaving the
+ * remainder to other traffic.
+ *
  * @ingroup libsync
  */
 class BandwidthManager : public QObject
@@ -50,55 +103,52 @@ public slots:
     void registerDownloadJob(GETFileJob *);
     void unregisterDownloadJob(QObject *);
 
-    void absoluteLimitTimerExpired();
-    void switchingTimerExpired();
-
-    void relativeUploadMeasuringTimerExpired();
-    void relativeUploadDelayTimerExpired();
-
-    void relativeDownloadMeasuringTimerExpired();
-    void relativeDownloadDelayTimerExpired();
+    /// Hands out the tokens that accumulated since the last tick
+    void refillTimerExpired();
 
 private:
-    // for switching between absolute and relative bw limiting
-    QTimer _switchingTimer;
-
-    // FIXME this timer and this variable should be replaced
-    // by the propagator emitting the changed limit values to us as signal
+    /// The capacity measurement of one direction, for relative limits
+    struct LinkEstimate
+    {
+        LinkEstimate()
+            : _capacity(0)
+            , _probing(false)
+        {
+        }
+        /// Bytes per second, 0 until it was measured
+        qint64 _capacity;
+        bool _probing;
+        /// Time since the current probe, or the last one, started
+        QElapsedTimer _phase;
+        /// Positions of the transfers when the probe started
+        QHash<QObject *, qint64> _startPositions;
+    };
+
+    void updateLimits();
+    void updateRefillTimer();
+    void distributeUploadQuota();
+    void distributeDownloadQuota();
+
+    /// Starts or ends a probe; returns whether the transfers are unlimited for it
+    bool updateEstimate(LinkEstimate &estimate, const QHash<QObject *, qint64> &positions);
+
+    // FIXME this variable should be replaced by the propagator
+    // emitting the changed limit values to us as signal
     OwncloudPropagator *_propagator;
 
-    // for absolute up/down bw limiting
-    QTimer _absoluteLimitTimer;
-
-    // FIXME merge these two lists
-    QLinkedList<UploadDevice *> _absoluteUploadDeviceList;
-    QLinkedList<UploadDevice *> _relativeUploadDeviceList;
-
-    QTimer _relativeUploadMeasuringTimer;
-
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeUploadDelayTimer;
-
-    // the device measured
-    UploadDevice *_relativeLimitCurrentMeasuredDevice;
-
-    // for measuring how much progress we made at start
-    qint64 _relativeUploadLimitProgressAtMeasuringRestart;
-    qint64 _currentUploadLimit;
+    QTimer _refillTimer;
 
+    QLinkedList<UploadDevice *> _uploadDeviceList;
     QLinkedList<GETFileJob *> _downloadJobList;
-    QTimer _relativeDownloadMeasuringTimer;
 
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeDownloadDelayTimer;
-
-    // the device measured
-    GETFileJob *_relativeLimitCurrentMeasuredJob;
+    qint64 _currentUploadLimit;
+    qint64 _currentDownloadLimit;
 
-    // for measuring how much progress we made at start
-    qint64 _relativeDownloadLimitProgressAtMeasuringRestart;
+    LinkEstimate _uploadEstimate;
+    LinkEstimate _downloadEstimate;
 
-    qint64 _currentDownloadLimit;
+    TokenBucket _uploadBucket;
+    TokenBucket _downloadBucket;
 };
 }
 
@@ -127,6 +127,54 @@ bool Capabilities::chunkingNg() const
     return _capabilities["dav"].toMap()["chunking"].toByteArray() >= "1.0";
 }
 
+bool Capabilities::chunkingReuse() const
+{
+    static const auto chunkingReuse = qgetenv("OWNCLOUD_CHUNKING_REUSE");
+    if (chunkingReuse == "0")
+        return false;
+    if (chunkingReuse == "1")
+        return true;
+    return chunkingNg() && _capabilities["dav"].toMap()["chunkingReuse"].toByteArray() >= "1.0";
+}
+
+bool Capabilities::bulkUpload() const
+{
+    static const auto bulkUpload = qgetenv("OWNCLOUD_BULK_UPLOAD");
+    if (bulkUpload == "0")
+        return false;
+    if (bulkUpload == "1")
+        return true;
+    return _capabilities["dav"].toMap()["bulkupload"].toByteArray() >= "1.0";
+}
+
+bool Capabilities::uploadCompression() const
+{
+    static const auto uploadCompression = qgetenv("OWNCLOUD_UPLOAD_COMPRESSION");
+    if (uploadCompression == "0")
+        return false;
+    if (uploadCompression == "1")
+        return true;
+    return _capabilities["dav"].toMap()["uploadcompression"].toByteArray() >= "1.0";
+}
+
+bool Capabilities::blockSignatures() const
+{
+    static const auto blockSignatures = qgetenv("OWNCLOUD_BLOCK_SIGNATURES");
+    if (blockSignatures == "0")
+        return false;
+    if (blockSignatures == "1")
+        return true;
+    return _capabilities["dav"].toMap()["blockSignatures"].toByteArray() >= "1.0";
+}
+
+QString Capabilities::changeNotificationsEndpoint() const
+{
+    static const auto changeNotifications = qgetenv("OWNCLOUD_CHANGE_NOTIFICATIONS");
+    if (changeNotifications == "0")
+        return QString();
+    return _capabilities["dav"].toMap()["changeNotifications"].toString();
+}
+
 bool Capabilities::chunkingParallelUploadDisabled() const
 {
     return _capabilities["dav"].toMap()["chunkingParallelUploadDisabled"].toBool();
@@ -44,9 +44,59 @@ public:
     bool shareResharing() const;
     bool chunkingNg() const;
 
+    /**
+     * Whether a chunk of a chunking-NG upload may be a copy of a range of
+     * the file it replaces, see PropagateUploadFileNG. The
+     * OWNCLOUD_CHUNKING_REUSE environment variable overrides it.
+     *
+     * Path: dav/chunkingReuse
+     * Default: false
+     */
+    bool chunkingReuse() const;
+
     /// disable parallel upload in chunking
     bool chunkingParallelUploadDisabled() const;
 
+    /**
+     * Whether several small files may be uploaded in one multipart
+     * POST request to remote.php/dav/bulk. The OWNCLOUD_BULK_UPLOAD
+     * environment variable overrides it.
+     *
+     * Path: dav/bulkupload
+     * Default: false
+     */
+    bool bulkUpload() const;
+
+    /**
+     * Whether upload bodies may be sent with "Content-Encoding: gzip".
+     * The OWNCLOUD_UPLOAD_COMPRESSION environment variable overrides it.
+     *
+     * Path: dav/uploadcompression
+     * Default: false
+     */
+    bool uploadCompression() const;
+
+    /**
+     * Whether a GET with an "OC-Block-Signatures" header returns the
+     * block signatures of the file instead of its content, so downloads
+     * can fetch only the blocks that are not available locally. The
+     * OWNCLOUD_BLOCK_SIGNATURES environment variable overrides it.
+     *
+     * Path: dav/blockSignatures
+     * Default: false
+     */
+    bool blockSignatures() const;
+
+    /**
+     * The long-poll endpoint that announces remote changes, relative to
+     * the server url, see ChangeNotifier. Setting the
+     * OWNCLOUD_CHANGE_NOTIFICATIONS environment variable to 0 ignores it.
+     *
+     * Path: dav/changeNotifications
+     * Default: empty, no endpoint
+     */
+    QString changeNotificationsEndpoint() const;
+
     /// Whether the "privatelink" DAV property is available
     bool privateLinkPropertyAvailable() const;
 
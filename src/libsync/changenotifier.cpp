@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "changenotifier.h"
+#include "account.h"
+#include "capabilities.h"
+#include "networkjobs.h"
+#include "common/utility.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QNetworkReply>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcChangeNotifier, "sync.changenotifier", QtInfoMsg)
+
+// Longer than the servers hold a poll, so only a dead connection times out
+static const int longPollTimeoutMsec = 5 * 60 * 1000;
+// A server that answers right away must not make us spin
+static const int minimumPollIntervalMsec = 1000;
+static const int minimumRetryMsec = 5 * 1000;
+static const int maximumRetryMsec = 5 * 60 * 1000;
+
+ChangeNotifier::ChangeNotifier(AccountPtr account, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _failures(0)
+    , _running(false)
+    , _healthy(false)
+{
+    _pollTimer.setSingleShot(true);
+    connect(&_pollTimer, &QTimer::timeout, this, &ChangeNotifier::sendPoll);
+}
+
+void ChangeNotifier::start()
+{
+    const QString endpoint = _account->capabilities().changeNotificationsEndpoint();
+    if (endpoint.isEmpty()) {
+        stop();
+        return;
+    }
+    if (_running && endpoint == _endpoint) {
+        return;
+    }
+    stop();
+
+    qCInfo(lcChangeNotifier) << "Listening for remote changes at" << endpoint;
+    _endpoint = endpoint;
+    _cursor.clear();
+    _failures = 0;
+    _running = true;
+    sendPoll();
+}
+
+void ChangeNotifier::stop()
+{
+    _running = false;
+    _pollTimer.stop();
+    if (_job) {
+        _job->disconnect(this);
+        _job->reply()->abort();
+        _job = nullptr;
+    }
+    setHealthy(false);
+}
+
+void ChangeNotifier::sendPoll()
+{
+    QList<QPair<QString, QString>> query;
+    if (!_cursor.isEmpty()) {
+        query << qMakePair(QStringLiteral("cursor"), _cursor);
+    }
+
+    _job = new SimpleNetworkJob(_account, this);
+    _job->setTimeout(longPollTimeoutMsec);
+    connect(_job.data(), &SimpleNetworkJob::finishedSignal, this, &ChangeNotifier::slotPollFinished);
+    _pollDuration.start();
+    _job->startRequest("GET", Utility::concatUrlPath(_account->url(), _endpoint, query));
+}
+
+void ChangeNotifier::slotPollFinished(QNetworkReply *reply)
+{
+    _job = nullptr;
+
+    QJsonParseError error;
+    error.error = QJsonParseError::NoError;
+    QJsonObject json;
+    if (reply->error() == QNetworkReply::NoError) {
+        json = QJsonDocument::fromJson(reply->readAll(), &error).object();
+    }
+
+    if (reply->error() != QNetworkReply::NoError || error.error != QJsonParseError::NoError
+        || !json.contains(QStringLiteral("cursor"))) {
+        const int retryMsec = qMin(minimumRetryMsec << qMin(_failures, 10), maximumRetryMsec);
+        ++_failures;
+        qCWarning(lcChangeNotifier) << "Polling for changes failed:" << reply->error() << reply->errorString()
+                                    << error.errorString() << "retrying in" << retryMsec << "ms";
+        setHealthy(false);
+        _pollTimer.start(retryMsec);
+        return;
+    }
+
+    _failures = 0;
+    _cursor = json.value(QStringLiteral("cursor")).toString();
+    setHealthy(true);
+
+    QStringList changes;
+    foreach (const QJsonValue &path, json.value(QStringLiteral("changes")).toArray()) {
+        changes.append(path.toString());
+    }
+    if (!changes.isEmpty()) {
+        qCInfo(lcChangeNotifier) << "Remote changes below" << changes;
+        emit remoteChanged(changes);
+    }
+
+    // A receiver may have stopped us
+    if (_running) {
+        _pollTimer.start(qMax<qint64>(0, minimumPollIntervalMsec - _pollDuration.elapsed()));
+    }
+}
+
+void ChangeNotifier::setHealthy(bool healthy)
+{
+    if (_healthy == healthy) {
+        return;
+    }
+    _healthy = healthy;
+    emit healthChanged(healthy);
+}
+
+} // namespace OCC
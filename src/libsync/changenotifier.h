@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+#include "accountfwd.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QTimer>
+
+class QNetworkReply;
+
+namespace OCC {
+
+class SimpleNetworkJob;
+
+/**
+ * @brief Listens to the server for remote changes
+ *
+ * Uses the long-poll endpoint advertised in the capabilities (see
+ * Capabilities::changeNotificationsEndpoint()). Each poll is a GET of
+ * the endpoint with the cursor of the previous answer. The server holds
+ * the request until something changes or its own timeout expires, then
+ * answers with a JSON object:
+ *
+ *   { "cursor": "<opaque>", "changes": [ "/Documents", "/Photos/2017" ] }
+ *
+ * The changes are paths relative to the WebDAV root of the user below
+ * which something changed. The first poll, without cursor, is answered
+ * right away with the current cursor.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT ChangeNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChangeNotifier(AccountPtr account, QObject *parent = 0);
+
+    /// Starts listening if the server has an endpoint, stops otherwise
+    void start();
+    void stop();
+
+    /**
+     * True while the server answers the polls: remote changes arrive
+     * through remoteChanged() without the need to poll the etags.
+     */
+    bool isHealthy() const { return _healthy; }
+
+signals:
+    /// Something changed below these remote paths
+    void remoteChanged(const QStringList &paths);
+    void healthChanged(bool healthy);
+
+private slots:
+    void sendPoll();
+    void slotPollFinished(QNetworkReply *reply);
+
+private:
+    void setHealthy(bool healthy);
+
+    AccountPtr _account;
+    QString _endpoint;
+    QString _cursor;
+    QPointer<SimpleNetworkJob> _job;
+    QTimer _pollTimer;
+    QElapsedTimer _pollDuration;
+    int _failures;
+    bool _running;
+    bool _healthy;
+};
+}
@@ -46,6 +46,7 @@ Q_LOGGING_CATEGORY(lcConfigFile, "sync.configfile", QtInfoMsg)
 static const char remotePollIntervalC[] = "remotePollInterval";
 static const char forceSyncIntervalC[] = "forceSyncInterval";
 static const char notificationRefreshIntervalC[] = "notificationRefreshInterval";
+static const char journalMaintenanceIntervalC[] = "journalMaintenanceInterval";
 static const char monoIconsC[] = "monoIcons";
 static const char promptDeleteC[] = "promptDeleteAllFiles";
 static const char crashReporterC[] = "crashReporter";
@@ -54,6 +55,7 @@ static const char skipUpdateCheckC[] = "skipUpdateCheck";
 static const char updateCheckIntervalC[] = "updateCheckInterval";
 static const char geometryC[] = "geometry";
 static const char timeoutC[] = "timeout";
+static const char transferNetworkManagersC[] = "transferNetworkManagers";
 static const char chunkSizeC[] = "chunkSize";
 static const char minChunkSizeC[] = "minChunkSize";
 static const char maxChunkSizeC[] = "maxChunkSize";
@@ -128,6 +130,12 @@ int ConfigFile::timeout() const
     return settings.value(QLatin1String(timeoutC), 300).toInt(); // default to 5 min
 }
 
+int ConfigFile::transferNetworkManagers() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qBound(0, settings.value(QLatin1String(transferNetworkManagersC), 0).toInt(), 16);
+}
+
 quint64 ConfigFile::chunkSize() const
 {
     QSettings settings(configFile(), QSettings::IniFormat);
@@ -406,6 +414,23 @@ quint64 ConfigFile::forceSyncInterval(const QString &connection) const
     return interval;
 }
 
+quint64 ConfigFile::journalMaintenanceInterval(const QString &connection) const
+{
+    QString con(connection);
+    if (connection.isEmpty())
+        con = defaultConnection();
+    QSettings settings(configFile(), QSettings::IniFormat);
+    settings.beginGroup(con);
+
+    quint64 defaultInterval = 24 * 60 * 60 * 1000ull; // 24h
+    quint64 interval = settings.value(QLatin1String(journalMaintenanceIntervalC), defaultInterval).toULongLong();
+    if (interval < 60 * 60 * 1000ull) {
+        qCWarning(lcConfigFile) << "Journal maintenance interval smaller than one hour, setting to one hour";
+        interval = 60 * 60 * 1000ull;
+    }
+    return interval;
+}
+
 quint64 ConfigFile::notificationRefreshInterval(const QString &connection) const
 {
     QString con(connection);
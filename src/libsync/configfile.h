@@ -72,6 +72,9 @@ public:
     /* Force sync interval, in milliseconds */
     quint64 forceSyncInterval(const QString &connection = QString()) const;
 
+    /* Minimum time between two maintenance runs of a sync journal, in milliseconds */
+    quint64 journalMaintenanceInterval(const QString &connection = QString()) const;
+
     bool monoIcons() const;
     void setMonoIcons(bool);
 
@@ -117,6 +120,14 @@ public:
     void setOptionalDesktopNotifications(bool show);
 
     int timeout() const;
+
+    /** Number of extra network access managers used for file transfers
+     *
+     * Each one opens its own connections to the server, next to the ones
+     * used for metadata requests. 0 sends everything through one manager.
+     */
+    int transferNetworkManagers() const;
+
     quint64 chunkSize() const;
     quint64 maxChunkSize() const;
     quint64 minChunkSize() const;
@@ -37,6 +37,9 @@ ConnectionValidator::ConnectionValidator(AccountPtr account, QObject *parent)
     : QObject(parent)
     , _account(account)
     , _isCheckingServerAndAuth(false)
+    , _authChecked(false)
+    , _capabilitiesChecked(false)
+    , _userFetched(false)
 {
 }
 
@@ -204,6 +207,14 @@ void ConnectionValidator::checkAuthentication()
     connect(job, &PropfindJob::result, this, &ConnectionValidator::slotAuthSuccess);
     connect(job, &PropfindJob::finishedWithError, this, &ConnectionValidator::slotAuthFailed);
     job->start();
+
+    // status.php opened the connection already. Instead of waiting for the
+    // authentication, send the other requests right away so they all travel
+    // over the warm connection concurrently.
+    if (_isCheckingServerAndAuth) {
+        checkServerCapabilities();
+        fetchUser();
+    }
 }
 
 void ConnectionValidator::slotAuthFailed(QNetworkReply *reply)
@@ -242,7 +253,8 @@ void ConnectionValidator::slotAuthSuccess()
         reportResult(Connected);
         return;
     }
-    checkServerCapabilities();
+    _authChecked = true;
+    reportConnectedWhenDone();
 }
 
 void ConnectionValidator::checkServerCapabilities()
@@ -252,8 +264,10 @@ void ConnectionValidator::checkServerCapabilities()
     job->setTimeout(timeoutToUseMsec);
     QObject::connect(job, &JsonApiJob::jsonReceived, this, &ConnectionValidator::slotCapabilitiesRecieved);
     job->start();
+}
 
-    // And we'll retrieve the ocs config in parallel
+void ConnectionValidator::fetchOcsConfig()
+{
     // note that 'this' might be destroyed before the job finishes, so intentionally not parented
     auto configJob = new JsonApiJob(_account, QLatin1String("ocs/v1.php/config"));
     configJob->setTimeout(timeoutToUseMsec);
@@ -267,17 +281,11 @@ void ConnectionValidator::checkServerCapabilities()
 
 void ConnectionValidator::slotCapabilitiesRecieved(const QJsonDocument &json)
 {
-    auto caps = json.object().value("ocs").toObject().value("data").toObject().value("capabilities").toObject();
-    qCInfo(lcConnectionValidator) << "Server capabilities" << caps;
-    _account->setCapabilities(caps.toVariantMap());
-
-    // New servers also report the version in the capabilities
-    QString serverVersion = caps["core"].toObject()["status"].toObject()["version"].toString();
-    if (!serverVersion.isEmpty() && !setAndCheckServerVersion(serverVersion)) {
-        return;
-    }
-
-    fetchUser();
+    // Applied to the account once the authentication succeeded, see applyResults()
+    _capabilities = json.object().value("ocs").toObject().value("data").toObject().value("capabilities").toObject();
+    qCInfo(lcConnectionValidator) << "Server capabilities" << _capabilities;
+    _capabilitiesChecked = true;
+    reportConnectedWhenDone();
 }
 
 void ConnectionValidator::ocsConfigReceived(const QJsonDocument &json, AccountPtr account)
@@ -329,34 +337,67 @@ bool ConnectionValidator::setAndCheckServerVersion(const QString &version)
 
 void ConnectionValidator::slotUserFetched(const QJsonDocument &json)
 {
-    QString user = json.object().value("ocs").toObject().value("data").toObject().value("id").toString();
-    if (!user.isEmpty()) {
-        _account->setDavUser(user);
-    }
-    QString displayName = json.object().value("ocs").toObject().value("data").toObject().value("display-name").toString();
-    if (!displayName.isEmpty()) {
-        _account->setDavDisplayName(displayName);
-    }
+    // Applied to the account once the authentication succeeded, see applyResults()
+    _user = json.object().value("ocs").toObject().value("data").toObject();
 #ifndef TOKEN_AUTH_ONLY
     AvatarJob *job = new AvatarJob(_account, this);
     job->setTimeout(20 * 1000);
     QObject::connect(job, &AvatarJob::avatarPixmap, this, &ConnectionValidator::slotAvatarImage);
     job->start();
 #else
-    reportResult(Connected);
+    _userFetched = true;
+    reportConnectedWhenDone();
 #endif
 }
 
 #ifndef TOKEN_AUTH_ONLY
 void ConnectionValidator::slotAvatarImage(const QImage &img)
 {
-    _account->setAvatar(img);
-    reportResult(Connected);
+    _avatar = img;
+    _userFetched = true;
+    reportConnectedWhenDone();
 }
 #endif
 
+void ConnectionValidator::reportConnectedWhenDone()
+{
+    if (_authChecked && _capabilitiesChecked && _userFetched && applyResults()) {
+        reportResult(Connected);
+    }
+}
+
+bool ConnectionValidator::applyResults()
+{
+    _account->setCapabilities(_capabilities.toVariantMap());
+
+    // New servers also report the version in the capabilities
+    QString serverVersion = _capabilities["core"].toObject()["status"].toObject()["version"].toString();
+    if (!serverVersion.isEmpty() && !setAndCheckServerVersion(serverVersion)) {
+        return false;
+    }
+
+    QString user = _user.value("id").toString();
+    if (!user.isEmpty()) {
+        _account->setDavUser(user);
+    }
+    QString displayName = _user.value("display-name").toString();
+    if (!displayName.isEmpty()) {
+        _account->setDavDisplayName(displayName);
+    }
+#ifndef TOKEN_AUTH_ONLY
+    _account->setAvatar(_avatar);
+#endif
+
+    fetchOcsConfig();
+    return true;
+}
+
 void ConnectionValidator::reportResult(Status status)
 {
+    // The requests that still run in parallel have nothing to add anymore
+    foreach (AbstractNetworkJob *job, findChildren<AbstractNetworkJob *>()) {
+        job->disconnect(this);
+    }
     emit connectionResult(status, _errors);
     deleteLater();
 }
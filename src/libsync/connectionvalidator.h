@@ -19,9 +19,14 @@
 #include <QObject>
 #include <QStringList>
 #include <QVariantMap>
+#include <QJsonObject>
 #include <QNetworkReply>
 #include "accountfwd.h"
 
+#ifndef TOKEN_AUTH_ONLY
+#include <QImage>
+#endif
+
 namespace OCC {
 
 /**
@@ -50,28 +55,37 @@ namespace OCC {
   +---------------------------+
   |
 *-+-> checkAuthentication (PROPFIND on root)
-        PropfindJob
-        |
-        +-> slotAuthFailed --> X
-        |
-        +-> slotAuthSuccess --+--> X (depending if coming from checkServerAndAuth or not)
-                              |
-  +---------------------------+
+  |     PropfindJob
+  |     |
+  |     +-> slotAuthFailed --> X
+  |     |
+  |     +-> slotAuthSuccess --+--> X (if not coming from checkServerAndAuth)
+  |                           |
+  |                           +--> reportConnectedWhenDone
+  |
+  |   when coming from checkServerAndAuth, in parallel to the PROPFIND:
   |
-  +-> checkServerCapabilities --------------v (in parallel)
-        JsonApiJob (cloud/capabilities)     JsonApiJob (ocs/v1.php/config)
-        |                                   +-> ocsConfigReceived
-        +-> slotCapabilitiesRecieved -+
-                                      |
-  +-----------------------------------+
+  +-> checkServerCapabilities
+  |     JsonApiJob (cloud/capabilities)
+  |     |
+  |     +-> slotCapabilitiesRecieved --> reportConnectedWhenDone
   |
   +-> fetchUser
-        PropfindJob
+        JsonApiJob (cloud/user)
         |
         +-> slotUserFetched
               AvatarJob
               |
-              +-> slotAvatarImage --> reportResult()
+              +-> slotAvatarImage --> reportConnectedWhenDone
+
+  reportConnectedWhenDone --> applyResults() --> reportResult() once all three are done
+                               |
+                               +-> fetchOcsConfig
+                                     JsonApiJob (ocs/v1.php/config)
+                                     +-> ocsConfigReceived
+
+  The capabilities and the user are only applied to the account once the
+  authentication succeeded.
 
     \endcode
  */
@@ -129,7 +143,15 @@ protected slots:
 
 private:
     void reportResult(Status status);
+    /// Reports Connected once the authentication, capabilities and user requests are all done
+    void reportConnectedWhenDone();
+    /** Applies the capabilities and the user to the account
+     *
+     * Returns false and reports ServerVersionMismatch for very old servers.
+     */
+    bool applyResults();
     void checkServerCapabilities();
+    void fetchOcsConfig();
     void fetchUser();
     static void ocsConfigReceived(const QJsonDocument &json, AccountPtr account);
 
@@ -142,6 +164,16 @@ private:
     QStringList _errors;
     AccountPtr _account;
     bool _isCheckingServerAndAuth;
+    bool _authChecked;
+    bool _capabilitiesChecked;
+    bool _userFetched;
+
+    // Results of the requests done in parallel to the authentication
+    QJsonObject _capabilities;
+    QJsonObject _user;
+#ifndef TOKEN_AUTH_ONLY
+    QImage _avatar;
+#endif
 };
 }
 
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "deltasync.h"
+#include "filesystem.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QtEndian>
+
+#include <vector>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcDeltaSync, "sync.deltasync", QtInfoMsg)
+
+static const qint64 minimumBlockSize = 64 * 1024;
+static const qint64 maximumBlockSize = 8 * 1024 * 1024;
+// Keeps the signatures of big files at a few hundred kilobytes
+static const qint64 targetBlockCount = 16 * 1024;
+// Size of the weak checksum plus an MD5
+static const int serializedSignatureSize = 4 + 16;
+
+qint64 DeltaSync::blockSizeForFileSize(qint64 fileSize)
+{
+    qint64 blockSize = minimumBlockSize;
+    while (blockSize < maximumBlockSize && fileSize / blockSize > targetBlockCount)
+        blockSize *= 2;
+    return blockSize;
+}
+
+// The checksum of rsync: a is the sum of the bytes, b the sum of the
+// running values of a. Both are kept modulo 2^16.
+static inline quint32 combine(quint32 a, quint32 b)
+{
+    return (a & 0xffff) | (b << 16);
+}
+
+quint32 DeltaSync::weakChecksum(const char *data, qint64 size)
+{
+    quint32 a = 0;
+    quint32 b = 0;
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    for (qint64 i = 0; i < size; ++i) {
+        a += bytes[i];
+        b += a;
+    }
+    return combine(a, b);
+}
+
+static QByteArray strongChecksum(const char *data, qint64 size)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, size), QCryptographicHash::Md5);
+}
+
+QVector<DeltaSync::BlockSignature> DeltaSync::computeSignatures(const char *data, qint64 size, qint64 blockSize)
+{
+    QVector<BlockSignature> result;
+    result.reserve(size / blockSize);
+    for (qint64 offset = 0; offset + blockSize <= size; offset += blockSize) {
+        BlockSignature signature;
+        signature._weak = weakChecksum(data + offset, blockSize);
+        signature._strong = strongChecksum(data + offset, blockSize);
+        result.append(signature);
+    }
+    return result;
+}
+
+static void appendSegment(QVector<DeltaSync::Segment> &segments, qint64 offset, qint64 size, qint64 sourceOffset)
+{
+    if (size <= 0)
+        return;
+    if (!segments.isEmpty()) {
+        // Merge with the previous segment if it continues it
+        auto &last = segments.last();
+        if (last._offset + last._size == offset
+            && (sourceOffset < 0 ? !last.isReused() : last._sourceOffset + last._size == sourceOffset)) {
+            last._size += size;
+            return;
+        }
+    }
+    DeltaSync::Segment segment;
+    segment._offset = offset;
+    segment._size = size;
+    segment._sourceOffset = sourceOffset;
+    segments.append(segment);
+}
+
+QVector<DeltaSync::Segment> DeltaSync::computeDelta(const char *data, qint64 size, qint64 blockSize,
+    const QVector<BlockSignature> &oldSignatures)
+{
+    QVector<Segment> segments;
+
+    QHash<quint32, int> blockByWeak;
+    // Most windows match nothing: a cheap filter in front of the hash
+    std::vector<bool> filter(1 << 16);
+    // Iterating backwards makes the first block win for duplicated contents
+    for (int i = oldSignatures.size() - 1; i >= 0; --i) {
+        blockByWeak.insertMulti(oldSignatures[i]._weak, i);
+        filter[oldSignatures[i]._weak >> 16] = true;
+    }
+
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    qint64 literalStart = 0;
+    qint64 pos = 0;
+    quint32 a = 0;
+    quint32 b = 0;
+    bool windowValid = false;
+    int expectedBlock = 0;
+
+    while (!oldSignatures.isEmpty() && pos + blockSize <= size) {
+        if (!windowValid) {
+            a = b = 0;
+            for (qint64 i = 0; i < blockSize; ++i) {
+                a += bytes[pos + i];
+                b += a;
+            }
+            windowValid = true;
+        }
+
+        const quint32 weak = combine(a, b);
+        int match = -1;
+        if (filter[weak >> 16] && blockByWeak.contains(weak)) {
+            const QByteArray strong = strongChecksum(data + pos, blockSize);
+            // Prefer the block that continues the previous match
+            for (auto it = blockByWeak.find(weak); it != blockByWeak.end() && it.key() == weak; ++it) {
+                if (oldSignatures[it.value()]._strong != strong)
+                    continue;
+                if (match < 0 || it.value() == expectedBlock)
+                    match = it.value();
+            }
+        }
+
+        if (match >= 0) {
+            appendSegment(segments, literalStart, pos - literalStart, -1);
+            appendSegment(segments, pos, blockSize, match * blockSize);
+            pos += blockSize;
+            literalStart = pos;
+            expectedBlock = match + 1;
+            windowValid = false;
+            continue;
+        }
+
+        if (pos + blockSize < size) {
+            const uchar out = bytes[pos];
+            const uchar in = bytes[pos + blockSize];
+            a += in - out;
+            b += a - quint32(blockSize) * out;
+        }
+        ++pos;
+    }
+    appendSegment(segments, literalStart, size - literalStart, -1);
+    return segments;
+}
+
+QByteArray DeltaSync::serializeSignatures(const QVector<BlockSignature> &signatures)
+{
+    QByteArray result(signatures.size() * serializedSignatureSize, Qt::Uninitialized);
+    char *out = result.data();
+    for (const auto &signature : signatures) {
+        qToBigEndian(signature._weak, reinterpret_cast<uchar *>(out));
+        memcpy(out + 4, signature._strong.constData(), 16);
+        out += serializedSignatureSize;
+    }
+    return result;
+}
+
+QVector<DeltaSync::BlockSignature> DeltaSync::deserializeSignatures(const QByteArray &data)
+{
+    QVector<BlockSignature> result;
+    if (data.size() % serializedSignatureSize != 0)
+        return result;
+    result.reserve(data.size() / serializedSignatureSize);
+    for (const char *in = data.constData(); in < data.constData() + data.size(); in += serializedSignatureSize) {
+        BlockSignature signature;
+        signature._weak = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(in));
+        signature._strong = QByteArray(in + 4, 16);
+        result.append(signature);
+    }
+    return result;
+}
+
+DeltaSync::Analysis DeltaSync::analyzeFile(const QString &fileName, qint64 oldBlockSize, const QByteArray &oldSignatures)
+{
+    Analysis result;
+
+    QFile file(fileName);
+    QString error;
+    if (!FileSystem::openAndSeekFileSharedRead(&file, &error, 0)) {
+        qCWarning(lcDeltaSync) << "Could not open" << fileName << error;
+        return result;
+    }
+    const qint64 size = file.size();
+    const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : "";
+    if (!data) {
+        qCWarning(lcDeltaSync) << "Could not map" << fileName << file.errorString();
+        return result;
+    }
+
+    result._blockSize = blockSizeForFileSize(size);
+    result._signatures = serializeSignatures(computeSignatures(data, size, result._blockSize));
+
+    const auto old = deserializeSignatures(oldSignatures);
+    if (!old.isEmpty() && oldBlockSize > 0) {
+        result._segments = computeDelta(data, size, oldBlockSize, old);
+        for (const auto &segment : result._segments) {
+            if (segment.isReused())
+                result._reusedBytes += segment._size;
+        }
+    }
+    result._valid = true;
+    return result;
+}
+
+DeltaSync::Patch DeltaSync::patchFile(const QString &source, const QString &target, qint64 targetSize,
+    qint64 blockSize, const QByteArray &targetSignatures)
+{
+    Patch result;
+
+    const auto signatures = deserializeSignatures(targetSignatures);
+    if (blockSize <= 0 || signatures.size() != targetSize / blockSize) {
+        qCWarning(lcDeltaSync) << "Signatures do not describe a file of size" << targetSize;
+        return result;
+    }
+
+    QFile sourceFile(source);
+    QString error;
+    if (!FileSystem::openAndSeekFileSharedRead(&sourceFile, &error, 0)) {
+        qCWarning(lcDeltaSync) << "Could not open" << source << error;
+        return result;
+    }
+    const qint64 size = sourceFile.size();
+    const char *data = size > 0 ? reinterpret_cast<const char *>(sourceFile.map(0, size)) : "";
+    if (!data) {
+        qCWarning(lcDeltaSync) << "Could not map" << source << sourceFile.errorString();
+        return result;
+    }
+
+    QFile targetFile(target);
+    if (!targetFile.open(QIODevice::WriteOnly) || !targetFile.resize(targetSize)) {
+        qCWarning(lcDeltaSync) << "Could not create" << target << targetFile.errorString();
+        return result;
+    }
+
+    auto copyBlocks = [&](qint64 targetOffset, qint64 sourceOffset, qint64 length) {
+        return targetFile.seek(targetOffset)
+            && targetFile.write(data + sourceOffset, length) == length;
+    };
+
+    std::vector<bool> present(signatures.size());
+    // Where the source has the content of a block, for targets that repeat it
+    QHash<QByteArray, qint64> sourceOffsetByStrong;
+    for (const auto &segment : computeDelta(data, size, blockSize, signatures)) {
+        if (!segment.isReused())
+            continue;
+        if (!copyBlocks(segment._sourceOffset, segment._offset, segment._size)) {
+            qCWarning(lcDeltaSync) << "Could not write to" << target << targetFile.errorString();
+            return result;
+        }
+        for (qint64 offset = 0; offset < segment._size; offset += blockSize) {
+            const int block = (segment._sourceOffset + offset) / blockSize;
+            present[block] = true;
+            sourceOffsetByStrong.insert(signatures[block]._strong, segment._offset + offset);
+        }
+    }
+
+    for (int block = 0; block < signatures.size(); ++block) {
+        if (!present[block]) {
+            auto it = sourceOffsetByStrong.constFind(signatures[block]._strong);
+            if (it != sourceOffsetByStrong.constEnd()) {
+                if (!copyBlocks(block * blockSize, it.value(), blockSize)) {
+                    qCWarning(lcDeltaSync) << "Could not write to" << target << targetFile.errorString();
+                    return result;
+                }
+                present[block] = true;
+            }
+        }
+        if (present[block])
+            result._reusedBytes += blockSize;
+        else
+            appendSegment(result._missing, block * blockSize, blockSize, -1);
+    }
+    appendSegment(result._missing, signatures.size() * blockSize, targetSize - signatures.size() * blockSize, -1);
+
+    targetFile.close();
+    if (targetFile.error() != QFile::NoError) {
+        qCWarning(lcDeltaSync) << "Could not write to" << target << targetFile.errorString();
+        return result;
+    }
+    result._valid = true;
+    return result;
+}
+
+} // namespace OCC
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+namespace OCC {
+
+/**
+ * @brief Block level comparison of two versions of a file, in the style of rsync
+ *
+ * The signatures of a version are a weak rolling checksum and a strong hash
+ * for each block of a fixed size. Comparing a new version against them finds
+ * the blocks that can be reused from the old version, even if they moved.
+ *
+ * @ingroup libsync
+ */
+namespace DeltaSync {
+
+    struct BlockSignature
+    {
+        quint32 _weak;
+        QByteArray _strong;
+    };
+
+    /**
+     * A range of the new version: either data that needs to be sent, or a
+     * copy of a range of the old version.
+     */
+    struct Segment
+    {
+        qint64 _offset;
+        qint64 _size;
+        /// Offset in the old version, -1 if the data needs to be sent
+        qint64 _sourceOffset;
+
+        bool isReused() const { return _sourceOffset >= 0; }
+    };
+
+    /// The result of analyzeFile()
+    struct Analysis
+    {
+        Analysis()
+            : _blockSize(0)
+            , _reusedBytes(0)
+            , _valid(false)
+        {
+        }
+        qint64 _blockSize;
+        /// Signatures of the new version, see serializeSignatures()
+        QByteArray _signatures;
+        /// Empty if there were no usable old signatures
+        QVector<Segment> _segments;
+        qint64 _reusedBytes;
+        bool _valid;
+    };
+
+    /// The result of patchFile()
+    struct Patch
+    {
+        Patch()
+            : _reusedBytes(0)
+            , _valid(false)
+        {
+        }
+        /// The ranges of the target that still need to be filled, in order
+        QVector<Segment> _missing;
+        qint64 _reusedBytes;
+        bool _valid;
+    };
+
+    /// The block size that is used for a file of that size
+    OWNCLOUDSYNC_EXPORT qint64 blockSizeForFileSize(qint64 fileSize);
+
+    /// The weak checksum that computeDelta() can roll over the data
+    OWNCLOUDSYNC_EXPORT quint32 weakChecksum(const char *data, qint64 size);
+
+    /// Signatures for all complete blocks of the data
+    OWNCLOUDSYNC_EXPORT QVector<BlockSignature> computeSignatures(const char *data, qint64 size, qint64 blockSize);
+
+    /**
+     * Describes the data as a list of consecutive segments, reusing the
+     * blocks of the old version wherever possible.
+     */
+    OWNCLOUDSYNC_EXPORT QVector<Segment> computeDelta(const char *data, qint64 size, qint64 blockSize,
+        const QVector<BlockSignature> &oldSignatures);
+
+    OWNCLOUDSYNC_EXPORT QByteArray serializeSignatures(const QVector<BlockSignature> &signatures);
+    OWNCLOUDSYNC_EXPORT QVector<BlockSignature> deserializeSignatures(const QByteArray &data);
+
+    /**
+     * Computes the signatures of the file and, if old signatures with the
+     * same block size are given, the delta against them.
+     *
+     * Reads the whole file; meant to run in a worker thread.
+     */
+    OWNCLOUDSYNC_EXPORT Analysis analyzeFile(const QString &fileName, qint64 oldBlockSize, const QByteArray &oldSignatures);
+
+    /**
+     * Creates \a target with a size of \a targetSize and copies every block
+     * of \a source that matches one of the target's signatures to its place.
+     *
+     * The tail of the target has no signature and is always missing.
+     * Reads the whole source file; meant to run in a worker thread.
+     */
+    OWNCLOUDSYNC_EXPORT Patch patchFile(const QString &source, const QString &target, qint64 targetSize,
+        qint64 blockSize, const QByteArray &targetSignatures);
+}
+
+} // namespace OCC
@@ -18,6 +18,15 @@
 #include <QFile>
 #include <QFileInfo>
 
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#elif defined(Q_OS_MAC)
+#include <fcntl.h>
+#endif
+
 // We use some internals of csync:
 extern "C" int c_utimes(const char *, const struct timeval *);
 
@@ -114,6 +123,75 @@ bool FileSystem::verifyFileUnchanged(const QString &fileName,
     return true;
 }
 
+bool FileSystem::preallocate(QFile &file, qint64 size)
+{
+    const qint64 current = file.size();
+    if (!file.isOpen() || size <= current) {
+        return false;
+    }
+#if defined(Q_OS_LINUX)
+    if (fallocate(file.handle(), FALLOC_FL_KEEP_SIZE, current, size - current) != 0) {
+        qCDebug(lcFileSystem) << "Could not preallocate" << file.fileName() << "errno:" << errno;
+        return false;
+    }
+    return true;
+#elif defined(Q_OS_MAC)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, size - current, 0 };
+    if (fcntl(file.handle(), F_PREALLOCATE, &store) == -1) {
+        // Contiguous space is not available, try fragmented
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(file.handle(), F_PREALLOCATE, &store) == -1) {
+            qCDebug(lcFileSystem) << "Could not preallocate" << file.fileName() << "errno:" << errno;
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FileSystem::cloneFile(const QString &source, const QString &destination, QString *errorString)
+{
+    QFile sourceFile(source);
+    if (!openAndSeekFileSharedRead(&sourceFile, errorString, 0)) {
+        return false;
+    }
+    QFile destinationFile(destination);
+    if (!destinationFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *errorString = destinationFile.errorString();
+        return false;
+    }
+
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    if (ioctl(destinationFile.handle(), FICLONE, sourceFile.handle()) == 0) {
+        return true;
+    }
+    // Not supported by the file system, or the files are on different ones
+    qCDebug(lcFileSystem) << "Could not clone" << source << "errno:" << errno;
+#endif
+
+    preallocate(destinationFile, sourceFile.size());
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    qint64 bytesRead = 0;
+    while ((bytesRead = sourceFile.read(buffer.data(), buffer.size())) > 0) {
+        if (destinationFile.write(buffer.constData(), bytesRead) != bytesRead) {
+            *errorString = destinationFile.errorString();
+            return false;
+        }
+    }
+    if (bytesRead < 0) {
+        *errorString = sourceFile.errorString();
+        return false;
+    }
+    destinationFile.close();
+    if (destinationFile.error() != QFile::NoError) {
+        *errorString = destinationFile.errorString();
+        return false;
+    }
+    return true;
+}
+
 #ifdef Q_OS_WIN
 static qint64 getSizeWithCsync(const QString &filename)
 {
@@ -77,6 +77,28 @@ namespace FileSystem {
     bool verifyFileUnchanged(const QString &fileName,
         qint64 previousSize,
         time_t previousMtime);
+
+    /**
+ * @brief Reserve disk space for \a file to grow to \a size bytes
+ *
+ * The file size is not changed: the file keeps growing as data is written,
+ * but the blocks are allocated up front to limit fragmentation. Does
+ * nothing where the platform has no way to do that.
+ *
+ * @return true if the space was reserved.
+ */
+    bool OWNCLOUDSYNC_EXPORT preallocate(QFile &file, qint64 size);
+
+    /**
+ * @brief Make \a destination a copy of \a source
+ *
+ * Where the file system supports it, the copy is a clone that shares the
+ * blocks of the source until either file is written to. Otherwise the
+ * content is copied.
+ *
+ * @return true on success, otherwise false with \a errorString set.
+ */
+    bool OWNCLOUDSYNC_EXPORT cloneFile(const QString &source, const QString &destination, QString *errorString);
 }
 
 /** @} */
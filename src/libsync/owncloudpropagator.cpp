@@ -41,6 +41,8 @@
 #include <QTimerEvent>
 #include <qmath.h>
 
+#include <algorithm>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagator, "sync.propagator", QtInfoMsg)
@@ -102,6 +104,94 @@ int OwncloudPropagator::hardMaximumActiveJob()
     return 6; // (Qt cannot do more anyway)
 }
 
+int OwncloudPropagator::maximumActiveMetadataJob()
+{
+    if (!_syncOptions._parallelNetworkJobs)
+        return 1;
+    static int max = qgetenv("OWNCLOUD_MAX_PARALLEL_METADATA").toUInt();
+    if (max)
+        return max;
+    // Keep more requests in flight than there are connections: they queue up
+    // in the QNAM and a connection does not sit idle while the reply of the
+    // previous request goes through the event loop.
+    return 2 * hardMaximumActiveJob();
+}
+
+bool OwncloudPropagator::canStartJob(PropagatorJob *job) const
+{
+    if (!_onlyQuickJobs || job->isLikelyFinishedQuickly())
+        return true;
+    // Composite jobs don't use a slot themselves, their children are checked
+    return !qobject_cast<PropagateItemJob *>(job);
+}
+
+bool OwncloudPropagator::isPriorityJob(PropagatorJob *job) const
+{
+    auto dirJob = qobject_cast<PropagateDirectory *>(job);
+    if (!dirJob || _priorityDirectories.isEmpty())
+        return false;
+    // Removals must keep their place: moves out of the directory happen before
+    if (dirJob->_item->_instruction == CSYNC_INSTRUCTION_REMOVE
+        || dirJob->_item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE)
+        return false;
+    const QString path = dirJob->_item->destination();
+    foreach (const QString &dir, _priorityDirectories) {
+        if (dir == path || (dir.startsWith(path) && dir.at(path.size()) == QLatin1Char('/')))
+            return true;
+    }
+    return false;
+}
+
+bool OwncloudPropagator::isInPriorityDirectory(const QString &path) const
+{
+    // Called for every comparison while sorting, so don't allocate.
+    // There are only a few priority directories.
+    const QStringRef directory = path.leftRef(qMax(0, path.lastIndexOf(QLatin1Char('/'))));
+    foreach (const QString &dir, _priorityDirectories) {
+        if (dir == directory)
+            return true;
+    }
+    return false;
+}
+
+void OwncloudPropagator::prioritize(const QString &directory)
+{
+    if (_priorityDirectories.contains(directory))
+        return;
+    _priorityDirectories.insert(directory);
+
+    if (_rootJob && _rootJob->_state != PropagatorJob::Finished) {
+        _rootJob->_subJobs.prioritizeJobs();
+        scheduleNextJob();
+    }
+}
+
+/* Files are sorted in classes by size, each class taking about an order of
+ * magnitude longer to transfer than the previous one */
+static int sizeClass(const SyncFileItem &item, quint64 smallFileSize, quint64 chunkSize)
+{
+    if (item._size < smallFileSize)
+        return 0;
+    if (item._size < chunkSize)
+        return 1;
+    return 2;
+}
+
+bool OwncloudPropagator::propagateBefore(const SyncFileItem &a, const SyncFileItem &b)
+{
+    if (!_priorityDirectories.isEmpty()) {
+        bool aPriority = isInPriorityDirectory(a.destination());
+        bool bPriority = isInPriorityDirectory(b.destination());
+        if (aPriority != bPriority)
+            return aPriority;
+    }
+    int aClass = sizeClass(a, smallFileSize(), _chunkSize);
+    int bClass = sizeClass(b, smallFileSize(), _chunkSize);
+    if (aClass != bClass)
+        return aClass < bClass;
+    return a._modtime > b._modtime;
+}
+
 PropagateItemJob::~PropagateItemJob()
 {
     if (auto p = propagator()) {
@@ -412,6 +502,40 @@ PropagateItemJob *OwncloudPropagator::createJob(const SyncFileItemPtr &item)
     return 0;
 }
 
+bool OwncloudPropagator::isBulkUploadCandidate(const SyncFileItem &item)
+{
+    return item._direction == SyncFileItem::Up
+        && (item._instruction == CSYNC_INSTRUCTION_NEW || item._instruction == CSYNC_INSTRUCTION_SYNC)
+        && !item.isDirectory()
+        && item._size < smallFileSize()
+        // The batch request is not throttled by the bandwidth manager
+        && _uploadLimit.fetchAndAddAcquire(0) == 0
+        && account()->capabilities().bulkUpload();
+}
+
+PropagatorJob *OwncloudPropagator::createJobForTask(const SyncFileItemPtr &item, SyncFileItemVector *tasks)
+{
+    if (!isBulkUploadCandidate(*item)) {
+        return createJob(item);
+    }
+
+    SyncFileItemVector batch;
+    batch.append(item);
+    for (auto it = tasks->begin(); it != tasks->end() && batch.size() < PropagateUploadBulk::maxFileCount;) {
+        if (isBulkUploadCandidate(**it)) {
+            batch.append(*it);
+            it = tasks->erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (batch.size() == 1) {
+        return createJob(item);
+    }
+    return new PropagateUploadBulk(this, batch);
+}
+
 quint64 OwncloudPropagator::smallFileSize()
 {
     const quint64 smallFileSize = 100 * 1024; //default to 1 MB. Not dynamic right now.
@@ -668,24 +792,33 @@ void OwncloudPropagator::scheduleNextJobImpl()
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
         }
-    } else if (_activeJobList.count() < hardMaximumActiveJob()) {
-        int likelyFinishedQuicklyCount = 0;
-        // NOTE: Only counts the first 3 jobs! Then for each
-        // one that is likely finished quickly, we can launch another one.
-        // When a job finishes another one will "move up" to be one of the first 3 and then
-        // be counted too.
-        for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
-            if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
-                likelyFinishedQuicklyCount++;
-            }
-        }
-        if (_activeJobList.count() < maximumActiveTransferJob() + likelyFinishedQuicklyCount) {
-            qCDebug(lcPropagator) << "Can pump in another request! activeJobs =" << _activeJobList.count();
-            if (_rootJob->scheduleSelfOrChild()) {
-                scheduleNextJob();
-            }
+        return;
+    }
+
+    // Only the jobs transferring a significant amount of data are limited by
+    // maximumActiveTransferJob(). Metadata requests (MKCOL, MOVE, DELETE) and
+    // small files are pumped in on top of them, so that a few big transfers
+    // don't serialize the creation of a whole directory tree.
+    int likelyFinishedQuicklyCount = 0;
+    foreach (PropagateItemJob *job, _activeJobList) {
+        if (job->isLikelyFinishedQuickly()) {
+            likelyFinishedQuicklyCount++;
         }
     }
+    int slowJobCount = _activeJobList.count() - likelyFinishedQuicklyCount;
+    int maximumActive = slowJobCount == 0 ? maximumActiveMetadataJob() : hardMaximumActiveJob();
+    if (_activeJobList.count() >= maximumActive) {
+        return;
+    }
+
+    qCDebug(lcPropagator) << "Can pump in another request! activeJobs =" << _activeJobList.count()
+                          << "slowJobs =" << slowJobCount;
+    _onlyQuickJobs = slowJobCount >= maximumActiveTransferJob();
+    bool started = _rootJob->scheduleSelfOrChild();
+    _onlyQuickJobs = false;
+    if (started) {
+        scheduleNextJob();
+    }
 }
 
 void OwncloudPropagator::reportProgress(const SyncFileItem &item, quint64 bytes)
@@ -764,6 +897,10 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
         _state = Running;
     }
 
+    if (propagator()->hasPriorityDirectories() && schedulePriorityJob()) {
+        return true;
+    }
+
     // Ask all the running composite jobs if they have something new to schedule.
     for (int i = 0; i < _runningJobs.size(); ++i) {
         ASSERT(_runningJobs.at(i)->_state == Running);
@@ -783,18 +920,27 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     // Now it's our turn, check if we have something left to do.
     if (!_jobsToDo.isEmpty()) {
         PropagatorJob *nextJob = _jobsToDo.first();
+        if (!propagator()->canStartJob(nextJob)) {
+            return false;
+        }
         _jobsToDo.remove(0);
         _runningJobs.append(nextJob);
         return possiblyRunNextJob(nextJob);
     }
     while (!_tasksToDo.isEmpty()) {
-        SyncFileItemPtr nextTask = _tasksToDo.first();
-        _tasksToDo.remove(0);
-        PropagatorJob *job = propagator()->createJob(nextTask);
+        int index = nextTaskIndex();
+        SyncFileItemPtr nextTask = _tasksToDo.at(index);
+        _tasksToDo.remove(index);
+        PropagatorJob *job = propagator()->createJobForTask(nextTask, &_tasksToDo);
         if (!job) {
             qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
             continue;
         }
+        if (!propagator()->canStartJob(job)) {
+            // Keep it first in line until a transfer slot is available
+            _jobsToDo.prepend(job);
+            return false;
+        }
 
         _runningJobs.append(job);
         return possiblyRunNextJob(job);
@@ -810,6 +956,83 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     return false;
 }
 
+bool PropagatorCompositeJob::schedulePriorityJob()
+{
+    for (int i = 0; i < _runningJobs.size(); ++i) {
+        PropagatorJob *job = _runningJobs.at(i);
+        if (propagator()->isPriorityJob(job) && possiblyRunNextJob(job)) {
+            return true;
+        }
+        if (job->parallelism() == WaitForFinished) {
+            return false;
+        }
+    }
+
+    // Jobs that were not started yet may only be skipped if they don't need
+    // to finish before the ones after them.
+    for (int i = 0; i < _jobsToDo.size(); ++i) {
+        PropagatorJob *job = _jobsToDo.at(i);
+        if (propagator()->isPriorityJob(job) && propagator()->canStartJob(job)) {
+            _jobsToDo.remove(i);
+            _runningJobs.append(job);
+            return possiblyRunNextJob(job);
+        }
+        if (job->parallelism() != FullParallelism) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void PropagatorCompositeJob::prioritizeJobs()
+{
+    // Like in schedulePriorityJob(), a job may only be overtaken if it
+    // doesn't need to finish before the ones after it
+    int movable = 0;
+    while (movable < _jobsToDo.size() && _jobsToDo.at(movable)->parallelism() == FullParallelism) {
+        ++movable;
+    }
+    auto end = _jobsToDo.begin() + qMin(movable + 1, _jobsToDo.size());
+    std::stable_partition(_jobsToDo.begin(), end, [this](PropagatorJob *job) {
+        return propagator()->isPriorityJob(job);
+    });
+
+    foreach (PropagatorJob *job, _runningJobs + _jobsToDo) {
+        if (auto dirJob = qobject_cast<PropagateDirectory *>(job)) {
+            dirJob->_subJobs.prioritizeJobs();
+        }
+    }
+}
+
+/* Only file transfers may be reordered: removals, moves and directories
+ * must keep their place. */
+static bool isReorderableTask(const SyncFileItem &item)
+{
+    return !item.isDirectory()
+        && (item._direction == SyncFileItem::Up || item._direction == SyncFileItem::Down)
+        && (item._instruction == CSYNC_INSTRUCTION_NEW
+               || item._instruction == CSYNC_INSTRUCTION_SYNC
+               || item._instruction == CSYNC_INSTRUCTION_CONFLICT);
+}
+
+int PropagatorCompositeJob::nextTaskIndex()
+{
+    // Pick the best of the transfers at the front of the list. Limit the
+    // number of candidates to keep this cheap for directories with many files.
+    const int maxCandidates = 500;
+    int best = 0;
+    for (int i = 0; i < _tasksToDo.size() && i < maxCandidates; ++i) {
+        const SyncFileItem &item = *_tasksToDo.at(i);
+        if (!isReorderableTask(item)) {
+            break;
+        }
+        if (i > 0 && propagator()->propagateBefore(item, *_tasksToDo.at(best))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
 void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
 {
     PropagatorJob *subJob = static_cast<PropagatorJob *>(sender());
@@ -893,6 +1116,9 @@ bool PropagateDirectory::scheduleSelfOrChild()
     }
 
     if (_firstJob && _firstJob->_state == NotYetStarted) {
+        if (!propagator()->canStartJob(_firstJob.data())) {
+            return false;
+        }
         return _firstJob->scheduleSelfOrChild();
     }
 
@@ -24,6 +24,7 @@
 #include <QPointer>
 #include <QIODevice>
 #include <QMutex>
+#include <QSet>
 
 #include "csync_util.h"
 #include "syncfileitem.h"
@@ -227,6 +228,10 @@ public:
     virtual bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
     virtual JobParallelism parallelism() Q_DECL_OVERRIDE;
 
+    /** Moves the pending directory jobs that contain a priority directory
+     * to the front, here and in all the directory jobs below */
+    void prioritizeJobs();
+
     /*
      * Abort synchronously or asynchronously - some jobs
      * require to be finished without immediete abort (abort on job might
@@ -262,6 +267,13 @@ private slots:
 
     void slotSubJobFinished(SyncFileItem::Status status);
     void finalize();
+
+private:
+    /** Give the directories the user looks at the first chance to schedule */
+    bool schedulePriorityJob();
+
+    /** The index of the task in _tasksToDo that should be started next */
+    int nextTaskIndex();
 };
 
 /**
@@ -341,6 +353,7 @@ public:
         SyncFileItem::Status status = _item->_status;
         done(status == SyncFileItem::NoStatus ? SyncFileItem::FileIgnored : status, _item->_errorString);
     }
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return true; }
 };
 
 class OwncloudPropagator : public QObject
@@ -364,6 +377,7 @@ public:
         , _anotherSyncNeeded(false)
         , _chunkSize(10 * 1000 * 1000) // 10 MB, overridden in setSyncOptions
         , _account(account)
+        , _onlyQuickJobs(false)
     {
         qRegisterMetaType<PropagatorJob::AbortType>("PropagatorJob::AbortType");
     }
@@ -420,6 +434,39 @@ public:
     /* The maximum number of active jobs in parallel  */
     int hardMaximumActiveJob();
 
+    /* The maximum number of active jobs in parallel when none of them
+     * transfers a significant amount of data (MKCOL, MOVE, DELETE, small files) */
+    int maximumActiveMetadataJob();
+
+    /** Whether the scheduler may start \a job now.
+     *
+     * Once all the transfer slots are taken, only the jobs that are likely
+     * finished quickly are started so that metadata requests keep flowing.
+     */
+    bool canStartJob(PropagatorJob *job) const;
+
+    /** Items in \a directory are propagated before the others.
+     *
+     * The pending jobs are reordered right away if the propagation is
+     * running. The path is relative to the sync folder, see
+     * SyncEngine::prioritizePath()
+     */
+    void prioritize(const QString &directory);
+    bool hasPriorityDirectories() const { return !_priorityDirectories.isEmpty(); }
+
+    /** Whether \a job is a directory job containing a priority directory */
+    bool isPriorityJob(PropagatorJob *job) const;
+
+    /** Whether the parent directory of \a path is a priority directory */
+    bool isInPriorityDirectory(const QString &path) const;
+
+    /** Whether \a a should be propagated before \a b when their order does not matter.
+     *
+     * Files in priority directories go first, then small files before big ones
+     * and recently modified files before older ones.
+     */
+    bool propagateBefore(const SyncFileItem &a, const SyncFileItem &b);
+
     bool isInSharedDirectory(const QString &file);
 
     /** Check whether a download would clash with an existing file
@@ -441,6 +488,18 @@ public:
     QString getFilePath(const QString &tmp_file_name) const;
 
     PropagateItemJob *createJob(const SyncFileItemPtr &item);
+
+    /** Whether the item may be uploaded together with others in a
+     * PropagateUploadBulk batch instead of its own PUT.
+     */
+    bool isBulkUploadCandidate(const SyncFileItem &item);
+
+    /** Creates the job for the next task of a directory.
+     *
+     * Usually that's createJob(), but small uploads are combined with
+     * other candidates from \a tasks, which are removed from it.
+     */
+    PropagatorJob *createJobForTask(const SyncFileItemPtr &item, SyncFileItemVector *tasks);
     void scheduleNextJob();
     void reportProgress(const SyncFileItem &, quint64 bytes);
 
@@ -522,6 +581,11 @@ private:
     AccountPtr _account;
     QScopedPointer<PropagateDirectory> _rootJob;
     SyncOptions _syncOptions;
+
+    /// Set by scheduleNextJobImpl() while all the transfer slots are taken
+    bool _onlyQuickJobs;
+
+    QSet<QString> _priorityDirectories;
 };
 
 
@@ -143,6 +143,8 @@ void ProgressInfo::reset()
     _sizeProgress = Progress();
     _fileProgress = Progress();
     _totalSizeOfCompletedJobs = 0;
+    _completedSizeOfRunningJobs = 0;
+    _warningCount = 0;
 
     // Historically, these starting estimates were way lower, but that lead
     // to gross overestimation of ETA when a good estimate wasn't available.
@@ -153,6 +155,21 @@ void ProgressInfo::reset()
     _lastCompletedItem = SyncFileItem();
 }
 
+void ProgressInfo::copyProgressFrom(const ProgressInfo &other)
+{
+    _status = other._status;
+    _currentItems = other._currentItems;
+    _lastCompletedItem = other._lastCompletedItem;
+    _currentDiscoveredFolder = other._currentDiscoveredFolder;
+    _sizeProgress = other._sizeProgress;
+    _fileProgress = other._fileProgress;
+    _totalSizeOfCompletedJobs = other._totalSizeOfCompletedJobs;
+    _completedSizeOfRunningJobs = other._completedSizeOfRunningJobs;
+    _warningCount = other._warningCount;
+    _maxFilesPerSecond = other._maxFilesPerSecond;
+    _maxBytesPerSecond = other._maxBytesPerSecond;
+}
+
 ProgressInfo::Status ProgressInfo::status() const
 {
     return _status;
@@ -220,13 +237,27 @@ quint64 ProgressInfo::completedSize() const
     return _sizeProgress._completed;
 }
 
+quint64 ProgressInfo::warningCount() const
+{
+    return _warningCount;
+}
+
 void ProgressInfo::setProgressComplete(const SyncFileItem &item)
 {
+    if (OCC::Progress::isWarningKind(item._status)) {
+        ++_warningCount;
+    }
     if (!shouldCountProgress(item)) {
         return;
     }
 
-    _currentItems.remove(item._file);
+    auto it = _currentItems.find(item._file);
+    if (it != _currentItems.end()) {
+        if (isSizeDependent(it->_item)) {
+            _completedSizeOfRunningJobs -= it->_progress._completed;
+        }
+        _currentItems.erase(it);
+    }
     _fileProgress.setCompleted(_fileProgress._completed + item._affectedItems);
     if (ProgressInfo::isSizeDependent(item)) {
         _totalSizeOfCompletedJobs += item._size;
@@ -241,13 +272,21 @@ void ProgressInfo::setProgressItem(const SyncFileItem &item, quint64 completed)
         return;
     }
 
-    _currentItems[item._file]._item = item;
-    _currentItems[item._file]._progress._total = item._size;
-    _currentItems[item._file]._progress.setCompleted(completed);
-    recomputeCompletedSize();
+    // Only the first progress of an item copies it
+    auto it = _currentItems.find(item._file);
+    if (it == _currentItems.end()) {
+        it = _currentItems.insert(item._file, ProgressItem());
+        it->_item = item;
+    }
+    it->_item._size = item._size;
+    it->_progress._total = item._size;
 
-    // This seems dubious!
-    _lastCompletedItem = SyncFileItem();
+    const quint64 previouslyCompleted = it->_progress._completed;
+    it->_progress.setCompleted(completed);
+    if (isSizeDependent(it->_item)) {
+        _completedSizeOfRunningJobs += it->_progress._completed - previouslyCompleted;
+    }
+    recomputeCompletedSize();
 }
 
 ProgressInfo::Estimates ProgressInfo::totalProgress() const
@@ -327,7 +366,11 @@ bool ProgressInfo::trustEta() const
 
 ProgressInfo::Estimates ProgressInfo::fileProgress(const SyncFileItem &item) const
 {
-    return _currentItems[item._file]._progress.estimates();
+    auto it = _currentItems.constFind(item._file);
+    if (it == _currentItems.constEnd()) {
+        return Estimates{ 0, 0 };
+    }
+    return it->_progress.estimates();
 }
 
 void ProgressInfo::updateEstimates()
@@ -350,12 +393,7 @@ void ProgressInfo::updateEstimates()
 
 void ProgressInfo::recomputeCompletedSize()
 {
-    quint64 r = _totalSizeOfCompletedJobs;
-    foreach (const ProgressItem &i, _currentItems) {
-        if (isSizeDependent(i._item))
-            r += i._progress._completed;
-    }
-    _sizeProgress.setCompleted(r);
+    _sizeProgress.setCompleted(_totalSizeOfCompletedJobs + _completedSizeOfRunningJobs);
 }
 
 ProgressInfo::Estimates ProgressInfo::Progress::estimates() const
@@ -41,6 +41,12 @@ public:
      */
     void reset();
 
+    /** Copies the progress state of \a other, e.g. to keep a snapshot of it.
+     *
+     * The copy does not update its estimates on its own.
+     */
+    void copyProgressFrom(const ProgressInfo &other);
+
     /** Records the status of the sync run
      */
     enum Status {
@@ -97,6 +103,9 @@ public:
     quint64 totalSize() const;
     quint64 completedSize() const;
 
+    /** Number of completed items with a warning kind of status, see Progress::isWarningKind() */
+    quint64 warningCount() const;
+
     /** Number of a file that is currently in progress. */
     quint64 currentFile() const;
 
@@ -178,6 +187,7 @@ public:
     };
     QHash<QString, ProgressItem> _currentItems;
 
+    /// The item completed last, the views get every completed item through ProgressDispatcher::itemsCompleted
     SyncFileItem _lastCompletedItem;
 
     // Used during local and remote update phase
@@ -221,8 +231,8 @@ private slots:
     void updateEstimates();
 
 private:
-    // Sets the completed size by summing finished jobs with the progress
-    // of active ones.
+    // Sets the completed size from the size of finished jobs and the
+    // progress of active ones.
     void recomputeCompletedSize();
 
     // Triggers the update() slot every second once propagation started.
@@ -234,6 +244,12 @@ private:
     // All size from completed jobs only.
     quint64 _totalSizeOfCompletedJobs;
 
+    // Sum of the progress of the size dependent _currentItems, kept up to
+    // date so a progress update does not need to look at all of them.
+    quint64 _completedSizeOfRunningJobs;
+
+    quint64 _warningCount;
+
     // The fastest observed rate of files per second in this sync.
     double _maxFilesPerSecond;
     double _maxBytesPerSecond;
@@ -286,9 +302,12 @@ signals:
      */
     void progressInfo(const QString &folder, const ProgressInfo &progress);
     /**
-     * @brief: the item was completed by a job
+     * @brief: the items were completed by jobs
+     *
+     * The items completed during a short time window are delivered together,
+     * in the order they completed, so that the views insert them in bulk.
      */
-    void itemCompleted(const QString &folder, const SyncFileItemPtr &item);
+    void itemsCompleted(const QString &folder, const SyncFileItemVector &items);
 
     /**
      * @brief A new folder-wide sync error was seen.
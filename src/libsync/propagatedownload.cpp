@@ -24,11 +24,13 @@
 #include "propagatorjobs.h"
 #include "common/checksums.h"
 #include "common/asserts.h"
+#include "transfercompression.h"
 
 #include <QLoggingCategory>
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <qtconcurrentrun.h>
 #include <cmath>
 
 #ifdef Q_OS_UNIX
@@ -65,6 +67,40 @@ QString OWNCLOUDSYNC_EXPORT createDownloadTmpFileName(const QString &previous)
     }
 }
 
+// Size of the reads from the network reply
+static const qint64 downloadBufferSize = 256 * 1024;
+
+// Below this size the signatures request costs about as much as the file
+static const quint64 minimumDeltaDownloadSize = 1024 * 1024;
+
+// A badly fragmented delta is downloaded as a whole instead
+static const int maximumDeltaDownloadRanges = 100;
+
+/* A delta download writes the blocks at their final offsets, so unlike the
+ * temporary file of a normal download its file is not a prefix of the remote
+ * file that could be resumed. It is told apart by a 'p' after the ".~". */
+static QString createDeltaDownloadTmpFileName(const QString &file)
+{
+    QString tmpFileName = createDownloadTmpFileName(file);
+    tmpFileName.insert(tmpFileName.lastIndexOf(QLatin1String(".~")) + 2, QLatin1Char('p'));
+    return tmpFileName;
+}
+
+static bool isDeltaDownloadTmpFileName(const QString &tmpFileName)
+{
+    return tmpFileName.midRef(tmpFileName.lastIndexOf(QLatin1String(".~")) + 2).startsWith(QLatin1Char('p'));
+}
+
+// The checksum header of a GET reply, empty if there is none
+static QByteArray transmissionChecksumHeader(QNetworkReply *reply)
+{
+    auto checksumHeader = findBestChecksum(reply->rawHeader(checkSumHeaderC));
+    auto contentMd5Header = reply->rawHeader(contentMd5HeaderC);
+    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
+        checksumHeader = "MD5:" + contentMd5Header;
+    return checksumHeader;
+}
+
 // DOES NOT take ownership of the device.
 GETFileJob::GETFileJob(AccountPtr account, const QString &path, QFile *device,
     const QMap<QByteArray, QByteArray> &headers, const QByteArray &expectedEtagForResume,
@@ -81,6 +117,7 @@ GETFileJob::GETFileJob(AccountPtr account, const QString &path, QFile *device,
     , _bandwidthManager(0)
     , _hasEmittedFinishedSignal(false)
     , _lastModified()
+    , _computeChecksums(false)
 {
 }
 
@@ -101,18 +138,28 @@ GETFileJob::GETFileJob(AccountPtr account, const QUrl &url, QFile *device,
     , _bandwidthManager(0)
     , _hasEmittedFinishedSignal(false)
     , _lastModified()
+    , _computeChecksums(false)
 {
 }
 
 
 void GETFileJob::start()
 {
-    if (_resumeStart > 0) {
+    if (_rangeEnd >= 0) {
+        _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-' + QByteArray::number(_rangeEnd);
+    } else if (_resumeStart > 0) {
         _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-';
         _headers["Accept-Ranges"] = "bytes";
         qCDebug(lcGetJob) << "Retry with range " << _headers["Range"];
     }
 
+    // QNetworkAccessManager asks for gzip and decompresses the body while
+    // it streams in. Ranges would refer to the compressed representation,
+    // and compressing archives or media only costs the server time.
+    if (_resumeStart > 0 || _rangeEnd >= 0 || TransferCompression::hasCompressedFormat(path())) {
+        _headers["Accept-Encoding"] = "identity";
+    }
+
     QNetworkRequest req;
     for (QMap<QByteArray, QByteArray>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
         req.setRawHeader(it.key(), it.value());
@@ -154,7 +201,9 @@ void GETFileJob::slotMetaDataChanged()
 {
     // For some reason setting the read buffer in GETFileJob::start doesn't seem to go
     // through the HTTP layer thread(?)
-    reply()->setReadBufferSize(16 * 1024);
+    // A large buffer means fewer wakeups per downloaded megabyte. Keep it small
+    // when the bandwidth is limited so that the limit stays accurate.
+    reply()->setReadBufferSize(_bandwidthLimited ? 16 * 1024 : downloadBufferSize);
 
     int httpStatus = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
@@ -201,6 +250,14 @@ void GETFileJob::slotMetaDataChanged()
             start = rx.cap(1).toULongLong();
         }
     }
+    if (_rangeEnd >= 0 && ranges.isEmpty()) {
+        // The whole file would be written over the range
+        qCWarning(lcGetJob) << "Server ignored the range" << _headers["Range"];
+        _errorString = tr("Server did not return the requested range");
+        _errorStatus = SyncFileItem::SoftError;
+        reply()->abort();
+        return;
+    }
     if (start != _resumeStart) {
         qCWarning(lcGetJob) << "Wrong content-range: " << ranges << " while expecting start was" << _resumeStart;
         if (ranges.isEmpty()) {
@@ -226,9 +283,41 @@ void GETFileJob::slotMetaDataChanged()
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
 
+    _transmissionChecksum.reset();
+    _contentChecksum.reset();
+    if (_computeChecksums && _resumeStart == 0 && _rangeEnd < 0) {
+        // The checksums can only be computed if we see the whole file
+        const QByteArray type = parseChecksumHeaderType(transmissionChecksumHeader(reply()));
+        if (!type.isEmpty()) {
+            _transmissionChecksum.reset(new StreamingChecksum(type));
+            if (!_transmissionChecksum->isValid())
+                _transmissionChecksum.reset();
+        }
+        if (!_contentChecksumType.isEmpty() && _contentChecksumType != type) {
+            _contentChecksum.reset(new StreamingChecksum(_contentChecksumType));
+            if (!_contentChecksum->isValid())
+                _contentChecksum.reset();
+        }
+    }
+
     _saveBodyToFile = true;
 }
 
+void GETFileJob::enableInlineChecksums(const QByteArray &contentChecksumType)
+{
+    _computeChecksums = true;
+    _contentChecksumType = contentChecksumType;
+}
+
+QByteArray GETFileJob::computedChecksum(const QByteArray &checksumType) const
+{
+    if (_transmissionChecksum && _transmissionChecksum->checksumType() == checksumType)
+        return _transmissionChecksum->result();
+    if (_contentChecksum && _contentChecksum->checksumType() == checksumType)
+        return _contentChecksum->result();
+    return QByteArray();
+}
+
 void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
 {
     _bandwidthManager = bwm;
@@ -249,8 +338,9 @@ void GETFileJob::setBandwidthLimited(bool b)
 void GETFileJob::giveBandwidthQuota(qint64 q)
 {
     _bandwidthQuota = q;
-    qCDebug(lcGetJob) << "Got" << q << "bytes";
-    QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
+    if (q > 0) {
+        QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
+    }
 }
 
 qint64 GETFileJob::currentDownloadPosition()
@@ -265,8 +355,9 @@ void GETFileJob::slotReadyRead()
 {
     if (!reply())
         return;
-    int bufferSize = qMin(1024 * 8ll, reply()->bytesAvailable());
-    QByteArray buffer(bufferSize, Qt::Uninitialized);
+    const qint64 bufferSize = qMin(downloadBufferSize, reply()->bytesAvailable());
+    if (_buffer.size() < bufferSize)
+        _buffer.resize(bufferSize);
 
     while (reply()->bytesAvailable() > 0) {
         if (_bandwidthChoked) {
@@ -275,15 +366,15 @@ void GETFileJob::slotReadyRead()
         }
         qint64 toRead = bufferSize;
         if (_bandwidthLimited) {
-            toRead = qMin(qint64(bufferSize), _bandwidthQuota);
+            toRead = qMin(bufferSize, _bandwidthQuota);
             if (toRead == 0) {
-                qCWarning(lcGetJob) << "Out of quota";
+                qCDebug(lcGetJob) << "Out of quota";
                 break;
             }
             _bandwidthQuota -= toRead;
         }
 
-        qint64 r = reply()->read(buffer.data(), toRead);
+        qint64 r = reply()->read(_buffer.data(), toRead);
         if (r < 0) {
             _errorString = networkReplyErrorString(*reply());
             _errorStatus = SyncFileItem::NormalError;
@@ -293,7 +384,7 @@ void GETFileJob::slotReadyRead()
         }
 
         if (_device->isOpen() && _saveBodyToFile) {
-            qint64 w = _device->write(buffer.constData(), r);
+            qint64 w = _device->write(_buffer.constData(), r);
             if (w != r) {
                 _errorString = _device->errorString();
                 _errorStatus = SyncFileItem::NormalError;
@@ -301,6 +392,10 @@ void GETFileJob::slotReadyRead()
                 reply()->abort();
                 return;
             }
+            if (_transmissionChecksum)
+                _transmissionChecksum->addData(_buffer.constData(), r);
+            if (_contentChecksum)
+                _contentChecksum->addData(_buffer.constData(), r);
         }
     }
 
@@ -340,6 +435,34 @@ QString GETFileJob::errorString() const
     return AbstractNetworkJob::errorString();
 }
 
+GETBlockSignaturesJob::GETBlockSignaturesJob(AccountPtr account, const QString &path, QObject *parent)
+    : AbstractNetworkJob(account, path, parent)
+{
+}
+
+void GETBlockSignaturesJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("OC-Block-Signatures", "1");
+    req.setPriority(QNetworkRequest::LowPriority);
+    sendRequest("GET", makeDavUrl(path()), req);
+    AbstractNetworkJob::start();
+}
+
+bool GETBlockSignaturesJob::finished()
+{
+    const int httpStatus = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const qint64 blockSize = reply()->rawHeader("OC-Block-Size").toLongLong();
+    const QByteArray etag = getEtagFromReply(reply());
+    if (reply()->error() != QNetworkReply::NoError || httpStatus != 200 || blockSize <= 0 || etag.isEmpty()) {
+        qCInfo(lcGetJob) << "No block signatures for" << path() << reply()->error() << httpStatus;
+        emit finishedWithResult(QByteArray(), 0, QByteArray());
+        return true;
+    }
+    emit finishedWithResult(etag, blockSize, reply()->readAll());
+    return true;
+}
+
 void PropagateDownloadFile::start()
 {
     if (propagator()->_abortRequested.fetchAndAddRelaxed(0))
@@ -412,12 +535,27 @@ void PropagateDownloadFile::startDownload()
 
     propagator()->reportProgress(*_item, 0);
 
+    if (!_localCopyTried) {
+        _localCopyTried = true;
+        const QString source = findLocalCopy();
+        if (!source.isEmpty()) {
+            startLocalCopy(source);
+            return;
+        }
+    }
+
+    if (!_deltaTried && deltaDownloadPossible()) {
+        startDeltaDownload();
+        return;
+    }
+
     QString tmpFileName;
     QByteArray expectedEtagForResume;
     const SyncJournalDb::DownloadInfo progressInfo = propagator()->_journal->getDownloadInfo(_item->_file);
     if (progressInfo._valid) {
         // if the etag has changed meanwhile, remove the already downloaded part.
-        if (progressInfo._etag != _item->_etag) {
+        // The blocks of an interrupted delta download can't be resumed either.
+        if (progressInfo._etag != _item->_etag || isDeltaDownloadTmpFileName(progressInfo._tmpfile)) {
             FileSystem::remove(propagator()->getFilePath(progressInfo._tmpfile));
             propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         } else {
@@ -471,6 +609,9 @@ void PropagateDownloadFile::startDownload()
         return;
     }
 
+    // Reserve the space up front, the file won't be fragmented as it grows
+    FileSystem::preallocate(_tmpFile, _item->_size);
+
     {
         SyncJournalDb::DownloadInfo pi;
         pi._etag = _item->_etag;
@@ -501,12 +642,281 @@ void PropagateDownloadFile::startDownload()
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    _job->enableInlineChecksums(contentChecksumType());
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
     propagator()->_activeJobList.append(this);
     _job->start();
 }
 
+QString PropagateDownloadFile::findLocalCopy()
+{
+    // Only trust checksums that identify the content
+    if (_item->_size == 0 || _item->_checksumHeader.isEmpty()
+        || !csync_is_collision_safe_hash(_item->_checksumHeader)) {
+        return QString();
+    }
+
+    // Leave reporting the lack of space to the normal download
+    if (propagator()->diskSpaceCheck() != OwncloudPropagator::DiskSpaceOk)
+        return QString();
+
+    QString result;
+    const QByteArray path = _item->_file.toUtf8();
+    propagator()->_journal->getFileRecordsByChecksum(_item->_checksumHeader, [&](const SyncJournalFileRecord &record) {
+        if (!result.isEmpty() || record._path == path || record._fileSize != qint64(_item->_size))
+            return;
+        // The checksum describes the file as it was synced
+        const QString fileName = propagator()->getFilePath(QString::fromUtf8(record._path));
+        if (QFileInfo(fileName).isFile()
+            && FileSystem::getSize(fileName) == record._fileSize
+            && FileSystem::getModTime(fileName) == record._modtime) {
+            result = fileName;
+        }
+    });
+    return result;
+}
+
+void PropagateDownloadFile::startLocalCopy(const QString &source)
+{
+    qCInfo(lcPropagateDownload) << "Copying" << source << "instead of downloading" << _item->_file;
+
+    _tmpFile.setFileName(propagator()->getFilePath(createDownloadTmpFileName(_item->_file)));
+    const QString destination = _tmpFile.fileName();
+    connect(&_localCopyWatcher, &QFutureWatcherBase::finished,
+        this, &PropagateDownloadFile::slotLocalCopyFinished);
+    _localCopyWatcher.setFuture(QtConcurrent::run([source, destination]() {
+        QString error;
+        if (!FileSystem::cloneFile(source, destination, &error))
+            return error.isEmpty() ? QStringLiteral("unknown error") : error;
+        return QString();
+    }));
+}
+
+void PropagateDownloadFile::slotLocalCopyFinished()
+{
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        finishAbortedWorker();
+        return;
+    }
+
+    const QString error = _localCopyWatcher.future().result();
+    if (!error.isEmpty()) {
+        slotLocalCopyChecksumFail(error);
+        return;
+    }
+    FileSystem::setFileHidden(_tmpFile.fileName(), true);
+
+    // The local file may have changed since it was synced
+    ValidateChecksumHeader *validator = new ValidateChecksumHeader(this);
+    connect(validator, &ValidateChecksumHeader::validated,
+        this, &PropagateDownloadFile::transmissionChecksumValidated);
+    connect(validator, &ValidateChecksumHeader::validationFailed,
+        this, &PropagateDownloadFile::slotLocalCopyChecksumFail);
+    validator->start(_tmpFile.fileName(), _item->_checksumHeader);
+}
+
+void PropagateDownloadFile::slotLocalCopyChecksumFail(const QString &errMsg)
+{
+    qCInfo(lcPropagateDownload) << "Could not use a local copy of" << _item->_file << errMsg;
+    FileSystem::remove(_tmpFile.fileName());
+    startDownload();
+}
+
+bool PropagateDownloadFile::deltaDownloadPossible()
+{
+    if (!propagator()->account()->capabilities().blockSignatures()
+        || !_item->_directDownloadUrl.isEmpty()
+        || _item->_size < minimumDeltaDownloadSize) {
+        return false;
+    }
+
+    // An interrupted download is resumed instead
+    const SyncJournalDb::DownloadInfo progressInfo = propagator()->_journal->getDownloadInfo(_item->_file);
+    if (progressInfo._valid && !isDeltaDownloadTmpFileName(progressInfo._tmpfile))
+        return false;
+
+    // Leave reporting the lack of space to the normal download
+    if (propagator()->diskSpaceCheck() != OwncloudPropagator::DiskSpaceOk)
+        return false;
+
+    const QFileInfo localFile(propagator()->getFilePath(_item->_file));
+    return localFile.isFile() && localFile.size() > 0;
+}
+
+void PropagateDownloadFile::startDeltaDownload()
+{
+    _deltaTried = true;
+    _blockSignaturesJob = new GETBlockSignaturesJob(propagator()->account(), propagator()->_remoteFolder + _item->_file, this);
+    connect(_blockSignaturesJob.data(), &GETBlockSignaturesJob::finishedWithResult,
+        this, &PropagateDownloadFile::slotBlockSignaturesFinished);
+    propagator()->_activeJobList.append(this);
+    _blockSignaturesJob->start();
+}
+
+void PropagateDownloadFile::slotBlockSignaturesFinished(const QByteArray &etag, qint64 blockSize, const QByteArray &signatures)
+{
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        done(SyncFileItem::SoftError, tr("Aborted by the user"));
+        return;
+    }
+
+    if (blockSize <= 0) {
+        startDownload();
+        return;
+    }
+    // The size of the file is only known for the discovered version
+    if (etag != _item->_etag) {
+        qCInfo(lcPropagateDownload) << "Block signatures of" << _item->_file << "are for another version" << etag << _item->_etag;
+        startDownload();
+        return;
+    }
+
+    // Left behind by an interrupted delta download
+    const SyncJournalDb::DownloadInfo progressInfo = propagator()->_journal->getDownloadInfo(_item->_file);
+    if (progressInfo._valid) {
+        FileSystem::remove(propagator()->getFilePath(progressInfo._tmpfile));
+    }
+
+    // Recorded like for a normal download, so that the temporary file is
+    // cleaned up if the client quits before the delta download is done
+    const QString tmpFileName = createDeltaDownloadTmpFileName(_item->_file);
+    _tmpFile.setFileName(propagator()->getFilePath(tmpFileName));
+    {
+        SyncJournalDb::DownloadInfo pi;
+        pi._etag = _item->_etag;
+        pi._tmpfile = tmpFileName;
+        pi._valid = true;
+        propagator()->_journal->setDownloadInfo(_item->_file, pi);
+        propagator()->_journal->commit("delta download start");
+    }
+
+    connect(&_patchWatcher, &QFutureWatcherBase::finished,
+        this, &PropagateDownloadFile::slotPatchFinished);
+    _patchWatcher.setFuture(QtConcurrent::run(&DeltaSync::patchFile,
+        propagator()->getFilePath(_item->_file), _tmpFile.fileName(), qint64(_item->_size), blockSize, signatures));
+}
+
+void PropagateDownloadFile::slotPatchFinished()
+{
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        finishAbortedWorker();
+        return;
+    }
+
+    const DeltaSync::Patch patch = _patchWatcher.future().result();
+    if (!patch._valid) {
+        abandonDeltaDownload(QStringLiteral("because the local file could not be used"));
+        return;
+    }
+    if (patch._reusedBytes == 0 || patch._missing.size() > maximumDeltaDownloadRanges) {
+        abandonDeltaDownload(QString("because %1 of %2 bytes are in %3 ranges")
+                                 .arg(_item->_size - patch._reusedBytes)
+                                 .arg(_item->_size)
+                                 .arg(patch._missing.size()));
+        return;
+    }
+
+    qCInfo(lcPropagateDownload) << "Delta download of" << _item->_file << "reuses" << patch._reusedBytes
+                                << "of" << _item->_size << "bytes, downloading" << patch._missing.size() << "ranges";
+
+    FileSystem::setFileHidden(_tmpFile.fileName(), true);
+    if (!_tmpFile.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        abandonDeltaDownload(_tmpFile.errorString());
+        return;
+    }
+    _missingRanges = patch._missing;
+    _resumeStart = patch._reusedBytes;
+    propagator()->reportProgress(*_item, _resumeStart);
+    startNextRange();
+}
+
+void PropagateDownloadFile::startNextRange()
+{
+    if (_missingRanges.isEmpty()) {
+        _tmpFile.close();
+
+        // Without a checksum header this is all that can be checked
+        if (_tmpFile.size() != qint64(_item->_size)) {
+            abandonDeltaDownload(QString("because the assembled file has %1 instead of %2 bytes")
+                                     .arg(_tmpFile.size())
+                                     .arg(_item->_size));
+            return;
+        }
+
+        // The ranges could only be checked against the etag. The checksum
+        // covers the blocks copied from the local file as well.
+        ValidateChecksumHeader *validator = new ValidateChecksumHeader(this);
+        connect(validator, &ValidateChecksumHeader::validated,
+            this, &PropagateDownloadFile::transmissionChecksumValidated);
+        connect(validator, &ValidateChecksumHeader::validationFailed,
+            this, &PropagateDownloadFile::slotChecksumFail);
+        validator->start(_tmpFile.fileName(), _item->_checksumHeader);
+        return;
+    }
+
+    const DeltaSync::Segment &range = _missingRanges.first();
+    if (!_tmpFile.seek(range._offset)) {
+        abandonDeltaDownload(_tmpFile.errorString());
+        return;
+    }
+
+    _downloadProgress = 0;
+    _job = new GETFileJob(propagator()->account(),
+        propagator()->_remoteFolder + _item->_file,
+        &_tmpFile, QMap<QByteArray, QByteArray>(), _item->_etag, range._offset, this);
+    _job->setRangeEnd(range._offset + range._size - 1);
+    _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotRangeFinished);
+    connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
+    propagator()->_activeJobList.append(this);
+    _job->start();
+}
+
+void PropagateDownloadFile::slotRangeFinished()
+{
+    propagator()->_activeJobList.removeOne(this);
+
+    GETFileJob *job = qobject_cast<GETFileJob *>(sender());
+    ASSERT(job);
+
+    const DeltaSync::Segment range = _missingRanges.first();
+    const QNetworkReply::NetworkError err = job->reply()->error();
+    if (err != QNetworkReply::NoError || _tmpFile.pos() != range._offset + range._size) {
+        if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+            _tmpFile.close();
+            FileSystem::remove(_tmpFile.fileName());
+            done(SyncFileItem::SoftError, job->errorString());
+            return;
+        }
+        abandonDeltaDownload(job->errorString());
+        return;
+    }
+
+    if (job->lastModified()) {
+        _item->_modtime = job->lastModified();
+    }
+    _item->_responseTimeStamp = job->responseTimestamp();
+
+    _missingRanges.removeFirst();
+    _resumeStart += range._size;
+    _downloadProgress = 0;
+    startNextRange();
+}
+
+void PropagateDownloadFile::abandonDeltaDownload(const QString &reason)
+{
+    qCInfo(lcPropagateDownload) << "Downloading all of" << _item->_file << reason;
+    _tmpFile.close();
+    FileSystem::remove(_tmpFile.fileName());
+    propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
+    _missingRanges.clear();
+    _resumeStart = 0;
+    _downloadProgress = 0;
+    startDownload();
+}
+
 qint64 PropagateDownloadFile::committedDiskSpace() const
 {
     if (_state == Running) {
@@ -624,6 +1034,12 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
+    // With a content encoding the Content-Length is the compressed size
+    const QByteArray contentEncoding = job->reply()->rawHeader("Content-Encoding");
+    if (!contentEncoding.isEmpty() && contentEncoding != "identity") {
+        bodySize = 0;
+    }
+
     if (bodySize > 0 && bodySize != _tmpFile.size() - job->resumeStart()) {
         qCDebug(lcPropagateDownload) << bodySize << _tmpFile.size() << job->resumeStart();
         propagator()->_anotherSyncNeeded = true;
@@ -647,11 +1063,15 @@ void PropagateDownloadFile::slotGetFinished()
         this, &PropagateDownloadFile::transmissionChecksumValidated);
     connect(validator, &ValidateChecksumHeader::validationFailed,
         this, &PropagateDownloadFile::slotChecksumFail);
-    auto checksumHeader = findBestChecksum(job->reply()->rawHeader(checkSumHeaderC));
-    auto contentMd5Header = job->reply()->rawHeader(contentMd5HeaderC);
-    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
-        checksumHeader = "MD5:" + contentMd5Header;
-    validator->start(_tmpFile.fileName(), checksumHeader);
+    auto checksumHeader = transmissionChecksumHeader(job->reply());
+    _computedContentChecksum = job->computedChecksum(contentChecksumType());
+    const QByteArray checksumType = parseChecksumHeaderType(checksumHeader);
+    const QByteArray computedChecksum = job->computedChecksum(checksumType);
+    if (!checksumType.isEmpty() && !computedChecksum.isEmpty()) {
+        validator->startWithComputedChecksum(checksumHeader, checksumType, computedChecksum);
+    } else {
+        validator->start(_tmpFile.fileName(), checksumHeader);
+    }
 }
 
 void PropagateDownloadFile::slotChecksumFail(const QString &errMsg)
@@ -772,6 +1192,10 @@ void PropagateDownloadFile::transmissionChecksumValidated(const QByteArray &chec
         return contentChecksumComputed(checksumType, checksum);
     }
 
+    if (!_computedContentChecksum.isEmpty()) {
+        return contentChecksumComputed(theContentChecksumType, _computedContentChecksum);
+    }
+
     // Compute the content checksum.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(theContentChecksumType);
@@ -927,9 +1351,35 @@ void PropagateDownloadFile::abort(PropagatorJob::AbortType abortType)
 {
     if (_job && _job->reply())
         _job->reply()->abort();
+    if (_blockSignaturesJob && _blockSignaturesJob->reply())
+        _blockSignaturesJob->reply()->abort();
+
+    // A worker thread can't be interrupted and writes to the temporary file
+    if (_localCopyWatcher.isRunning() || _patchWatcher.isRunning()) {
+        if (abortType == AbortType::Asynchronous) {
+            // Emitted by finishAbortedWorker()
+            _abortFinishedPending = true;
+            return;
+        }
+        _localCopyWatcher.waitForFinished();
+        _patchWatcher.waitForFinished();
+        FileSystem::remove(_tmpFile.fileName());
+    }
 
     if (abortType == AbortType::Asynchronous) {
         emit abortFinished();
     }
 }
+
+void PropagateDownloadFile::finishAbortedWorker()
+{
+    FileSystem::remove(_tmpFile.fileName());
+    if (_state != Finished) {
+        done(SyncFileItem::SoftError, tr("Aborted by the user"));
+    }
+    if (_abortFinishedPending) {
+        _abortFinishedPending = false;
+        emit abortFinished();
+    }
+}
 }
@@ -15,9 +15,12 @@
 
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
+#include "common/checksums.h"
+#include "deltasync.h"
 
 #include <QBuffer>
 #include <QFile>
+#include <QFutureWatcher>
 
 namespace OCC {
 
@@ -46,6 +49,17 @@ class GETFileJob : public AbstractNetworkJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    /// Last byte to download, -1 to download up to the end of the file
+    qint64 _rangeEnd = -1;
+
+    /// Reused for every read from the reply
+    QByteArray _buffer;
+
+    bool _computeChecksums;
+    QByteArray _contentChecksumType;
+    QScopedPointer<StreamingChecksum> _transmissionChecksum;
+    QScopedPointer<StreamingChecksum> _contentChecksum;
+
 public:
     // DOES NOT take ownership of the device.
     explicit GETFileJob(AccountPtr account, const QString &path, QFile *device,
@@ -84,7 +98,10 @@ public:
     void setBandwidthManager(BandwidthManager *bwm);
     void setChoked(bool c);
     void setBandwidthLimited(bool b);
+    bool isBandwidthLimited() const { return _bandwidthLimited; }
     void giveBandwidthQuota(qint64 q);
+    /// The part of the last quota that was not used yet
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
     qint64 currentDownloadPosition();
 
     QString errorString() const;
@@ -99,6 +116,29 @@ public:
     quint64 resumeStart() { return _resumeStart; }
     time_t lastModified() { return _lastModified; }
 
+    /**
+     * Compute checksums of the body while it is written to the device.
+     *
+     * The transmission checksum announced by the server is computed, as well
+     * as \a contentChecksumType if it is not empty. This saves reading the
+     * file again once it is downloaded.
+     */
+    void enableInlineChecksums(const QByteArray &contentChecksumType);
+
+    /**
+     * The checksum of type \a checksumType of the received body.
+     *
+     * Empty if it was not computed, for example when a download is resumed.
+     */
+    QByteArray computedChecksum(const QByteArray &checksumType) const;
+
+    /**
+     * Only download the bytes from resumeStart() up to and including \a end.
+     *
+     * The body is written at the current position of the device. Unlike
+     * for a resumed download the job fails if the server ignores the range.
+     */
+    void setRangeEnd(qint64 end) { _rangeEnd = end; }
 
 signals:
     void finishedSignal();
@@ -108,6 +148,28 @@ private slots:
     void slotMetaDataChanged();
 };
 
+/**
+ * @brief Fetches the block signatures of a remote file
+ *
+ * The server answers a GET with an "OC-Block-Signatures" header with the
+ * signatures of the file, see DeltaSync::serializeSignatures(), and their
+ * block size in the "OC-Block-Size" header.
+ *
+ * @ingroup libsync
+ */
+class GETBlockSignaturesJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    explicit GETBlockSignaturesJob(AccountPtr account, const QString &path, QObject *parent = 0);
+    void start() Q_DECL_OVERRIDE;
+    bool finished() Q_DECL_OVERRIDE;
+
+signals:
+    /// The block size is 0 if there are no signatures
+    void finishedWithResult(const QByteArray &etag, qint64 blockSize, const QByteArray &signatures);
+};
+
 /**
  * @brief The PropagateDownloadFile class
  * @ingroup libsync
@@ -127,14 +189,25 @@ private slots:
     +-> startDownload() <--------------------------+
           |                                        |
           +-> run a GETFileJob                     | checksum identical?
-                                                   |
+          |                                        |
+          |   (A synced local file with the same   |
+          |    checksum is copied instead, see     |
+          |    startLocalCopy().                   |
+          |    With block signatures, a local      |
+          |    file is patched and only the        |
+          |    missing ranges are downloaded,      |
+          |    see startDeltaDownload())           |
+          |                                        |
       done?-> slotGetFinished()                    |
                 |                                  |
                 +-> validate checksum header       |
+                    (computed while downloading    |
+                     unless the download resumed)  |
                                                    |
       done?-> transmissionChecksumValidated()      |
                 |                                  |
                 +-> compute the content checksum   |
+                    (if not computed already)      |
                                                    |
       done?-> contentChecksumComputed()            |
                 |                                  |
@@ -155,6 +228,9 @@ public:
         , _resumeStart(0)
         , _downloadProgress(0)
         , _deleteExisting(false)
+        , _localCopyTried(false)
+        , _deltaTried(false)
+        , _abortFinishedPending(false)
     {
     }
     void start() Q_DECL_OVERRIDE;
@@ -182,6 +258,16 @@ private slots:
     void startDownload();
     /// Called when the GETFileJob finishes
     void slotGetFinished();
+    /// Called when a local file with the same content was copied
+    void slotLocalCopyFinished();
+    /// Called when that copy turned out not to have the expected content
+    void slotLocalCopyChecksumFail(const QString &errMsg);
+    /// Called when the block signatures of the remote file arrive
+    void slotBlockSignaturesFinished(const QByteArray &etag, qint64 blockSize, const QByteArray &signatures);
+    /// Called when the local blocks were copied to the temporary file
+    void slotPatchFinished();
+    /// Called when the GETFileJob for a missing range finishes
+    void slotRangeFinished();
     /// Called when the download's checksum header was validated
     void transmissionChecksumValidated(const QByteArray &checksumType, const QByteArray &checksum);
     /// Called when the download's checksum computation is done
@@ -197,12 +283,41 @@ private slots:
 private:
     void deleteExistingFolder();
 
+    /// A synced local file with the content of the remote one, if any
+    QString findLocalCopy();
+    void startLocalCopy(const QString &source);
+
+    /// Whether the local file may provide blocks of the remote one
+    bool deltaDownloadPossible();
+    void startDeltaDownload();
+    void startNextRange();
+    /// Removes the patched file and downloads the whole file instead
+    void abandonDeltaDownload(const QString &reason);
+    /// Finishes the job once a worker thread is done after an abort
+    void finishAbortedWorker();
+
     quint64 _resumeStart;
     qint64 _downloadProgress;
     QPointer<GETFileJob> _job;
     QFile _tmpFile;
     bool _deleteExisting;
 
+    /// Content checksum computed by the GETFileJob, if any
+    QByteArray _computedContentChecksum;
+
+    bool _localCopyTried;
+    /// Error of the copy of a local file, empty on success
+    QFutureWatcher<QString> _localCopyWatcher;
+
+    bool _deltaTried;
+    QPointer<GETBlockSignaturesJob> _blockSignaturesJob;
+    QFutureWatcher<DeltaSync::Patch> _patchWatcher;
+    /// Ranges of a delta download that still need to be downloaded
+    QVector<DeltaSync::Segment> _missingRanges;
+
+    /// An asynchronous abort waits for a worker thread, see finishAbortedWorker()
+    bool _abortFinishedPending;
+
     QElapsedTimer _stopwatch;
 };
 }
@@ -166,13 +166,11 @@ void PropagateRemoteMove::slotMoveJobFinished()
 
 void PropagateRemoteMove::finalize()
 {
-    SyncJournalFileRecord oldRecord;
-    propagator()->_journal->getFileRecord(_item->_originalFile, &oldRecord);
     // if reading from db failed still continue hoping that deleteFileRecord
     // reopens the db successfully.
     // The db is only queried to transfer the content checksum from the old
     // to the new record. It is not a problem to skip it here.
-    propagator()->_journal->deleteFileRecord(_item->_originalFile);
+    SyncJournalFileRecord oldRecord = recordBeforeMove(propagator()->_journal, *_item);
 
     SyncJournalFileRecord record = _item->toSyncJournalFileRecordWithInode(propagator()->getFilePath(_item->_renameTarget));
     record._path = _item->_renameTarget.toUtf8();
@@ -186,7 +184,7 @@ void PropagateRemoteMove::finalize()
         }
     }
 
-    if (!propagator()->_journal->setFileRecord(record)) {
+    if (!updateMovedRecord(propagator()->_journal, *_item, oldRecord, record)) {
         done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
         return;
     }
@@ -202,6 +200,40 @@ void PropagateRemoteMove::finalize()
     done(SyncFileItem::Success);
 }
 
+SyncJournalFileRecord PropagateRemoteMove::recordBeforeMove(SyncJournalDb *journal, const SyncFileItem &item)
+{
+    SyncJournalFileRecord record;
+    journal->getFileRecord(item._originalFile, &record);
+    if (!record.isValid() && item._file != item._originalFile) {
+        journal->getFileRecord(item._file, &record);
+    }
+    return record;
+}
+
+bool PropagateRemoteMove::updateMovedRecord(SyncJournalDb *journal, const SyncFileItem &item,
+    const SyncJournalFileRecord &oldRecord, const SyncJournalFileRecord &record)
+{
+    if (oldRecord == record) {
+        return true;
+    }
+
+    journal->deleteFileRecord(item._originalFile);
+    if (oldRecord.isValid() && oldRecord._path != item._originalFile.toUtf8()) {
+        journal->deleteFileRecord(QString::fromUtf8(oldRecord._path));
+    }
+    if (!journal->setFileRecord(record)) {
+        return false;
+    }
+
+    // The children follow in one statement; their own jobs only write what changed.
+    // The move of a parent directory may already have moved them away from _originalFile.
+    const QByteArray oldPath = oldRecord.isValid() ? oldRecord._path : item._originalFile.toUtf8();
+    if (item.isDirectory() && oldPath != record._path) {
+        return journal->moveFileRecords(oldPath, record._path);
+    }
+    return true;
+}
+
 bool PropagateRemoteMove::adjustSelectiveSync(SyncJournalDb *journal, const QString &from_, const QString &to_)
 {
     bool ok;
@@ -58,12 +58,32 @@ public:
     void start() Q_DECL_OVERRIDE;
     void abort(PropagatorJob::AbortType abortType) Q_DECL_OVERRIDE;
     JobParallelism parallelism() Q_DECL_OVERRIDE { return _item->isDirectory() ? WaitForFinished : FullParallelism; }
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return true; }
 
     /**
      * Rename the directory in the selective sync list
      */
     static bool adjustSelectiveSync(SyncJournalDb *journal, const QString &from, const QString &to);
 
+    /**
+     * The journal record of a moved item from before the move
+     *
+     * A directory move takes the records below the directory along (see
+     * SyncJournalDb::moveFileRecords()), so once the parent was moved the
+     * record is found at the item's adjusted path rather than at
+     * _originalFile.
+     */
+    static SyncJournalFileRecord recordBeforeMove(SyncJournalDb *journal, const SyncFileItem &item);
+
+    /**
+     * Replaces the record of a moved item by \a record
+     *
+     * Entries that merely moved along with their parent directory usually
+     * already have an up to date record; nothing is written for those.
+     */
+    static bool updateMovedRecord(SyncJournalDb *journal, const SyncFileItem &item,
+        const SyncJournalFileRecord &oldRecord, const SyncJournalFileRecord &record);
+
 private slots:
     void slotMoveJobFinished();
     void finalize();
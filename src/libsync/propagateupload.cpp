@@ -26,6 +26,7 @@
 #include "syncengine.h"
 #include "propagateremotedelete.h"
 #include "common/asserts.h"
+#include "transfercompression.h"
 
 #include <QNetworkAccessManager>
 #include <QFileInfo>
@@ -323,6 +324,7 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
 
 UploadDevice::UploadDevice(BandwidthManager *bwm)
     : _read(0)
+    , _uncompressedSize(-1)
     , _bandwidthManager(bwm)
     , _bandwidthQuota(0)
     , _readWithProgress(0)
@@ -344,6 +346,7 @@ bool UploadDevice::prepareAndOpen(const QString &fileName, qint64 start, qint64
 {
     _data.clear();
     _read = 0;
+    _uncompressedSize = -1;
 
     QFile file(fileName);
     QString openError;
@@ -364,6 +367,32 @@ bool UploadDevice::prepareAndOpen(const QString &fileName, qint64 start, qint64
 }
 
 
+bool UploadDevice::compress(const QString &fileName)
+{
+    ASSERT(_read == 0);
+    static const int sampleSize = 64 * 1024;
+    const QByteArray sample = QByteArray::fromRawData(_data.constData(), qMin(_data.size(), sampleSize));
+    if (!TransferCompression::isCompressible(fileName, sample))
+        return false;
+
+    QByteArray compressed = TransferCompression::gzip(_data);
+    // Not worth it if it saves less than a tenth
+    if (compressed.isEmpty() || compressed.size() > _data.size() / 10 * 9)
+        return false;
+
+    qCDebug(lcPropagateUpload) << "Compressed" << fileName << "from" << _data.size() << "to" << compressed.size() << "bytes";
+    _uncompressedSize = _data.size();
+    _data = compressed;
+    return true;
+}
+
+qint64 UploadDevice::uncompressedBytes(qint64 sent) const
+{
+    if (!isCompressed() || _data.isEmpty())
+        return sent;
+    return sent * _uncompressedSize / _data.size();
+}
+
 qint64 UploadDevice::writeData(const char *, qint64)
 {
     ASSERT(false, "write to read only device");
@@ -443,7 +472,9 @@ void UploadDevice::giveBandwidthQuota(qint64 bwq)
 {
     if (!atEnd()) {
         _bandwidthQuota = bwq;
-        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection); // tell QNAM that we have quota
+        if (bwq > 0) {
+            QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection); // tell QNAM that we have quota
+        }
     }
 }
 
@@ -15,10 +15,13 @@
 
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
+#include "deltasync.h"
 
 #include <QBuffer>
 #include <QFile>
 #include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QJsonObject>
 
 
 namespace OCC {
@@ -42,6 +45,18 @@ public:
     /** Reads the data from the file and opens the device */
     bool prepareAndOpen(const QString &fileName, qint64 start, qint64 size);
 
+    /**
+     * Replaces the data by its gzip encoding if it compresses well.
+     *
+     * Must be called before anything was read. Returns whether the data
+     * is now compressed.
+     */
+    bool compress(const QString &fileName);
+    bool isCompressed() const { return _uncompressedSize >= 0; }
+
+    /** Maps a number of sent bytes to the amount of file data they carry */
+    qint64 uncompressedBytes(qint64 sent) const;
+
     qint64 writeData(const char *, qint64) Q_DECL_OVERRIDE;
     qint64 readData(char *data, qint64 maxlen) Q_DECL_OVERRIDE;
     bool atEnd() const Q_DECL_OVERRIDE;
@@ -63,6 +78,8 @@ private:
     QByteArray _data;
     // Position in the data
     qint64 _read;
+    // Size of the data before compress(), -1 if it is not compressed
+    qint64 _uncompressedSize;
 
     // Bandwidth manager related
     QPointer<BandwidthManager> _bandwidthManager;
@@ -150,6 +167,95 @@ signals:
 
 };
 
+/**
+ * @brief The multipart body of a BulkUploadJob
+ *
+ * The body is a sequence of parts: the delimiters and headers are kept in
+ * memory, the file contents are read from the disk only once the request
+ * gets to them. At most one of the files is open at a time.
+ *
+ * @ingroup libsync
+ */
+class BulkUploadDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit BulkUploadDevice(QObject *parent = 0);
+
+    /** Appends data that is sent as is */
+    void appendData(const QByteArray &data);
+    /** Appends the content of a file, which must have the given size when it is read */
+    void appendFile(const QString &fileName, qint64 size);
+
+    qint64 writeData(const char *, qint64) Q_DECL_OVERRIDE;
+    qint64 readData(char *data, qint64 maxlen) Q_DECL_OVERRIDE;
+    bool atEnd() const Q_DECL_OVERRIDE;
+    qint64 size() const Q_DECL_OVERRIDE;
+    qint64 bytesAvailable() const Q_DECL_OVERRIDE;
+    bool isSequential() const Q_DECL_OVERRIDE;
+    bool seek(qint64 pos) Q_DECL_OVERRIDE;
+
+private:
+    struct Part
+    {
+        QByteArray _data;
+        QString _fileName; // if empty, the part is _data
+        qint64 _offset; // position of the part in the body
+        qint64 _size;
+    };
+
+    /** Index of the part that contains the position \a pos */
+    int partAt(qint64 pos) const;
+
+    QVector<Part> _parts;
+    qint64 _size;
+    // Position in the body
+    qint64 _read;
+    // The file of the part with the index _openPart, if that is a file
+    QFile _file;
+    int _openPart;
+};
+
+/**
+ * @brief Uploads several files in one multipart/related POST request
+ *
+ * Every part carries the headers a PUT of that file would have, plus
+ * X-File-Path with the path of the file below the dav root. The server
+ * replies with a JSON object that maps each X-File-Path to its result:
+ * { "error": bool, "status": int, "message": string, "etag": string, "fileid": string }
+ *
+ * @ingroup libsync
+ */
+class BulkUploadJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+    QIODevice *_device;
+    QByteArray _boundary;
+    QJsonObject _results;
+
+public:
+    // Takes ownership of the device
+    explicit BulkUploadJob(AccountPtr account, QIODevice *device, const QByteArray &boundary, QObject *parent = 0);
+    ~BulkUploadJob();
+
+    void start() Q_DECL_OVERRIDE;
+    bool finished() Q_DECL_OVERRIDE;
+
+    QIODevice *device()
+    {
+        return _device;
+    }
+
+    /// The result of one file, empty if the reply did not mention it
+    QJsonObject result(const QString &remotePath) const
+    {
+        return _results.value(remotePath).toObject();
+    }
+
+signals:
+    void finishedSignal();
+};
+
 /**
  * @brief This job implements the asynchronous PUT
  *
@@ -348,6 +454,11 @@ private:
     quint64 _currentChunkSize = 0; /// current chunk size
     bool _removeJobError = false; /// If not null, there was an error removing the job
 
+    // Delta upload: the analysis of the file against the block signatures
+    // of the remote version, and its result.
+    QFutureWatcher<DeltaSync::Analysis> _deltaWatcher;
+    DeltaSync::Analysis _delta;
+
     // Map chunk number with its size  from the PROPFIND on resume.
     // (Only used from slotPropfindIterate/slotPropfindFinished because the LsColJob use signals to report data.)
     struct ServerChunkInfo
@@ -363,6 +474,9 @@ private:
      */
     QUrl chunkUrl(int chunk = -1);
 
+    /// Path of the destination file, as used by the final MOVE
+    QString destinationPath() const;
+
 public:
     PropagateUploadFileNG(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
         : PropagateUploadFileCommon(propagator, item)
@@ -373,6 +487,7 @@ public:
 
 private:
     void startNewUpload();
+    void startDeltaAnalysis();
     void startNextChunk();
 public slots:
     void abort(AbortType abortType) Q_DECL_OVERRIDE;
@@ -380,10 +495,89 @@ private slots:
     void slotPropfindFinished();
     void slotPropfindFinishedWithError();
     void slotPropfindIterate(const QString &name, const QMap<QString, QString> &properties);
+    void slotDeltaAnalysisFinished();
     void slotDeleteJobFinished();
     void slotMkColFinished(QNetworkReply::NetworkError);
     void slotPutFinished();
     void slotMoveJobFinished();
     void slotUploadProgress(qint64, qint64);
 };
+
+class PropagateUploadBulk;
+
+/**
+ * @ingroup libsync
+ *
+ * Propagation job for one file of a PropagateUploadBulk batch.
+ *
+ * Does the usual checks and checksum computations, then hands its content
+ * to the batch instead of sending a PUT.
+ */
+class PropagateUploadFileBulkItem : public PropagateUploadFileCommon
+{
+    Q_OBJECT
+private:
+    PropagateUploadBulk *_bulk;
+
+public:
+    PropagateUploadFileBulkItem(OwncloudPropagator *propagator, const SyncFileItemPtr &item, PropagateUploadBulk *bulk)
+        : PropagateUploadFileCommon(propagator, item)
+        , _bulk(bulk)
+    {
+    }
+
+    void doStartUpload() Q_DECL_OVERRIDE;
+
+    /// The X-File-Path of this file
+    QString remotePath() const;
+
+    /// Appends the part of this file to the multipart body
+    void appendPart(BulkUploadDevice *body, const QByteArray &boundary);
+
+    /// Handles the reply of the batch's request
+    void bulkUploadFinished(BulkUploadJob *job);
+};
+
+/**
+ * @ingroup libsync
+ *
+ * Uploads a batch of small files with a single BulkUploadJob.
+ *
+ * The request is sent once every file is either prepared or already
+ * finished with an error. The per-file results of the reply are mapped
+ * back to the individual items.
+ */
+class PropagateUploadBulk : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /// Upper bound for the number of files in one request
+    static const int maxFileCount = 100;
+
+    PropagateUploadBulk(OwncloudPropagator *propagator, const SyncFileItemVector &items);
+
+    bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return true; }
+
+    /// Called by the item jobs once their content is ready to be sent
+    void itemReady(PropagateUploadFileBulkItem *job);
+
+public slots:
+    void abort(PropagatorJob::AbortType abortType) Q_DECL_OVERRIDE;
+
+private slots:
+    void slotItemFinished(SyncFileItem::Status status);
+    void slotBulkUploadFinished();
+
+private:
+    void startBulkUploadIfReady();
+
+    QVector<PropagateUploadFileBulkItem *> _jobs;
+    int _nextJob; // index of the first item job not started yet
+    QVector<PropagateUploadFileBulkItem *> _readyJobs;
+    QPointer<BulkUploadJob> _bulkJob;
+    bool _uploadStarted;
+    int _finishedCount;
+    SyncFileItem::Status _hasError; // NoStatus, or the last error of an item
+};
 }
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "config.h"
+#include "propagateupload.h"
+#include "owncloudpropagator_p.h"
+#include "networkjobs.h"
+#include "account.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+#include "common/utility.h"
+#include "filesystem.h"
+#include "common/checksums.h"
+#include "common/asserts.h"
+
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QUuid>
+
+#include <algorithm>
+#include <cstring>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcBulkUploadJob, "sync.networkjob.bulkupload", QtInfoMsg)
+
+BulkUploadDevice::BulkUploadDevice(QObject *parent)
+    : QIODevice(parent)
+    , _size(0)
+    , _read(0)
+    , _openPart(-1)
+{
+}
+
+void BulkUploadDevice::appendData(const QByteArray &data)
+{
+    Part part;
+    part._data = data;
+    part._offset = _size;
+    part._size = data.size();
+    _parts.append(part);
+    _size += part._size;
+}
+
+void BulkUploadDevice::appendFile(const QString &fileName, qint64 size)
+{
+    Part part;
+    part._fileName = fileName;
+    part._offset = _size;
+    part._size = size;
+    _parts.append(part);
+    _size += part._size;
+}
+
+int BulkUploadDevice::partAt(qint64 pos) const
+{
+    // The last part that starts at or before pos, empty parts are skipped
+    auto it = std::upper_bound(_parts.begin(), _parts.end(), pos,
+        [](qint64 p, const Part &part) { return p < part._offset; });
+    return int(it - _parts.begin()) - 1;
+}
+
+qint64 BulkUploadDevice::writeData(const char *, qint64)
+{
+    ASSERT(false, "write to read only device");
+    return 0;
+}
+
+qint64 BulkUploadDevice::readData(char *data, qint64 maxlen)
+{
+    if (_read >= _size) {
+        return -1;
+    }
+    const int index = partAt(_read);
+    const Part &part = _parts.at(index);
+    const qint64 inPart = _read - part._offset;
+    maxlen = qMin(maxlen, part._size - inPart);
+
+    if (part._fileName.isEmpty()) {
+        std::memcpy(data, part._data.constData() + inPart, maxlen);
+    } else {
+        if (_openPart != index) {
+            _file.close();
+            _file.setFileName(part._fileName);
+            QString openError;
+            if (!FileSystem::openAndSeekFileSharedRead(&_file, &openError, 0)) {
+                setErrorString(openError);
+                return -1;
+            }
+            _openPart = index;
+        }
+        if (_file.pos() != inPart && !_file.seek(inPart)) {
+            setErrorString(_file.errorString());
+            return -1;
+        }
+        maxlen = _file.read(data, maxlen);
+        if (maxlen <= 0) {
+            // The file got shorter since the item checked it
+            setErrorString(tr("Local file changed during sync."));
+            return -1;
+        }
+        if (inPart + maxlen >= part._size) {
+            _file.close();
+            _openPart = -1;
+        }
+    }
+    _read += maxlen;
+    return maxlen;
+}
+
+bool BulkUploadDevice::atEnd() const
+{
+    return _read >= _size;
+}
+
+qint64 BulkUploadDevice::size() const
+{
+    return _size;
+}
+
+qint64 BulkUploadDevice::bytesAvailable() const
+{
+    return _size - _read + QIODevice::bytesAvailable();
+}
+
+// random access, we can seek
+bool BulkUploadDevice::isSequential() const
+{
+    return false;
+}
+
+bool BulkUploadDevice::seek(qint64 pos)
+{
+    if (!QIODevice::seek(pos)) {
+        return false;
+    }
+    if (pos < 0 || pos > _size) {
+        return false;
+    }
+    _read = pos;
+    return true;
+}
+
+BulkUploadJob::BulkUploadJob(AccountPtr account, QIODevice *device, const QByteArray &boundary, QObject *parent)
+    : AbstractNetworkJob(account, QLatin1String("remote.php/dav/bulk"), parent)
+    , _device(device)
+    , _boundary(boundary)
+{
+    _device->setParent(this);
+}
+
+BulkUploadJob::~BulkUploadJob()
+{
+    // Make sure that we destroy the QNetworkReply before our _device of which it keeps an internal pointer.
+    setReply(0);
+}
+
+void BulkUploadJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Content-Type", "multipart/related; boundary=" + _boundary);
+    req.setPriority(QNetworkRequest::LowPriority); // Like PUTs, must not block non-propagation jobs.
+
+    sendRequest("POST", makeAccountUrl(path()), req, _device);
+
+    if (reply()->error() != QNetworkReply::NoError) {
+        qCWarning(lcBulkUploadJob) << " Network error: " << reply()->errorString();
+    }
+
+    connect(this, &AbstractNetworkJob::networkActivity, account().data(), &Account::propagatorNetworkActivity);
+    AbstractNetworkJob::start();
+}
+
+bool BulkUploadJob::finished()
+{
+    qCInfo(lcBulkUploadJob) << "POST of" << reply()->request().url().toString() << "FINISHED WITH STATUS"
+                            << reply()->error()
+                            << (reply()->error() == QNetworkReply::NoError ? QLatin1String("") : errorString())
+                            << reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+
+    if (reply()->error() == QNetworkReply::NoError) {
+        QJsonParseError jsonParseError;
+        _results = QJsonDocument::fromJson(reply()->readAll(), &jsonParseError).object();
+        if (jsonParseError.error != QJsonParseError::NoError) {
+            qCWarning(lcBulkUploadJob) << "Invalid JSON reply:" << jsonParseError.errorString();
+        }
+    }
+
+    emit finishedSignal();
+    return true;
+}
+
+void PropagateUploadFileBulkItem::doStartUpload()
+{
+    const QString fileName = propagator()->getFilePath(_item->_file);
+    QFile file(fileName);
+    QString openError;
+    if (!FileSystem::openAndSeekFileSharedRead(&file, &openError, 0)) {
+        qCWarning(lcPropagateUpload) << "Could not open" << fileName << "for upload:" << openError;
+
+        // If the file is currently locked, we want to retry the sync
+        // when it becomes available again.
+        if (FileSystem::isFileLocked(fileName)) {
+            emit propagator()->seenLockedFile(fileName);
+        }
+        // Soft error because this is likely caused by the user modifying his files while syncing
+        abortWithError(SyncFileItem::SoftError, openError);
+        return;
+    }
+
+    // The content is read when the request gets to it, see BulkUploadDevice
+    if (quint64(file.size()) != _item->_size) {
+        propagator()->_anotherSyncNeeded = true;
+        abortWithError(SyncFileItem::SoftError, tr("Local file changed during sync."));
+        return;
+    }
+
+    propagator()->reportProgress(*_item, 0);
+    _bulk->itemReady(this);
+}
+
+QString PropagateUploadFileBulkItem::remotePath() const
+{
+    QString path = propagator()->_remoteFolder + _item->_file;
+    if (!path.startsWith(QLatin1Char('/'))) {
+        path.prepend(QLatin1Char('/'));
+    }
+    return path;
+}
+
+void PropagateUploadFileBulkItem::appendPart(BulkUploadDevice *body, const QByteArray &boundary)
+{
+    auto headers = PropagateUploadFileCommon::headers();
+    // The server answers the whole batch at once, there is nothing to poll
+    headers.remove("OC-Async");
+    headers["X-File-Path"] = remotePath().toUtf8();
+    if (!_transmissionChecksumHeader.isEmpty()) {
+        headers[checkSumHeaderC] = _transmissionChecksumHeader;
+    }
+    headers["Content-Length"] = QByteArray::number(_item->_size);
+
+    QByteArray partHeader = "--" + boundary + "\r\n";
+    for (auto it = headers.constBegin(); it != headers.constEnd(); ++it) {
+        partHeader.append(it.key() + ": " + it.value() + "\r\n");
+    }
+    partHeader.append("\r\n");
+    body->appendData(partHeader);
+    body->appendFile(propagator()->getFilePath(_item->_file), _item->_size);
+    body->appendData("\r\n");
+}
+
+void PropagateUploadFileBulkItem::bulkUploadFinished(BulkUploadJob *job)
+{
+    if (_finished) {
+        return;
+    }
+
+    if (job->reply()->error() != QNetworkReply::NoError) {
+        _item->_httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        commonErrorHandling(job);
+        return;
+    }
+
+    const QJsonObject result = job->result(remotePath());
+    if (result.isEmpty()) {
+        abortWithError(SyncFileItem::NormalError, tr("The server did not report a result for this file"));
+        return;
+    }
+
+    if (result.value("error").toBool()) {
+        _item->_httpErrorCode = result.value("status").toInt();
+        if (checkForProblemsWithShared(_item->_httpErrorCode,
+                tr("The file was edited locally but is part of a read only share. "
+                   "It is restored and your edit is in the conflict file."))) {
+            return;
+        }
+        if (_item->_httpErrorCode == 412) {
+            // See commonErrorHandling()
+            propagator()->_journal->avoidReadFromDbOnNextSync(_item->_file);
+            propagator()->_anotherSyncNeeded = true;
+        }
+        QString errorString = result.value("message").toString();
+        if (errorString.isEmpty()) {
+            errorString = tr("Upload failed with HTTP status %1").arg(_item->_httpErrorCode);
+        }
+        abortWithError(classifyError(QNetworkReply::UnknownContentError, _item->_httpErrorCode,
+                           &propagator()->_anotherSyncNeeded),
+            errorString);
+        return;
+    }
+
+    _finished = true;
+    _item->_etag = parseEtag(result.value("etag").toString().toUtf8().constData());
+    const QByteArray fid = result.value("fileid").toString().toUtf8();
+    if (!fid.isEmpty()) {
+        if (!_item->_fileId.isEmpty() && _item->_fileId != fid) {
+            qCWarning(lcPropagateUpload) << "File ID changed!" << _item->_fileId << fid;
+        }
+        _item->_fileId = fid;
+    }
+    _item->_responseTimeStamp = job->responseTimestamp();
+
+    if (_item->_etag.isEmpty()) {
+        done(SyncFileItem::NormalError, tr("The server did not acknowledge the upload. (No e-tag was present)"));
+        return;
+    }
+
+    // The file is on the server, but make sure the next sync looks at it
+    // again if it was changed in the meantime.
+    const QString fullFilePath(propagator()->getFilePath(_item->_file));
+    if (!FileSystem::fileExists(fullFilePath)
+        || !FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime)) {
+        propagator()->_anotherSyncNeeded = true;
+    }
+
+    finalize();
+}
+
+PropagateUploadBulk::PropagateUploadBulk(OwncloudPropagator *propagator, const SyncFileItemVector &items)
+    : PropagatorJob(propagator)
+    , _nextJob(0)
+    , _uploadStarted(false)
+    , _finishedCount(0)
+    , _hasError(SyncFileItem::NoStatus)
+{
+    foreach (const SyncFileItemPtr &item, items) {
+        auto job = new PropagateUploadFileBulkItem(propagator, item, this);
+        // The item jobs are deleted together with the batch
+        job->setParent(this);
+        _jobs.append(job);
+    }
+}
+
+bool PropagateUploadBulk::scheduleSelfOrChild()
+{
+    if (_state == Finished) {
+        return false;
+    }
+    if (_state == NotYetStarted) {
+        _state = Running;
+        qCInfo(lcPropagateUpload) << "Starting bulk upload of" << _jobs.size() << "files by" << this;
+    }
+
+    // Like PropagatorCompositeJob, start one item per call so that the
+    // propagator checks its job limits before each of them
+    if (_nextJob >= _jobs.size()) {
+        return false;
+    }
+    auto job = _jobs.at(_nextJob);
+    if (!propagator()->canStartJob(job)) {
+        return false;
+    }
+    ++_nextJob;
+    connect(job, &PropagatorJob::finished, this, &PropagateUploadBulk::slotItemFinished);
+    return job->scheduleSelfOrChild();
+}
+
+void PropagateUploadBulk::itemReady(PropagateUploadFileBulkItem *job)
+{
+    _readyJobs.append(job);
+    startBulkUploadIfReady();
+
+    // The item is no longer in the active job list
+    propagator()->scheduleNextJob();
+}
+
+void PropagateUploadBulk::startBulkUploadIfReady()
+{
+    if (_uploadStarted || _readyJobs.isEmpty()
+        || _readyJobs.size() + _finishedCount < _jobs.size()) {
+        return;
+    }
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    _uploadStarted = true;
+
+    const QByteArray boundary = "bulk-" + QUuid::createUuid().toRfc4122().toHex();
+    auto device = new BulkUploadDevice;
+    foreach (auto job, _readyJobs) {
+        job->appendPart(device, boundary);
+    }
+    device->appendData("--" + boundary + "--\r\n");
+    device->open(QIODevice::ReadOnly);
+
+    qCInfo(lcPropagateUpload) << "Uploading" << _readyJobs.size() << "files in one request of" << device->size() << "bytes";
+    _bulkJob = new BulkUploadJob(propagator()->account(), device, boundary, this);
+    connect(_bulkJob.data(), &BulkUploadJob::finishedSignal, this, &PropagateUploadBulk::slotBulkUploadFinished);
+    // The request counts as one active job, represented by its first item
+    propagator()->_activeJobList.append(_readyJobs.first());
+    _bulkJob->start();
+}
+
+void PropagateUploadBulk::slotBulkUploadFinished()
+{
+    BulkUploadJob *job = qobject_cast<BulkUploadJob *>(sender());
+    ASSERT(job);
+
+    propagator()->_activeJobList.removeOne(_readyJobs.first());
+
+    // Copy, the items might finish the whole batch
+    const auto readyJobs = _readyJobs;
+    foreach (auto item, readyJobs) {
+        item->bulkUploadFinished(job);
+    }
+}
+
+void PropagateUploadBulk::slotItemFinished(SyncFileItem::Status status)
+{
+    if (status == SyncFileItem::FatalError
+        || status == SyncFileItem::NormalError
+        || status == SyncFileItem::SoftError
+        || status == SyncFileItem::DetailError) {
+        _hasError = status;
+    }
+
+    _finishedCount++;
+    if (_finishedCount == _jobs.size()) {
+        _state = Finished;
+        emit finished(_hasError == SyncFileItem::NoStatus ? SyncFileItem::Success : _hasError);
+        return;
+    }
+
+    startBulkUploadIfReady();
+}
+
+void PropagateUploadBulk::abort(PropagatorJob::AbortType abortType)
+{
+    foreach (auto job, _jobs) {
+        if (job->_state == Running) {
+            job->abort(AbortType::Synchronous);
+        }
+    }
+
+    if (_bulkJob && _bulkJob->reply()) {
+        if (abortType == AbortType::Asynchronous && _bulkJob->device()->atEnd()) {
+            // All files were sent already, aborting now could leave them
+            // on the server without the journal knowing about it.
+            connect(_bulkJob->reply(), &QNetworkReply::finished, this, [this] { emit abortFinished(); });
+            return;
+        }
+        _bulkJob->reply()->abort();
+    }
+
+    if (abortType == AbortType::Asynchronous) {
+        emit abortFinished();
+    }
+}
+}
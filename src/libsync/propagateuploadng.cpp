@@ -30,11 +30,19 @@
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <qtconcurrentrun.h>
 #include <cmath>
 #include <cstring>
 
 namespace OCC {
 
+// Property of the PUT jobs of the chunks that the server copies from the remote file
+static const char reusedChunkC[] = "reusedChunk";
+
+// Below this reading the whole file for its blocks delays the upload
+// for longer than the reused blocks could save
+static const quint64 minimumDeltaUploadSize = 1024 * 1024;
+
 QUrl PropagateUploadFileNG::chunkUrl(int chunk)
 {
     QString path = QLatin1String("remote.php/dav/uploads/")
@@ -47,6 +55,12 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
     return Utility::concatUrlPath(propagator()->account()->url(), path);
 }
 
+QString PropagateUploadFileNG::destinationPath() const
+{
+    return QDir::cleanPath(propagator()->account()->url().path() + QLatin1Char('/')
+        + propagator()->account()->davPath() + propagator()->_remoteFolder + _item->_file);
+}
+
 /*
   State machine:
 
@@ -67,6 +81,10 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
           |                                                       |                      |
     +-----+<------------------------------------------------------+<---  slotDeleteJobFinished()
     |
+    |  (With chunk reuse, startNewUpload() of a large file that is on the
+    |   server or was uploaded before is preceded by startDeltaAnalysis(),
+    |   and unchanged ranges of the file are sent as references to the
+    |   remote file instead of data.)
     +---->  startNextChunk()  ---finished?  --+
                   ^               |          |
                   +---------------+          |
@@ -106,6 +124,48 @@ void PropagateUploadFileNG::doStartUpload()
         // startNewUpload will reset the _transferId and the UploadInfo in the db.
     }
 
+    if (propagator()->account()->capabilities().chunkingReuse()
+        && _item->_size >= minimumDeltaUploadSize) {
+        startDeltaAnalysis();
+        return;
+    }
+    startNewUpload();
+}
+
+void PropagateUploadFileNG::startDeltaAnalysis()
+{
+    auto signatures = propagator()->_journal->getBlockSignatures(_item->_file);
+    const bool remoteExists = PropagateUploadFileCommon::headers().contains("If-Match");
+
+    // A file that was neither uploaded before nor exists on the server has
+    // nothing to reuse. Its signatures are computed when it is updated.
+    if (!remoteExists && signatures._signatures.isEmpty()) {
+        startNewUpload();
+        return;
+    }
+
+    // The signatures are only useful if they describe the version the
+    // upload replaces. They are computed anyway, for the next upload.
+    if (!remoteExists || signatures._etag != _item->_etag) {
+        signatures = SyncJournalDb::BlockSignatures();
+    }
+
+    connect(&_deltaWatcher, &QFutureWatcherBase::finished,
+        this, &PropagateUploadFileNG::slotDeltaAnalysisFinished);
+    _deltaWatcher.setFuture(QtConcurrent::run(&DeltaSync::analyzeFile,
+        propagator()->getFilePath(_item->_file), signatures._blockSize, signatures._signatures));
+}
+
+void PropagateUploadFileNG::slotDeltaAnalysisFinished()
+{
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    _delta = _deltaWatcher.future().result();
+    if (!_delta._segments.isEmpty()) {
+        qCInfo(lcPropagateUpload) << "Delta upload of" << _item->_file << "reuses" << _delta._reusedBytes
+                                  << "of" << _item->_size << "bytes in" << _delta._segments.size() << "segments";
+    }
     startNewUpload();
 }
 
@@ -274,8 +334,7 @@ void PropagateUploadFileNG::startNextChunk()
         Q_ASSERT(_jobs.isEmpty()); // There should be no running job anymore
         _finished = true;
         // Finish with a MOVE
-        QString destination = QDir::cleanPath(propagator()->account()->url().path() + QLatin1Char('/')
-            + propagator()->account()->davPath() + propagator()->_remoteFolder + _item->_file);
+        QString destination = destinationPath();
         auto headers = PropagateUploadFileCommon::headers();
 
         // "If-Match applies to the source, but we are interested in comparing the etag of the destination
@@ -299,10 +358,28 @@ void PropagateUploadFileNG::startNextChunk()
         return;
     }
 
+    // Find the delta segment this chunk starts in
+    qint64 sourceOffset = -1;
+    foreach (const auto &segment, _delta._segments) {
+        if (quint64(segment._offset + segment._size) <= _sent)
+            continue;
+        const qint64 segmentOffset = _sent - segment._offset;
+        const quint64 remaining = segment._size - segmentOffset;
+        if (segment.isReused()) {
+            // Nothing is sent, so there is no reason to split it
+            sourceOffset = segment._sourceOffset + segmentOffset;
+            _currentChunkSize = remaining;
+        } else {
+            _currentChunkSize = qMin(_currentChunkSize, remaining);
+        }
+        break;
+    }
+    const bool chunkIsReused = sourceOffset >= 0;
+
     auto device = new UploadDevice(&propagator()->_bandwidthManager);
     const QString fileName = propagator()->getFilePath(_item->_file);
 
-    if (!device->prepareAndOpen(fileName, _sent, _currentChunkSize)) {
+    if (!device->prepareAndOpen(fileName, _sent, chunkIsReused ? 0 : _currentChunkSize)) {
         qCWarning(lcPropagateUpload) << "Could not prepare upload device: " << device->errorString();
 
         // If the file is currently locked, we want to retry the sync
@@ -317,12 +394,21 @@ void PropagateUploadFileNG::startNextChunk()
 
     QMap<QByteArray, QByteArray> headers;
     headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
+    if (chunkIsReused) {
+        // The server fills the chunk from the current version of the file
+        headers["OC-Chunk-Source"] = QUrl::toPercentEncoding(destinationPath(), "/");
+        headers["OC-Chunk-Source-Offset"] = QByteArray::number(sourceOffset);
+        headers["OC-Chunk-Source-Length"] = QByteArray::number(_currentChunkSize);
+        headers["If-Match"] = PropagateUploadFileCommon::headers().value("If-Match");
+    }
 
     _sent += _currentChunkSize;
     QUrl url = chunkUrl(_currentChunk);
 
     // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
     PUTFileJob *job = new PUTFileJob(propagator()->account(), url, device, headers, _currentChunk, this);
+    // Several chunks are uploaded in parallel, slotPutFinished() needs to know about this one
+    job->setProperty(reusedChunkC, chunkIsReused);
     _jobs.append(job);
     connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotPutFinished);
     connect(job, &PUTFileJob::uploadProgress,
@@ -359,12 +445,24 @@ void PropagateUploadFileNG::slotPutFinished()
 
     ENFORCE(_sent <= _item->_size, "can't send more than size");
 
+    if (job->property(reusedChunkC).toBool()) {
+        // The empty body of a reused chunk reports no upload progress. The
+        // chunks still running count it in theirs, see slotUploadProgress().
+        bool putRunning = false;
+        foreach (AbstractNetworkJob *other, _jobs) {
+            putRunning = putRunning || qobject_cast<PUTFileJob *>(other);
+        }
+        if (!putRunning) {
+            propagator()->reportProgress(*_item, _sent);
+        }
+    }
+
     // Adjust the chunk size for the time taken.
     //
     // Dynamic chunk sizing is enabled if the server configured a
     // target duration for each chunk upload.
     double targetDuration = propagator()->syncOptions()._targetChunkUploadDuration;
-    if (targetDuration > 0) {
+    if (targetDuration > 0 && !job->property(reusedChunkC).toBool()) {
         double uploadTime = job->msSinceStart() + 1; // add one to avoid div-by-zero
 
         auto predictedGoodSize = static_cast<quint64>(
@@ -467,6 +565,15 @@ void PropagateUploadFileNG::slotMoveJobFinished()
     }
     _item->_responseTimeStamp = job->responseTimestamp();
 
+    // Remember the blocks of the version now on the server for the next upload
+    SyncJournalDb::BlockSignatures signatures;
+    if (_delta._valid) {
+        signatures._etag = _item->_etag;
+        signatures._blockSize = _delta._blockSize;
+        signatures._signatures = _delta._signatures;
+    }
+    propagator()->_journal->setBlockSignatures(_item->_file, signatures);
+
 #ifdef WITH_TESTING
     // performance logging
     quint64 duration = _stopWatch.stop();
@@ -123,6 +123,14 @@ void PropagateUploadFileV1::startNextChunk()
         return;
     }
 
+    // Chunks are assembled by the server from their raw sizes, so only
+    // complete files are compressed. The checksum header still refers to
+    // the uncompressed content.
+    if (_chunkCount <= 1 && propagator()->account()->capabilities().uploadCompression()
+        && device->compress(fileName)) {
+        headers["Content-Encoding"] = "gzip";
+    }
+
     // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
     PUTFileJob *job = new PUTFileJob(propagator()->account(), propagator()->_remoteFolder + path, device, headers, _currentChunk, this);
     _jobs.append(job);
@@ -346,7 +354,8 @@ void PropagateUploadFileV1::slotUploadProgress(qint64 sent, qint64 total)
         }
     } else {
         // sender() is the only current job, no need to look at the byteWritten properties
-        amount += sent;
+        auto device = qobject_cast<UploadDevice *>(static_cast<PUTFileJob *>(sender())->device());
+        amount += device ? device->uncompressedBytes(sent) : sent;
     }
     propagator()->reportProgress(*_item, amount);
 }
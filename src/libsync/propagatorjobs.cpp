@@ -231,9 +231,7 @@ void PropagateLocalRename::start()
         }
     }
 
-    SyncJournalFileRecord oldRecord;
-    propagator()->_journal->getFileRecord(_item->_originalFile, &oldRecord);
-    propagator()->_journal->deleteFileRecord(_item->_originalFile);
+    SyncJournalFileRecord oldRecord = PropagateRemoteMove::recordBeforeMove(propagator()->_journal, *_item);
 
     // store the rename file name in the item.
     const auto oldFile = _item->_file;
@@ -246,11 +244,22 @@ void PropagateLocalRename::start()
     }
 
     if (!_item->isDirectory()) { // Directories are saved at the end
-        if (!propagator()->_journal->setFileRecord(record)) {
+        if (!PropagateRemoteMove::updateMovedRecord(propagator()->_journal, *_item, oldRecord, record)) {
             done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
             return;
         }
     } else {
+        // The move of a parent directory may already have moved the records away from _originalFile
+        const QByteArray oldPath = oldRecord.isValid() ? oldRecord._path : _item->_originalFile.toUtf8();
+        propagator()->_journal->deleteFileRecord(_item->_originalFile);
+        if (oldPath != _item->_originalFile.toUtf8()) {
+            propagator()->_journal->deleteFileRecord(QString::fromUtf8(oldPath));
+        }
+        if (oldPath != record._path
+            && !propagator()->_journal->moveFileRecords(oldPath, record._path)) {
+            done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
+            return;
+        }
         if (!PropagateRemoteMove::adjustSelectiveSync(propagator()->_journal, oldFile, _item->_renameTarget)) {
             done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
             return;
@@ -40,6 +40,7 @@ public:
     {
     }
     void start() Q_DECL_OVERRIDE;
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return !_item->isDirectory(); }
 
 private:
     bool removeRecursively(const QString &path);
@@ -60,6 +61,7 @@ public:
     {
     }
     void start() Q_DECL_OVERRIDE;
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return true; }
 
     /**
      * Whether an existing file with the same name may be deleted before
@@ -87,5 +89,6 @@ public:
     }
     void start() Q_DECL_OVERRIDE;
     JobParallelism parallelism() Q_DECL_OVERRIDE { return _item->isDirectory() ? WaitForFinished : FullParallelism; }
+    bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return true; }
 };
 }
@@ -56,6 +56,7 @@ namespace OCC {
 Q_LOGGING_CATEGORY(lcEngine, "sync.engine", QtInfoMsg)
 
 static const int s_touchedFilesMaxAgeMs = 15 * 1000;
+static const qint64 s_priorityDirectoriesMaxAgeMs = 10 * 60 * 1000;
 bool SyncEngine::s_anySyncRunning = false;
 
 qint64 SyncEngine::minimumFileAgeForUpload = 2000;
@@ -327,6 +328,48 @@ void SyncEngine::deleteStaleErrorBlacklistEntries(const SyncFileItemVector &sync
     _journal->deleteStaleErrorBlacklistEntries(blacklist_file_paths);
 }
 
+// Whether the data is well formed UTF-8, without decoding it
+static bool isValidUtf8(const QByteArray &data)
+{
+    auto s = reinterpret_cast<const uchar *>(data.constData());
+    const auto end = s + data.size();
+    while (s < end) {
+        const uchar c = *s++;
+        if (c < 0x80)
+            continue;
+        int extra;
+        uint codePoint;
+        uint minimum;
+        if ((c & 0xe0) == 0xc0) {
+            extra = 1;
+            codePoint = c & 0x1f;
+            minimum = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            extra = 2;
+            codePoint = c & 0x0f;
+            minimum = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            extra = 3;
+            codePoint = c & 0x07;
+            minimum = 0x10000;
+        } else {
+            return false;
+        }
+        if (end - s < extra)
+            return false;
+        for (int i = 0; i < extra; ++i) {
+            if ((s[i] & 0xc0) != 0x80)
+                return false;
+            codePoint = (codePoint << 6) | (s[i] & 0x3f);
+        }
+        s += extra;
+        // Overlong forms, surrogates and values beyond Unicode
+        if (codePoint < minimum || codePoint > 0x10ffff || (codePoint >= 0xd800 && codePoint <= 0xdfff))
+            return false;
+    }
+    return true;
+}
+
 int SyncEngine::treewalkLocal(csync_file_stat_t *file, csync_file_stat_t *other, void *data)
 {
     return static_cast<SyncEngine *>(data)->treewalkFile(file, other, false);
@@ -344,6 +387,7 @@ int SyncEngine::treewalkRemote(csync_file_stat_t *file, csync_file_stat_t *other
  * csync_walk_local_tree()/csync_walk_remote_tree().
  *
  * It merges the two csync file trees into a single map of SyncFileItems.
+ * Only the entries that need propagation or a journal update get an item.
  *
  * See doc/dev/sync-algorithm.md for an overview.
  */
@@ -352,12 +396,27 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
     if (!file)
         return -1;
 
+    // Nearly all entries are unchanged. Record them as seen, without
+    // decoding their path or allocating an item. An unchanged remote entry
+    // still needs the slow path if the local walk made an item for it.
+    if (file->instruction == CSYNC_INSTRUCTION_NONE
+        && file->error_status == CSYNC_STATUS_OK
+        && (!remote || !_syncItemMap.contains(file->path))
+        && isValidUtf8(file->path)) {
+        _seenFiles.insert(file->path);
+        if (file->type != CSYNC_FTW_TYPE_DIR
+            && (!other || other->instruction == CSYNC_INSTRUCTION_NONE || other->instruction == CSYNC_INSTRUCTION_UPDATE_METADATA)) {
+            _hasNoneFiles = true;
+        }
+        return 0;
+    }
+
     QTextCodec::ConverterState utf8State;
     static QTextCodec *codec = QTextCodec::codecForName("UTF-8");
     ASSERT(codec);
     QString fileUtf8 = codec->toUnicode(file->path, file->path.size(), &utf8State);
     QString renameTarget;
-    QString key = fileUtf8;
+    QByteArray key = file->path;
 
     auto instruction = file->instruction;
     if (utf8State.invalidChars > 0 || utf8State.remainingChars > 0) {
@@ -370,7 +429,7 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
             instruction = CSYNC_INSTRUCTION_IGNORE;
         }
         if (instruction == CSYNC_INSTRUCTION_RENAME) {
-            key = renameTarget;
+            key = file->rename_path;
         }
     }
 
@@ -430,10 +489,10 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
     }
 
     // record the seen files to be able to clean the journal later
-    _seenFiles.insert(item->_file);
+    _seenFiles.insert(item->_file.toUtf8());
     if (!renameTarget.isEmpty()) {
         // Yes, this records both the rename renameTarget and the original so we keep both in case of a rename
-        _seenFiles.insert(renameTarget);
+        _seenFiles.insert(file->rename_path);
     }
 
     switch (file->error_status) {
@@ -817,6 +876,16 @@ void SyncEngine::startSync()
 
     _csync_ctx->read_remote_from_db = true;
 
+    _localDiscoveryIncomplete = false;
+    if (_localDiscoveryStyle == LocalDiscoveryStyle::DatabaseAndFilesystem) {
+        qCInfo(lcEngine) << "Reading the local tree from the database, except for" << _localDiscoveryPaths.size() << "paths";
+        _csync_ctx->should_discover_locally_fn = [this](const QByteArray &path) {
+            return shouldDiscoverLocally(path);
+        };
+    } else {
+        _csync_ctx->should_discover_locally_fn = nullptr;
+    }
+
     bool ok;
     auto selectiveSyncBlackList = _journal->getSelectiveSyncList(SyncJournalDb::SelectiveSyncBlackList, &ok);
     if (ok) {
@@ -926,13 +995,24 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _progressInfo->_status = ProgressInfo::Reconcile;
     emit transmissionProgress(*_progressInfo);
 
-    if (csync_reconcile(_csync_ctx.data()) < 0) {
+    const bool reconcileFailed = csync_reconcile(_csync_ctx.data()) < 0;
+    // Rename detection is done, don't keep a copy of the whole metadata table during propagation
+    _journal->releaseRenameIndex();
+    if (reconcileFailed) {
         handleSyncError(_csync_ctx.data(), "csync_reconcile");
         return;
     }
 
     qCInfo(lcEngine) << "#### Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Reconcile Finished")) << "ms";
 
+    if (_csync_ctx->local_discovery_incomplete) {
+        qCInfo(lcEngine) << "Local entries read from the database differ from the disk, a full local discovery is needed";
+        _localDiscoveryIncomplete = true;
+        if (_anotherSyncNeeded == NoFollowUpSync) {
+            _anotherSyncNeeded = ImmediateFollowUp;
+        }
+    }
+
     _hasNoneFiles = false;
     _hasRemoveFile = false;
     _hasForwardInTimeFiles = false;
@@ -941,6 +1021,7 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _seenFiles.clear();
     _temporarilyUnavailablePaths.clear();
     _renamedFolders.clear();
+    _seenFiles.reserve(int(std::max(_csync_ctx->local.files.size(), _csync_ctx->remote.files.size())));
 
     if (csync_walk_local_tree(_csync_ctx.data(), &treewalkLocal, 0) < 0) {
         qCWarning(lcEngine) << "Error in local treewalk.";
@@ -953,7 +1034,11 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     qCInfo(lcEngine) << "Permissions of the root folder: " << _csync_ctx->remote.root_perms.toString();
 
     // The map was used for merging trees, convert it to a list:
-    SyncFileItemVector syncItems = _syncItemMap.values().toVector();
+    SyncFileItemVector syncItems;
+    syncItems.reserve(_syncItemMap.size());
+    for (auto it = _syncItemMap.constBegin(); it != _syncItemMap.constEnd(); ++it) {
+        syncItems.append(it.value());
+    }
     _syncItemMap.clear(); // free memory
 
     // Adjust the paths for the renames.
@@ -985,8 +1070,17 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
 
     if (!_hasNoneFiles && _hasRemoveFile) {
         qCInfo(lcEngine) << "All the files are going to be changed, asking the user";
+        // The removals tell which side lost its files: the order of syncItems
+        // isn't meaningful, the first one may be a new file on the other side.
+        SyncFileItem::Direction direction = SyncFileItem::Up;
+        for (const auto &item : syncItems) {
+            if (item->_instruction == CSYNC_INSTRUCTION_REMOVE && item->_direction == SyncFileItem::Down) {
+                direction = SyncFileItem::Down;
+                break;
+            }
+        }
         bool cancel = false;
-        emit aboutToRemoveAllFiles(syncItems.first()->_direction, &cancel);
+        emit aboutToRemoveAllFiles(direction, &cancel);
         if (cancel) {
             qCInfo(lcEngine) << "User aborted sync";
             finalize(false);
@@ -1051,6 +1145,15 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _propagator = QSharedPointer<OwncloudPropagator>(
         new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
     _propagator->setSyncOptions(_syncOptions);
+    const qint64 priorityCutoff = QDateTime::currentMSecsSinceEpoch() - s_priorityDirectoriesMaxAgeMs;
+    for (auto it = _priorityDirectories.begin(); it != _priorityDirectories.end();) {
+        if (it.value() < priorityCutoff) {
+            it = _priorityDirectories.erase(it);
+        } else {
+            _propagator->prioritize(it.key());
+            ++it;
+        }
+    }
     connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
         this, &SyncEngine::slotItemCompleted);
     connect(_propagator.data(), &OwncloudPropagator::progress,
@@ -1133,9 +1236,7 @@ void SyncEngine::slotFinished(bool success)
     _journal->commit("All Finished.", false);
 
     // Send final progress information even if no
-    // files needed propagation, but clear the lastCompletedItem
-    // so we don't count this twice (like Recent Files)
-    _progressInfo->_lastCompletedItem = SyncFileItem();
+    // files needed propagation
     _progressInfo->_status = ProgressInfo::Done;
     emit transmissionProgress(*_progressInfo);
 
@@ -1562,6 +1663,50 @@ bool SyncEngine::wasFileTouched(const QString &fn) const
     return false;
 }
 
+void SyncEngine::prioritizePath(const QString &relativePath)
+{
+    // The user looks at the directory, so all the items in it are of interest
+    const QString directory = relativePath.left(qMax(0, relativePath.lastIndexOf(QLatin1Char('/'))));
+    _priorityDirectories[directory] = QDateTime::currentMSecsSinceEpoch();
+    if (_propagator) {
+        _propagator->prioritize(directory);
+    }
+}
+
+void SyncEngine::setLocalDiscoveryOptions(LocalDiscoveryStyle style, std::set<QByteArray> paths)
+{
+    _localDiscoveryStyle = style;
+    _localDiscoveryPaths = std::move(paths);
+}
+
+bool SyncEngine::shouldDiscoverLocally(const QByteArray &path) const
+{
+    if (_localDiscoveryStyle == LocalDiscoveryStyle::FilesystemOnly) {
+        return true;
+    }
+
+    // The path itself, or a parent of one of the paths: they sort right after "path/"
+    if (_localDiscoveryPaths.count(path)) {
+        return true;
+    }
+    const QByteArray prefix = path + '/';
+    auto it = _localDiscoveryPaths.lower_bound(prefix);
+    if (it != _localDiscoveryPaths.end() && it->startsWith(prefix)) {
+        return true;
+    }
+
+    // Below one of the paths: a reported directory is read with its whole subtree
+    if (_localDiscoveryPaths.count(QByteArray())) {
+        return true;
+    }
+    for (int slash = path.indexOf('/'); slash != -1; slash = path.indexOf('/', slash + 1)) {
+        if (_localDiscoveryPaths.count(path.left(slash))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 AccountPtr SyncEngine::account() const
 {
     return _account;
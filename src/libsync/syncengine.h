@@ -22,9 +22,11 @@
 #include <QThread>
 #include <QString>
 #include <QSet>
+#include <QHash>
 #include <QMap>
 #include <QStringList>
 #include <QSharedPointer>
+#include <set>
 
 #include <csync.h>
 
@@ -54,6 +56,11 @@ enum AnotherSyncNeeded {
     DelayedFollowUp // regularly schedule this folder again (around 1/minute, unlimited)
 };
 
+enum class LocalDiscoveryStyle {
+    FilesystemOnly, //< read all local data from the filesystem
+    DatabaseAndFilesystem, //< read from the db, except for listed paths
+};
+
 /**
  * @brief The SyncEngine class
  * @ingroup libsync
@@ -89,6 +96,31 @@ public:
 
     bool wasFileTouched(const QString &fn) const;
 
+    /**
+     * Propagate the items next to \a relativePath before the others.
+     *
+     * Called when the user looks at a file, for example when the file
+     * manager asks for its status through the socket api.
+     */
+    void prioritizePath(const QString &relativePath);
+
+    /**
+     * Control which local directories are read from the disk in the next sync.
+     *
+     * With DatabaseAndFilesystem, only the directories in \a paths (relative
+     * to the sync root) and their parents are read from the disk. The others
+     * are taken from the journal if their inode did not change. The caller
+     * is responsible for knowing, through a file watcher for example, that
+     * nothing else changed locally.
+     */
+    void setLocalDiscoveryOptions(LocalDiscoveryStyle style, std::set<QByteArray> paths = {});
+
+    /**
+     * Whether the last sync saw that local entries it took from the journal
+     * differ from the disk. The next sync should then read everything.
+     */
+    bool isLocalDiscoveryIncomplete() const { return _localDiscoveryIncomplete; }
+
     AccountPtr account() const;
     SyncJournalDb *journal() const { return _journal; }
     QString localPath() const { return _localPath; }
@@ -188,8 +220,9 @@ private:
 
     static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
 
-    // Must only be acessed during update and reconcile
-    QMap<QString, SyncFileItemPtr> _syncItemMap;
+    // Must only be acessed during update and reconcile.
+    // Keyed by the UTF-8 path of csync, which the hash shares without a copy.
+    QHash<QByteArray, SyncFileItemPtr> _syncItemMap;
 
     AccountPtr _account;
     QScopedPointer<CSYNC> _csync_ctx;
@@ -203,8 +236,8 @@ private:
     QSharedPointer<OwncloudPropagator> _propagator;
 
     // After a sync, only the syncdb entries whose filenames appear in this
-    // set will be kept. See _temporarilyUnavailablePaths.
-    QSet<QString> _seenFiles;
+    // set will be kept. See _temporarilyUnavailablePaths. UTF-8 encoded.
+    QSet<QByteArray> _seenFiles;
 
     // Some paths might be temporarily unavailable on the server, for
     // example due to 503 Storage not available. Deleting information
@@ -216,6 +249,10 @@ private:
     // while the remote says storage not available.
     QSet<QString> _temporarilyUnavailablePaths;
 
+    // Directories the user recently looked at, with the time of the last
+    // request in msecs since epoch. See prioritizePath().
+    QHash<QString, qint64> _priorityDirectories;
+
     QThread _thread;
 
     QScopedPointer<ProgressInfo> _progressInfo;
@@ -262,6 +299,14 @@ private:
 
     AnotherSyncNeeded _anotherSyncNeeded;
 
+    /** See setLocalDiscoveryOptions() */
+    LocalDiscoveryStyle _localDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
+    std::set<QByteArray> _localDiscoveryPaths;
+    bool _localDiscoveryIncomplete = false;
+
+    /** Whether the local directory must be read from the disk */
+    bool shouldDiscoverLocally(const QByteArray &path) const;
+
     /** Stores the time since a job touched a file. */
     QMultiMap<QElapsedTimer, QString> _touchedFiles;
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "config.h"
+#include "transfercompression.h"
+
+#include <QFileInfo>
+#include <QSet>
+#include <cmath>
+
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
+
+namespace OCC {
+
+// Below this many bytes the gzip header eats the savings
+static const int minimumCompressibleSize = 1024;
+
+// Samples with more bits per byte are most likely compressed already
+static const double maximumEntropy = 7.0;
+
+bool TransferCompression::isAvailable()
+{
+#ifdef ZLIB_FOUND
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TransferCompression::hasCompressedFormat(const QString &fileName)
+{
+    static const QSet<QString> compressedSuffixes = {
+        // archives
+        "7z", "bz2", "cab", "deb", "dmg", "gz", "jar", "lz", "lzma", "rar", "rpm", "tgz", "xz", "zip", "zst",
+        // office documents are zip files
+        "docx", "odg", "odp", "ods", "odt", "pptx", "xlsx",
+        // images
+        "gif", "heic", "jp2", "jpeg", "jpg", "png", "webp",
+        // audio and video
+        "aac", "avi", "flac", "m4a", "m4v", "mkv", "mov", "mp3", "mp4", "mpeg", "mpg", "ogg", "opus", "webm", "wmv",
+        // others
+        "apk", "epub", "pdf"
+    };
+    return compressedSuffixes.contains(QFileInfo(fileName).suffix().toLower());
+}
+
+double TransferCompression::entropy(const QByteArray &sample)
+{
+    if (sample.isEmpty())
+        return 0;
+
+    qint64 counts[256] = {};
+    for (char c : sample)
+        ++counts[static_cast<uchar>(c)];
+
+    double result = 0;
+    const double size = sample.size();
+    for (qint64 count : counts) {
+        if (count == 0)
+            continue;
+        const double p = count / size;
+        result -= p * std::log2(p);
+    }
+    return result;
+}
+
+bool TransferCompression::isCompressible(const QString &fileName, const QByteArray &sample)
+{
+    if (!isAvailable() || sample.size() < minimumCompressibleSize)
+        return false;
+    if (hasCompressedFormat(fileName))
+        return false;
+    return entropy(sample) <= maximumEntropy;
+}
+
+QByteArray TransferCompression::gzip(const QByteArray &data)
+{
+#ifdef ZLIB_FOUND
+    z_stream stream = {};
+    // 16 + MAX_WBITS selects the gzip format. Favor speed: the data is
+    // compressed right before it is sent.
+    if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return QByteArray();
+
+    QByteArray result;
+    result.resize(deflateBound(&stream, data.size()));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef *>(result.data());
+    stream.avail_out = result.size();
+
+    const int ret = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END)
+        return QByteArray();
+    result.resize(stream.total_out);
+    return result;
+#else
+    Q_UNUSED(data);
+    return QByteArray();
+#endif
+}
+
+QByteArray TransferCompression::gunzip(const QByteArray &data)
+{
+#ifdef ZLIB_FOUND
+    z_stream stream = {};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        return QByteArray();
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+
+    QByteArray result;
+    char buffer[16 * 1024];
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if (ret == Z_OK || ret == Z_STREAM_END)
+            result.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END)
+        return QByteArray();
+    return result;
+#else
+    Q_UNUSED(data);
+    return QByteArray();
+#endif
+}
+
+} // namespace OCC
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QByteArray>
+#include <QString>
+
+namespace OCC {
+
+/**
+ * @brief Helpers for compressing file contents on the wire
+ *
+ * Uploads are sent with "Content-Encoding: gzip" when the server allows it
+ * and the data compresses well. Downloads rely on QNetworkAccessManager,
+ * which negotiates gzip and decompresses while the data streams in.
+ *
+ * @ingroup libsync
+ */
+namespace TransferCompression {
+
+    /// Whether gzip support was compiled in
+    OWNCLOUDSYNC_EXPORT bool isAvailable();
+
+    /**
+     * Whether the file name indicates a format that is already compressed,
+     * like archives, images, audio and video.
+     */
+    OWNCLOUDSYNC_EXPORT bool hasCompressedFormat(const QString &fileName);
+
+    /**
+     * Shannon entropy of the sample in bits per byte, between 0 and 8.
+     *
+     * Compressed or encrypted data is close to 8.
+     */
+    OWNCLOUDSYNC_EXPORT double entropy(const QByteArray &sample);
+
+    /**
+     * Whether data with this name and the given leading bytes is worth
+     * compressing.
+     */
+    OWNCLOUDSYNC_EXPORT bool isCompressible(const QString &fileName, const QByteArray &sample);
+
+    /// Returns the data in gzip format, or an empty array on failure
+    OWNCLOUDSYNC_EXPORT QByteArray gzip(const QByteArray &data);
+
+    /// Decodes gzip data, returns an empty array on failure
+    OWNCLOUDSYNC_EXPORT QByteArray gunzip(const QByteArray &data);
+}
+
+} // namespace OCC
@@ -7,43 +7,213 @@
 
 #include "syncenginetestutils.h"
 #include <syncengine.h>
+#include "common/ownsql.h"
+
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
 
 using namespace OCC;
 
-int numDirs = 0;
-int numFiles = 0;
+/// Peak resident set size of the process in KiB, -1 if unknown
+static qint64 peakRssKb()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1024; // in bytes
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+struct TreeShape
+{
+    const char *name;
+    int filesPerDir;
+    int dirsPerDir;
+    int maxDepth;
+    qint64 fileSize;
+};
+
+static const TreeShape treeShapes[] = {
+    { "wide", 100, 30, 1, 64 }, // 30 dirs, 3100 files
+    { "deep", 2, 2, 10, 64 }, // 2046 dirs, 4094 files
+    { "tiny", 40, 6, 3, 1 }, // 258 dirs, 10360 files
+    { "huge", 2, 2, 1, 8 * 1000 * 1000 }, // 2 dirs, 6 files, each below the chunk size
+};
+
+static const char *const scenarios[] = { "initial", "noop", "onechange", "rename", "delete" };
 
-template<int filesPerDir, int dirPerDir, int maxDepth>
-void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
-    for (int fileNum = 1; fileNum <= filesPerDir; ++fileNum) {
+struct Tree
+{
+    QStringList topLevelDirs;
+    QStringList files;
+    int numDirs = 0;
+};
+
+static void addTree(const TreeShape &shape, int depth, const QString &path, FileModifier &fi, Tree &tree)
+{
+    for (int fileNum = 1; fileNum <= shape.filesPerDir; ++fileNum) {
         QString name = QStringLiteral("file") + QString::number(fileNum);
-        fi.insert(path.isEmpty() ? name : path + "/" + name);
-        numFiles++;
+        QString filePath = path.isEmpty() ? name : path + "/" + name;
+        fi.insert(filePath, shape.fileSize);
+        tree.files.append(filePath);
     }
-    if (depth >= maxDepth)
+    if (depth >= shape.maxDepth)
         return;
-    for (char dirNum = 1; dirNum <= dirPerDir; ++dirNum) {
+    for (int dirNum = 1; dirNum <= shape.dirsPerDir; ++dirNum) {
         QString name = QStringLiteral("dir") + QString::number(dirNum);
         QString subPath = path.isEmpty() ? name : path + "/" + name;
         fi.mkdir(subPath);
-        numDirs++;
-        addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(depth + 1, subPath, fi);
+        tree.numDirs++;
+        if (path.isEmpty())
+            tree.topLevelDirs.append(subPath);
+        addTree(shape, depth + 1, subPath, fi, tree);
     }
 }
 
-int main(int argc, char *argv[])
+/// Does the local changes of a scenario, the initial and no-op syncs need none
+static void prepareScenario(const QString &scenario, FileModifier &fi, Tree &tree)
 {
-    QCoreApplication app(argc, argv);
-    FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
-    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.localModifier());
+    if (scenario == "onechange") {
+        // The deepest file
+        fi.appendByte(tree.files.last());
+    } else if (scenario == "rename") {
+        for (auto &file : tree.files) {
+            fi.rename(file, file + "_renamed");
+            file += "_renamed";
+        }
+    } else if (scenario == "delete") {
+        // The files at the root stay, so that not all files are removed
+        for (const auto &dir : tree.topLevelDirs)
+            fi.remove(dir);
+        tree.files.erase(std::remove_if(tree.files.begin(), tree.files.end(),
+                             [](const QString &file) { return file.contains('/'); }),
+            tree.files.end());
+        tree.topLevelDirs.clear();
+    }
+}
 
-    qDebug() << "NUMFILES" << numFiles;
-    qDebug() << "NUMDIRS" << numDirs;
+/// Runs one sync and returns its measurements
+static QJsonObject measureSync(FakeFolder &fakeFolder)
+{
     QElapsedTimer timer;
+    QMap<ProgressInfo::Status, qint64> phaseStarts;
+    auto connection = QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress,
+        [&](const ProgressInfo &progress) {
+            if (!phaseStarts.contains(progress.status()))
+                phaseStarts[progress.status()] = timer.elapsed();
+        });
+
+    const quint64 statementsBefore = SqlQuery::executedStatementCount();
     timer.start();
-    bool result1 = fakeFolder.syncOnce();
-    qDebug() << "FIRST SYNC: " << result1 << timer.restart();
-    bool result2 = fakeFolder.syncOnce();
-    qDebug() << "SECOND SYNC: " << result2 << timer.restart();
-    return (result1 && result2) ? 0 : -1;
+    const bool success = fakeFolder.syncOnce();
+    const qint64 totalMs = timer.elapsed();
+    QObject::disconnect(connection);
+
+    auto phaseMs = [&](ProgressInfo::Status status, ProgressInfo::Status next) -> double {
+        if (!phaseStarts.contains(status))
+            return -1;
+        return phaseStarts.value(next, totalMs) - phaseStarts[status];
+    };
+    QJsonObject phases;
+    phases["discovery"] = phaseMs(ProgressInfo::Discovery, ProgressInfo::Reconcile);
+    phases["reconcile"] = phaseMs(ProgressInfo::Reconcile, ProgressInfo::Propagation);
+    phases["propagation"] = phaseMs(ProgressInfo::Propagation, ProgressInfo::Done);
+
+    QJsonObject result;
+    result["success"] = success;
+    result["totalMs"] = double(totalMs);
+    result["phasesMs"] = phases;
+    result["sqlStatements"] = double(SqlQuery::executedStatementCount() - statementsBefore);
+    result["peakRssKb"] = double(peakRssKb());
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList shapeNames, scenarioNames;
+    for (const auto &shape : treeShapes)
+        shapeNames.append(shape.name);
+    for (const auto scenario : scenarios)
+        scenarioNames.append(scenario);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs sync scenarios on synthetic trees and prints one JSON object per scenario.");
+    parser.addHelpOption();
+    QCommandLineOption shapeOption("shape", "Tree shape to run: " + shapeNames.join(", ") + ". Can be repeated, all by default.", "name");
+    QCommandLineOption scenarioOption("scenario", "Scenario to report: " + scenarioNames.join(", ") + ". Can be repeated, all by default.", "name");
+    QCommandLineOption latencyOption("latency", "Simulated latency of each request.", "ms", "0");
+    QCommandLineOption bandwidthOption("bandwidth", "Simulated bandwidth, 0 for unlimited.", "bytes/s", "0");
+    QCommandLineOption outputOption("output", "Appends the results to this file instead of printing them.", "file");
+    QCommandLineOption logOption("log", "Keep the sync log on the standard output.");
+    parser.addOptions({ shapeOption, scenarioOption, latencyOption, bandwidthOption, outputOption, logOption });
+    parser.process(app);
+
+    const QStringList selectedShapes = parser.isSet(shapeOption) ? parser.values(shapeOption) : shapeNames;
+    const QStringList selectedScenarios = parser.isSet(scenarioOption) ? parser.values(scenarioOption) : scenarioNames;
+    FakeNetworkConditions conditions;
+    conditions.latencyMs = parser.value(latencyOption).toInt();
+    conditions.bytesPerSecond = parser.value(bandwidthOption).toLongLong();
+
+    QFile output;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning() << "Could not open" << output.fileName();
+            return -1;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly);
+    }
+
+    bool allSucceeded = true;
+    for (const auto &shape : treeShapes) {
+        if (!selectedShapes.contains(shape.name))
+            continue;
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        if (!parser.isSet(logOption))
+            Logger::instance()->setLogFile(QString());
+        fakeFolder.setNetworkConditions(conditions);
+
+        Tree tree;
+        addTree(shape, 0, QString(), fakeFolder.localModifier(), tree);
+        const int numFiles = tree.files.size();
+        const int numDirs = tree.numDirs;
+
+        // The scenarios build on each other, they all run but only the selected ones are reported
+        for (const QString &scenario : scenarioNames) {
+            prepareScenario(scenario, fakeFolder.localModifier(), tree);
+            QJsonObject result = measureSync(fakeFolder);
+            allSucceeded &= result["success"].toBool();
+            if (!selectedScenarios.contains(scenario))
+                continue;
+
+            result["shape"] = shape.name;
+            result["scenario"] = scenario;
+            result["files"] = numFiles;
+            result["dirs"] = numDirs;
+            result["latencyMs"] = conditions.latencyMs;
+            result["bytesPerSecond"] = double(conditions.bytesPerSecond);
+            output.write(QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n');
+            output.flush();
+        }
+    }
+    return allSucceeded ? 0 : -1;
 }
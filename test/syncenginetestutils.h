@@ -12,10 +12,16 @@
 #include "filesystem.h"
 #include "syncengine.h"
 #include "common/syncjournaldb.h"
+#include "transfercompression.h"
+#include "deltasync.h"
 
 #include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkReply>
 #include <QMap>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QtTest>
 
 /*
@@ -27,6 +33,7 @@
 static const QUrl sRootUrl("owncloud://somehost/owncloud/remote.php/webdav/");
 static const QUrl sRootUrl2("owncloud://somehost/owncloud/remote.php/dav/files/admin/");
 static const QUrl sUploadUrl("owncloud://somehost/owncloud/remote.php/dav/uploads/admin/");
+static const QUrl sBulkUploadUrl("owncloud://somehost/owncloud/remote.php/dav/bulk");
 
 inline QString getFilePathFromUrl(const QUrl &url) {
     QString path = url.path();
@@ -47,6 +54,19 @@ inline QByteArray generateFileId() {
     return QByteArray::number(qrand(), 16);
 }
 
+/// Sets an environment variable until the end of the scope, even if a test fails early
+struct ScopedEnvironmentVariable
+{
+    ScopedEnvironmentVariable(const char *name, const QByteArray &value)
+        : _name(name)
+    {
+        qputenv(_name, value);
+    }
+    ~ScopedEnvironmentVariable() { qunsetenv(_name); }
+
+    const char *_name;
+};
+
 class PathComponents : public QStringList {
 public:
     PathComponents(const char *path) : PathComponents{QString::fromUtf8(path)} {}
@@ -311,6 +331,25 @@ private:
     }
 };
 
+/**
+ * Simulated network conditions of a FakeQNAM, see FakeQNAM::setNetworkConditions()
+ *
+ * A fake reply responds after the latency plus the time its payload
+ * needs at the given bandwidth. The bandwidth is shared by all the replies
+ * of the FakeQNAM: a payload is only sent once the previous ones are.
+ */
+struct FakeNetworkConditions
+{
+    int latencyMs = 0;
+    qint64 bytesPerSecond = 0; // 0 for unlimited
+};
+
+/**
+ * Invokes \a method of \a reply like a queued call, but delayed by the
+ * network conditions of the FakeQNAM that created it.
+ */
+inline void scheduleResponse(QNetworkReply *reply, const char *method, qint64 payloadSize = 0);
+
 class FakePropfindReply : public QNetworkReply
 {
     Q_OBJECT
@@ -328,7 +367,7 @@ public:
         Q_ASSERT(!fileName.isNull()); // for root, it should be empty
         const FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
         if (!fileInfo) {
-            QMetaObject::invokeMethod(this, "respond404", Qt::QueuedConnection);
+            scheduleResponse(this, "respond404");
             return;
         }
         QString prefix = request.url().path().left(request.url().path().size() - fileName.size());
@@ -378,7 +417,7 @@ public:
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond", payload.size());
     }
 
     Q_INVOKABLE void respond() {
@@ -438,7 +477,7 @@ public:
         }
         fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(request.rawHeader("X-OC-Mtime").toLongLong());
         remoteRootFileInfo.find(fileName, /*invalidate_etags=*/true);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond", putPayload.size());
     }
 
     Q_INVOKABLE void respond() {
@@ -455,6 +494,83 @@ public:
     qint64 readData(char *, qint64) override { return 0; }
 };
 
+// Stores the parts of a multipart bulk upload, see OCC::BulkUploadJob
+class FakeBulkUploadReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    QByteArray payload;
+
+    FakeBulkUploadReply(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+                        QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+                        const QByteArray &body, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        const QByteArray contentType = request.rawHeader("Content-Type");
+        const QByteArray delimiter = "--" + contentType.mid(contentType.indexOf("boundary=") + 9);
+        QJsonObject results;
+        int pos = body.indexOf(delimiter);
+        while (pos >= 0 && body.mid(pos + delimiter.size(), 2) == "\r\n") {
+            const int headersStart = pos + delimiter.size() + 2;
+            const int headersEnd = body.indexOf("\r\n\r\n", headersStart);
+            Q_ASSERT(headersEnd > 0);
+            QMap<QByteArray, QByteArray> headers;
+            foreach (const QByteArray &line, body.mid(headersStart, headersEnd - headersStart).split('\n')) {
+                const int colon = line.indexOf(':');
+                headers[line.left(colon)] = line.mid(colon + 1).trimmed();
+            }
+            const int size = headers["Content-Length"].toInt();
+            const QByteArray data = body.mid(headersEnd + 4, size);
+            pos = body.indexOf(delimiter, headersEnd + 4 + size);
+
+            const QString path = QString::fromUtf8(headers["X-File-Path"]);
+            const QString fileName = path.mid(1);
+            if (errorPaths.contains(fileName)) {
+                results[path] = QJsonObject{ { "error", true }, { "status", errorPaths[fileName] },
+                    { "message", QStringLiteral("Fake bulk upload error") } };
+                continue;
+            }
+            FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
+            if (fileInfo) {
+                fileInfo->size = data.size();
+                fileInfo->contentChar = data.at(0);
+            } else {
+                fileInfo = remoteRootFileInfo.create(fileName, data.size(), data.at(0));
+            }
+            fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(headers["X-OC-Mtime"].toLongLong());
+            remoteRootFileInfo.find(fileName, /*invalidate_etags=*/true);
+            results[path] = QJsonObject{ { "error", false }, { "etag", fileInfo->etag },
+                { "fileid", QString::fromUtf8(fileInfo->fileId) } };
+        }
+        payload = QJsonDocument(results).toJson();
+        scheduleResponse(this, "respond", body.size());
+    }
+
+    Q_INVOKABLE void respond() {
+        setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+        setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        emit finished();
+    }
+
+    void abort() override { }
+
+    qint64 bytesAvailable() const override { return payload.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{payload.size()}, maxlen);
+        std::memcpy(data, payload.constData(), len);
+        payload.remove(0, len);
+        return len;
+    }
+};
+
 class FakeMkcolReply : public QNetworkReply
 {
     Q_OBJECT
@@ -475,7 +591,7 @@ public:
             abort();
             return;
         }
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond");
     }
 
     Q_INVOKABLE void respond() {
@@ -503,7 +619,7 @@ public:
         QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isEmpty());
         remoteRootFileInfo.remove(fileName);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond");
     }
 
     Q_INVOKABLE void respond() {
@@ -532,7 +648,7 @@ public:
         QString dest = getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("Destination")));
         Q_ASSERT(!dest.isEmpty());
         remoteRootFileInfo.rename(fileName, dest);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond");
     }
 
     Q_INVOKABLE void respond() {
@@ -564,7 +680,7 @@ public:
         QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isEmpty());
         fileInfo = remoteRootFileInfo.find(fileName);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond", fileInfo ? fileInfo->size : 0);
     }
 
     Q_INVOKABLE void respond() {
@@ -576,8 +692,18 @@ public:
         }
         payload = fileInfo->contentChar;
         size = fileInfo->size;
+        int status = 200;
+        // Only closed ranges are honored, resumed downloads start from scratch
+        QRegExp closedRange("bytes=(\\d+)-(\\d+)");
+        if (closedRange.exactMatch(QString::fromLatin1(request().rawHeader("Range")))) {
+            const int start = closedRange.cap(1).toInt();
+            const int end = std::min(closedRange.cap(2).toInt(), size - 1);
+            setRawHeader("Content-Range", QString("bytes %1-%2/%3").arg(start).arg(end).arg(size).toLatin1());
+            size = end - start + 1;
+            status = 206;
+        }
         setHeader(QNetworkRequest::ContentLengthHeader, size);
-        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
         setRawHeader("OC-ETag", fileInfo->etag.toLatin1());
         setRawHeader("ETag", fileInfo->etag.toLatin1());
         setRawHeader("OC-FileId", fileInfo->fileId);
@@ -608,6 +734,51 @@ public:
 };
 
 
+class FakeBlockSignaturesReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    QByteArray payload;
+
+    FakeBlockSignaturesReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        const FileInfo *fileInfo = remoteRootFileInfo.find(getFilePathFromUrl(request.url()));
+        Q_ASSERT(fileInfo);
+        const qint64 blockSize = OCC::DeltaSync::blockSizeForFileSize(fileInfo->size);
+        const QByteArray content(fileInfo->size, fileInfo->contentChar);
+        payload = OCC::DeltaSync::serializeSignatures(
+            OCC::DeltaSync::computeSignatures(content.constData(), content.size(), blockSize));
+        setRawHeader("OC-Block-Size", QByteArray::number(blockSize));
+        setRawHeader("ETag", fileInfo->etag.toLatin1());
+        scheduleResponse(this, "respond", payload.size());
+    }
+
+    Q_INVOKABLE void respond() {
+        setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setFinished(true);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        emit finished();
+    }
+
+    void abort() override { }
+
+    qint64 bytesAvailable() const override { return payload.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{payload.size()}, maxlen);
+        memcpy(data, payload.constData(), len);
+        payload.remove(0, len);
+        return len;
+    }
+};
+
 class FakeChunkMoveReply : public QNetworkReply
 {
     Q_OBJECT
@@ -699,6 +870,41 @@ public:
 };
 
 
+// A successful reply with the given body, for endpoints that are not about files
+class FakePayloadReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    FakePayloadReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+                     const QByteArray &body, QObject *parent)
+    : QNetworkReply{parent}, _body(body) {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        scheduleResponse(this, "respond", _body.size());
+    }
+
+    Q_INVOKABLE void respond() {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setHeader(QNetworkRequest::ContentLengthHeader, _body.size());
+        emit metaDataChanged();
+        emit readyRead();
+        emit finished();
+    }
+
+    void abort() override { }
+    qint64 bytesAvailable() const override { return _body.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{_body.size()}, maxlen);
+        std::copy(_body.constBegin(), _body.constBegin() + len, data);
+        _body.remove(0, len);
+        return len;
+    }
+
+    QByteArray _body;
+};
+
 class FakeErrorReply : public QNetworkReply
 {
     Q_OBJECT
@@ -710,7 +916,7 @@ public:
         setUrl(request.url());
         setOperation(op);
         open(QIODevice::ReadOnly);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        scheduleResponse(this, "respond");
     }
 
     Q_INVOKABLE void respond() {
@@ -757,8 +963,15 @@ private:
     // monitor requests and optionally provide custom replies
     Override _override;
 
+    FakeNetworkConditions _networkConditions;
+    // Started once, the time the bandwidth is busy until is measured on it
+    QElapsedTimer _networkClock;
+    qint64 _linkBusyUntilMs = 0;
+
+    friend class FakeLaneQNAM;
+
 public:
-    FakeQNAM(FileInfo initialRoot) : _remoteRootFileInfo{std::move(initialRoot)} { }
+    FakeQNAM(FileInfo initialRoot) : _remoteRootFileInfo{std::move(initialRoot)} { _networkClock.start(); }
     FileInfo &currentRemoteState() { return _remoteRootFileInfo; }
     FileInfo &uploadState() { return _uploadFileInfo; }
 
@@ -766,6 +979,23 @@ public:
 
     void setOverride(const Override &override) { _override = override; }
 
+    /// Delays the fake replies, see scheduleResponse()
+    void setNetworkConditions(const FakeNetworkConditions &conditions) { _networkConditions = conditions; }
+
+    /// How long a reply with \a payloadSize bytes takes under the network conditions
+    qint64 responseDelayMs(qint64 payloadSize)
+    {
+        qint64 delayMs = _networkConditions.latencyMs;
+        if (_networkConditions.bytesPerSecond > 0) {
+            // The link is busy until the payloads of the earlier replies are through
+            const qint64 now = _networkClock.elapsed();
+            const qint64 sendStart = qMax(now, _linkBusyUntilMs);
+            _linkBusyUntilMs = sendStart + payloadSize * 1000 / _networkConditions.bytesPerSecond;
+            delayMs += _linkBusyUntilMs - now;
+        }
+        return delayMs;
+    }
+
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
                                          QIODevice *outgoingData = 0) {
@@ -773,6 +1003,8 @@ protected:
             if (auto reply = _override(op, request))
                 return reply;
         }
+        if (request.url().path() == sBulkUploadUrl.path())
+            return new FakeBulkUploadReply{_remoteRootFileInfo, _errorPaths, op, request, outgoingData->readAll(), this};
         const QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isNull());
         if (_errorPaths.contains(fileName))
@@ -785,10 +1017,27 @@ protected:
         if (verb == "PROPFIND")
             // Ignore outgoingData always returning somethign good enough, works for now.
             return new FakePropfindReply{info, op, request, this};
+        else if ((verb == QLatin1String("GET") || op == QNetworkAccessManager::GetOperation) && request.hasRawHeader("OC-Block-Signatures"))
+            return new FakeBlockSignaturesReply{info, op, request, this};
         else if (verb == QLatin1String("GET") || op == QNetworkAccessManager::GetOperation)
             return new FakeGetReply{info, op, request, this};
-        else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation)
-            return new FakePutReply{info, op, request, outgoingData->readAll(), this};
+        else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation) {
+            QByteArray payload = outgoingData->readAll();
+            if (request.rawHeader("Content-Encoding") == "gzip")
+                payload = OCC::TransferCompression::gunzip(payload);
+            if (isUpload && request.hasRawHeader("OC-Chunk-Source")) {
+                // A chunk copied from a range of the current remote file
+                Q_ASSERT(payload.isEmpty());
+                auto source = _remoteRootFileInfo.find(getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("OC-Chunk-Source"))));
+                const qint64 offset = request.rawHeader("OC-Chunk-Source-Offset").toLongLong();
+                const qint64 length = request.rawHeader("OC-Chunk-Source-Length").toLongLong();
+                if (!source || request.rawHeader("If-Match") != '"' + source->etag.toLatin1() + '"')
+                    return new FakeErrorReply{op, request, this, 412};
+                Q_ASSERT(length > 0 && offset + length <= source->size);
+                payload = QByteArray(length, source->contentChar);
+            }
+            return new FakePutReply{info, op, request, payload, this};
+        }
         else if (verb == QLatin1String("MKCOL"))
             return new FakeMkcolReply{info, op, request, this};
         else if (verb == QLatin1String("DELETE") || op == QNetworkAccessManager::DeleteOperation)
@@ -804,14 +1053,52 @@ protected:
     }
 };
 
+inline void scheduleResponse(QNetworkReply *reply, const char *method, qint64 payloadSize)
+{
+    qint64 delayMs = 0;
+    if (auto qnam = dynamic_cast<FakeQNAM *>(reply->parent())) {
+        delayMs = qnam->responseDelayMs(payloadSize);
+    }
+    if (delayMs <= 0) {
+        QMetaObject::invokeMethod(reply, method, Qt::QueuedConnection);
+        return;
+    }
+    QTimer::singleShot(delayMs, reply, [reply, method] { QMetaObject::invokeMethod(reply, method); });
+}
+
+/**
+ * One of the extra access managers of an account, see Account::setupTransferLanes().
+ * It serves the same remote state as the FakeQNAM it is created for.
+ */
+class FakeLaneQNAM : public QNetworkAccessManager
+{
+    FakeQNAM *_main;
+public:
+    FakeLaneQNAM(FakeQNAM *main) : _main{main} { }
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
+                                         QIODevice *outgoingData = 0) override {
+        return _main->createRequest(op, request, outgoingData);
+    }
+};
+
 class FakeCredentials : public OCC::AbstractCredentials
 {
-    QNetworkAccessManager *_qnam;
+    FakeQNAM *_qnam;
+    mutable bool _qnamCreated = false;
 public:
-    FakeCredentials(QNetworkAccessManager *qnam) : _qnam{qnam} { }
+    FakeCredentials(FakeQNAM *qnam) : _qnam{qnam} { }
     virtual QString authType() const { return "test"; }
     virtual QString user() const { return "admin"; }
-    virtual QNetworkAccessManager *createQNAM() const { return _qnam; }
+    virtual QNetworkAccessManager *createQNAM() const {
+        // The first one is the account's main access manager, the others are transfer lanes
+        if (!_qnamCreated) {
+            _qnamCreated = true;
+            return _qnam;
+        }
+        return new FakeLaneQNAM{_qnam};
+    }
     virtual bool ready() const { return true; }
     virtual void fetchFromKeychain() { }
     virtual void askFromUser() { }
@@ -881,6 +1168,7 @@ public:
     };
     ErrorList serverErrorPaths() { return {_fakeQnam}; }
     void setServerOverride(const FakeQNAM::Override &override) { _fakeQnam->setOverride(override); }
+    void setNetworkConditions(const FakeNetworkConditions &conditions) { _fakeQnam->setNetworkConditions(conditions); }
 
     QString localPath() const {
         // SyncEngine wants a trailing slash
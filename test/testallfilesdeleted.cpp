@@ -124,6 +124,38 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState().children.count(), 0);
     }
 
+    void testAllFilesDeletedWithNewFiles_data()
+    {
+        testAllFilesDeletedKeep_data();
+    }
+
+    /*
+     * The direction comes from the deleted side even if the other side has new files
+     */
+    void testAllFilesDeletedWithNewFiles()
+    {
+        QFETCH(bool, deleteOnRemote);
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+
+        int aboutToRemoveAllFilesCalled = 0;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToRemoveAllFiles,
+            [&](SyncFileItem::Direction dir, bool *cancel) {
+                aboutToRemoveAllFilesCalled++;
+                QCOMPARE(dir, deleteOnRemote ? SyncFileItem::Down : SyncFileItem::Up);
+                *cancel = true;
+            });
+
+        auto &modifier = deleteOnRemote ? fakeFolder.remoteModifier() : fakeFolder.localModifier();
+        auto &otherModifier = deleteOnRemote ? fakeFolder.localModifier() : fakeFolder.remoteModifier();
+        for (const auto &s : fakeFolder.currentRemoteState().children.keys())
+            modifier.remove(s);
+        for (int i = 0; i < 10; ++i)
+            otherModifier.insert(QString("new%1").arg(i));
+
+        QVERIFY(!fakeFolder.syncOnce()); // Should fail because we cancel the sync
+        QCOMPARE(aboutToRemoveAllFilesCalled, 1);
+    }
+
     void testNotDeleteMetaDataChange() {
         /**
          * This test make sure that we don't popup a file deleted message if all the metadata have
@@ -0,0 +1,114 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include "bandwidthmanager.h"
+
+using namespace OCC;
+
+class TestBandwidthManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testTokenBucket()
+    {
+        TokenBucket bucket;
+        // Without a rate nothing is limited
+        QCOMPARE(bucket.take(1000 * 1000), qint64(1000 * 1000));
+
+        bucket.setRate(100 * 1000);
+        QCOMPARE(bucket.capacity(), qint64(20 * 1000));
+        QCOMPARE(bucket.take(1), qint64(0));
+
+        // Tokens accumulate at the rate
+        bucket.refillFor(50);
+        QCOMPARE(bucket.available(), qint64(5000));
+        QCOMPARE(bucket.take(3000), qint64(3000));
+        QCOMPARE(bucket.take(3000), qint64(2000));
+        QCOMPARE(bucket.available(), qint64(0));
+
+        // Unused tokens can be returned
+        bucket.giveBack(500);
+        QCOMPARE(bucket.available(), qint64(500));
+
+        // Being idle only saves up a small burst
+        bucket.refillFor(10 * 1000);
+        QCOMPARE(bucket.available(), bucket.capacity());
+        bucket.giveBack(1000);
+        QCOMPARE(bucket.available(), bucket.capacity());
+
+        // Slow rates still allow one read buffer at a time
+        bucket.setRate(1000);
+        QCOMPARE(bucket.capacity(), qint64(16 * 1024));
+        QCOMPARE(bucket.available(), qint64(16 * 1024));
+    }
+
+    // An absolute limit caps the throughput of a sync
+    void testDownloadLimit()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().insert("A/big", 300 * 1000);
+        fakeFolder.syncEngine().setNetworkLimits(0, 100 * 1000);
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // Nearly three seconds, minus the burst the bucket saves up
+        QVERIFY(timer.elapsed() >= 2000);
+    }
+
+    // Folders that sync at the same time share the limit equally
+    void testDownloadLimitSharedByFolders()
+    {
+        FakeFolder fakeFolder1{ FileInfo::A12_B12_C12_S12() };
+        FakeFolder fakeFolder2{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder1.remoteModifier().insert("A/big", 150 * 1000);
+        fakeFolder2.remoteModifier().insert("A/big", 150 * 1000);
+        fakeFolder1.syncEngine().setNetworkLimits(0, 100 * 1000);
+        fakeFolder2.syncEngine().setNetworkLimits(0, 100 * 1000);
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 finished1 = -1;
+        qint64 finished2 = -1;
+        QObject::connect(&fakeFolder1.syncEngine(), &SyncEngine::finished, [&] { finished1 = timer.elapsed(); });
+        QObject::connect(&fakeFolder2.syncEngine(), &SyncEngine::finished, [&] { finished2 = timer.elapsed(); });
+        fakeFolder1.scheduleSync();
+        fakeFolder2.scheduleSync();
+        QTRY_VERIFY_WITH_TIMEOUT(finished1 >= 0 && finished2 >= 0, 30000);
+        QCOMPARE(fakeFolder1.currentLocalState(), fakeFolder1.currentRemoteState());
+        QCOMPARE(fakeFolder2.currentLocalState(), fakeFolder2.currentRemoteState());
+
+        // Together they get 100 kB/s, so each needs about three seconds.
+        // If one of them took the whole rate it would be done after half that.
+        QVERIFY(finished1 >= 2000);
+        QVERIFY(finished2 >= 2000);
+    }
+
+    // With a relative limit the transfers run unlimited while the link is
+    // measured, instead of waiting at the minimum rate for a first estimate
+    void testRelativeDownloadLimitProbe()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().insert("A/big", 1000 * 1000);
+        fakeFolder.syncEngine().setNetworkLimits(0, -50);
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // The minimum rate would need over a minute
+        QVERIFY(timer.elapsed() < 10 * 1000);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBandwidthManager)
+#include "testbandwidthmanager.moc"
@@ -0,0 +1,146 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+static SyncFileItemPtr findCompletedItem(const QSignalSpy &spy, const QString &path)
+{
+    for (const QList<QVariant> &args : spy) {
+        auto item = args[0].value<SyncFileItemPtr>();
+        if (item->destination() == path)
+            return item;
+    }
+    return SyncFileItemPtr();
+}
+
+class TestBulkUpload : public QObject
+{
+    Q_OBJECT
+
+    int _bulkRequests = 0;
+    int _putRequests = 0;
+
+    void countRequests(FakeFolder &fakeFolder)
+    {
+        _bulkRequests = 0;
+        _putRequests = 0;
+        fakeFolder.setServerOverride([this](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (request.url().path() == sBulkUploadUrl.path())
+                ++_bulkRequests;
+            else if (op == QNetworkAccessManager::PutOperation)
+                ++_putRequests;
+            return nullptr;
+        });
+    }
+
+private slots:
+
+    void testBulkUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+        countRequests(fakeFolder);
+
+        for (int i = 0; i < 5; ++i)
+            fakeFolder.localModifier().insert(QString("A/x%1").arg(i), 10 + i);
+        fakeFolder.localModifier().appendByte("A/a1");
+        // Alone in its directory: no batch
+        fakeFolder.localModifier().insert("B/y1", 10);
+        // Too big for a batch
+        fakeFolder.localModifier().insert("A/big", 200 * 1000);
+
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), SIGNAL(itemCompleted(const SyncFileItemPtr &)));
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(_bulkRequests, 1);
+        QCOMPARE(_putRequests, 2);
+
+        // The results are mapped back to the items and stored in the journal
+        for (const QString &path : { "A/x0", "A/x4", "A/a1" }) {
+            auto item = findCompletedItem(completeSpy, path);
+            QVERIFY(item);
+            QCOMPARE(item->_status, SyncFileItem::Success);
+            QCOMPARE(QString::fromLatin1(item->_etag), fakeFolder.currentRemoteState().find(path)->etag);
+            SyncJournalFileRecord record;
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(path, &record));
+            QCOMPARE(record._fileId, fakeFolder.currentRemoteState().find(path)->fileId);
+        }
+
+        // Nothing left to do
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(_bulkRequests, 1);
+        QCOMPARE(_putRequests, 2);
+    }
+
+    void testWithoutCapability()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        countRequests(fakeFolder);
+
+        fakeFolder.localModifier().insert("A/x1", 10);
+        fakeFolder.localModifier().insert("A/x2", 10);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(_bulkRequests, 0);
+        QCOMPARE(_putRequests, 2);
+    }
+
+    void testPartialFailure()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+        countRequests(fakeFolder);
+
+        fakeFolder.localModifier().insert("A/x1", 10);
+        fakeFolder.localModifier().insert("A/x2", 10);
+        fakeFolder.localModifier().insert("A/x3", 10);
+        fakeFolder.serverErrorPaths().append("A/x2", 500);
+
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), SIGNAL(itemCompleted(const SyncFileItemPtr &)));
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(_bulkRequests, 1);
+        QCOMPARE(findCompletedItem(completeSpy, "A/x1")->_status, SyncFileItem::Success);
+        QCOMPARE(findCompletedItem(completeSpy, "A/x2")->_status, SyncFileItem::NormalError);
+        QCOMPARE(findCompletedItem(completeSpy, "A/x2")->_httpErrorCode, 500);
+        QCOMPARE(findCompletedItem(completeSpy, "A/x3")->_status, SyncFileItem::Success);
+        QVERIFY(fakeFolder.currentRemoteState().find("A/x1"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("A/x2"));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/x3"));
+
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncEngine().journal()->wipeErrorBlacklist();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testRequestFailure()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+
+        fakeFolder.localModifier().insert("A/x1", 10);
+        fakeFolder.localModifier().insert("A/x2", 10);
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (request.url().path() == sBulkUploadUrl.path())
+                return new FakeErrorReply{ op, request, this, 507 };
+            return nullptr;
+        });
+
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), SIGNAL(itemCompleted(const SyncFileItemPtr &)));
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(findCompletedItem(completeSpy, "A/x1")->_status, SyncFileItem::DetailError);
+        QCOMPARE(findCompletedItem(completeSpy, "A/x2")->_status, SyncFileItem::DetailError);
+        QVERIFY(!fakeFolder.currentRemoteState().find("A/x1"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBulkUpload)
+#include "testbulkupload.moc"
@@ -0,0 +1,78 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "changenotifier.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+class TestChangeNotifier : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testNoEndpoint()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        int polls = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request) -> QNetworkReply * {
+            if (request.url().path().endsWith("/changes"))
+                ++polls;
+            return nullptr;
+        });
+
+        ChangeNotifier notifier(fakeFolder.syncEngine().account());
+        notifier.start();
+        QTest::qWait(100);
+        QCOMPARE(polls, 0);
+        QVERIFY(!notifier.isHealthy());
+    }
+
+    void testNotifications()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "changeNotifications", "ocs/v2.php/apps/notify/changes" } } } });
+
+        QStringList cursors;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (!request.url().path().endsWith("/changes"))
+                return nullptr;
+            const QString cursor = QUrlQuery(request.url()).queryItemValue("cursor");
+            cursors.append(cursor);
+            if (cursor.isEmpty())
+                return new FakePayloadReply(op, request, R"({ "cursor": "1", "changes": [] })", this);
+            if (cursor == "1")
+                return new FakePayloadReply(op, request, R"({ "cursor": "2", "changes": [ "/A/a1", "/B" ] })", this);
+            return new FakeErrorReply{ op, request, this, 503 };
+        });
+
+        ChangeNotifier notifier(fakeFolder.syncEngine().account());
+        QSignalSpy changed(&notifier, &ChangeNotifier::remoteChanged);
+        QSignalSpy health(&notifier, &ChangeNotifier::healthChanged);
+        notifier.start();
+
+        // The first poll only fetches the cursor
+        QVERIFY(changed.wait());
+        QCOMPARE(changed.size(), 1);
+        QCOMPARE(changed[0][0].toStringList(), QStringList() << "/A/a1" << "/B");
+        QCOMPARE(cursors, QStringList() << "" << "1");
+        QVERIFY(notifier.isHealthy());
+
+        // A failed poll is retried later
+        QTRY_VERIFY(!notifier.isHealthy());
+        QCOMPARE(cursors, QStringList() << "" << "1" << "2");
+        QCOMPARE(health.size(), 2);
+
+        notifier.stop();
+        QCOMPARE(health.size(), 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestChangeNotifier)
+#include "testchangenotifier.moc"
@@ -146,6 +146,41 @@ using namespace OCC;
 #endif
     }
 
+    void testStreamingChecksum() {
+        QFile file(_testfile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray data = file.readAll();
+
+        QList<QByteArray> types;
+        types << checkSumMD5C << checkSumSHA1C;
+#ifdef ZLIB_FOUND
+        types << checkSumAdlerC;
+#endif
+        foreach (const QByteArray &type, types) {
+            StreamingChecksum checksum(type);
+            QVERIFY(checksum.isValid());
+            // Feed the data in uneven pieces
+            for (int pos = 0; pos < data.size(); pos += 1000) {
+                checksum.addData(data.constData() + pos, qMin(1000, data.size() - pos));
+            }
+            QCOMPARE(checksum.result(), ComputeChecksum::computeNow(_testfile, type));
+        }
+
+        QVERIFY(!StreamingChecksum("Klaas32").isValid());
+
+        // Validating a precomputed checksum does not need the file
+        _successDown = false;
+        ValidateChecksumHeader vali;
+        connect(&vali, SIGNAL(validated(QByteArray,QByteArray)), this, SLOT(slotDownValidated()));
+        connect(&vali, SIGNAL(validationFailed(QString)), this, SLOT(slotDownError(QString)));
+        vali.startWithComputedChecksum("MD5:" + FileSystem::calcMd5(_testfile), checkSumMD5C, FileSystem::calcMd5(_testfile));
+        QVERIFY(_successDown);
+
+        _expectedError = QLatin1String("The downloaded file does not match the checksum, it will be resumed.");
+        _errorSeen = false;
+        vali.startWithComputedChecksum("MD5:bad", checkSumMD5C, FileSystem::calcMd5(_testfile));
+        QVERIFY(_errorSeen);
+    }
 
     void cleanupTestCase() {
     }
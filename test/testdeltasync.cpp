@@ -0,0 +1,308 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "deltasync.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+static QByteArray randomData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i)
+        data[i] = static_cast<char>(qrand());
+    return data;
+}
+
+// Rebuilds the new version from the old one and the literal data of the new one
+static QByteArray applyDelta(const QByteArray &oldData, const QByteArray &newData, const QVector<DeltaSync::Segment> &segments)
+{
+    QByteArray result;
+    for (const auto &segment : segments) {
+        if (segment.isReused())
+            result += oldData.mid(segment._sourceOffset, segment._size);
+        else
+            result += newData.mid(segment._offset, segment._size);
+    }
+    return result;
+}
+
+class TestDeltaSync : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testWeakChecksumRolls()
+    {
+        // The checksum of a window must not depend on how it was reached
+        const QByteArray data = randomData(1000);
+        const QByteArray block = data.mid(500, 100);
+        const auto signatures = DeltaSync::computeSignatures(block.constData(), block.size(), 100);
+        QCOMPARE(signatures.size(), 1);
+        QCOMPARE(signatures[0]._weak, DeltaSync::weakChecksum(block.constData(), block.size()));
+
+        const auto segments = DeltaSync::computeDelta(data.constData(), data.size(), 100, signatures);
+        QCOMPARE(segments.size(), 3);
+        QVERIFY(segments[1].isReused());
+        QCOMPARE(segments[1]._offset, qint64(500));
+        QCOMPARE(segments[1]._sourceOffset, qint64(0));
+    }
+
+    void testDelta()
+    {
+        const qint64 blockSize = 4096;
+        const QByteArray oldData = randomData(100 * blockSize + 123);
+        const auto signatures = DeltaSync::computeSignatures(oldData.constData(), oldData.size(), blockSize);
+        QCOMPARE(signatures.size(), 100);
+
+        // An insertion shifts everything after it, a modification breaks one block
+        QByteArray newData = oldData;
+        newData.insert(30 * blockSize + 10, randomData(77));
+        newData[70 * blockSize] = ~newData[70 * blockSize];
+
+        const auto segments = DeltaSync::computeDelta(newData.constData(), newData.size(), blockSize, signatures);
+        QCOMPARE(applyDelta(oldData, newData, segments), newData);
+
+        qint64 reused = 0;
+        qint64 expectedOffset = 0;
+        for (const auto &segment : segments) {
+            QCOMPARE(segment._offset, expectedOffset);
+            expectedOffset += segment._size;
+            if (segment.isReused())
+                reused += segment._size;
+        }
+        QCOMPARE(expectedOffset, qint64(newData.size()));
+        // Only the two damaged blocks are missing
+        QCOMPARE(reused, 98 * blockSize);
+
+        // Unrelated data reuses nothing
+        const QByteArray other = randomData(oldData.size());
+        const auto otherSegments = DeltaSync::computeDelta(other.constData(), other.size(), blockSize, signatures);
+        QCOMPARE(otherSegments.size(), 1);
+        QVERIFY(!otherSegments[0].isReused());
+    }
+
+    void testSerialization()
+    {
+        const QByteArray data = randomData(10 * 1000);
+        const auto signatures = DeltaSync::computeSignatures(data.constData(), data.size(), 1000);
+        const auto restored = DeltaSync::deserializeSignatures(DeltaSync::serializeSignatures(signatures));
+        QCOMPARE(restored.size(), signatures.size());
+        for (int i = 0; i < signatures.size(); ++i) {
+            QCOMPARE(restored[i]._weak, signatures[i]._weak);
+            QCOMPARE(restored[i]._strong, signatures[i]._strong);
+        }
+        QVERIFY(DeltaSync::deserializeSignatures("garbage").isEmpty());
+    }
+
+    void testDeltaUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" }, { "chunkingReuse", "1.0" } } } });
+        SyncOptions options;
+        options._initialChunkSize = 1000 * 1000;
+        options._targetChunkUploadDuration = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        int reusedChunks = 0;
+        int dataChunks = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                if (request.hasRawHeader("OC-Chunk-Source"))
+                    ++reusedChunks;
+                else
+                    ++dataChunks;
+            }
+            return nullptr;
+        });
+
+        // A new file has nothing to reuse, it isn't analyzed
+        const int size = 5 * 1000 * 1000;
+        fakeFolder.localModifier().insert("A/big", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(reusedChunks, 0);
+        QCOMPARE(dataChunks, 5);
+        QVERIFY(fakeFolder.syncJournal().getBlockSignatures("A/big")._signatures.isEmpty());
+
+        // The first update records the signatures of the version on the server
+        reusedChunks = dataChunks = 0;
+        fakeFolder.localModifier().appendByte("A/big");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(reusedChunks, 0);
+        QCOMPARE(dataChunks, 6);
+        QVERIFY(!fakeFolder.syncJournal().getBlockSignatures("A/big")._signatures.isEmpty());
+
+        // Only the end of the file is sent again
+        reusedChunks = dataChunks = 0;
+        fakeFolder.localModifier().appendByte("A/big");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/big")->size, size + 2);
+        QCOMPARE(reusedChunks, 1);
+        QCOMPARE(dataChunks, 1);
+
+        // Files below the size threshold are not analyzed
+        fakeFolder.localModifier().insert("A/medium", 1040 * 1000);
+        QVERIFY(fakeFolder.syncOnce());
+        fakeFolder.localModifier().appendByte("A/medium");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.syncJournal().getBlockSignatures("A/medium")._signatures.isEmpty());
+
+        // New content has nothing to reuse
+        reusedChunks = dataChunks = 0;
+        fakeFolder.localModifier().setContents("A/big", 'X');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(reusedChunks, 0);
+        QCOMPARE(dataChunks, 6);
+
+        // When the server version changed the signatures are not used
+        reusedChunks = dataChunks = 0;
+        fakeFolder.remoteModifier().appendByte("A/big");
+        QVERIFY(fakeFolder.syncOnce());
+        fakeFolder.localModifier().appendByte("A/big");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(reusedChunks, 0);
+    }
+
+    void testPatchFile()
+    {
+        QTemporaryDir dir;
+        const qint64 blockSize = 4096;
+        const QByteArray oldData = randomData(50 * blockSize);
+        // A new block, then two blocks that repeat the start and a tail
+        QByteArray newData = oldData;
+        newData.insert(10 * blockSize, randomData(blockSize));
+        newData.append(oldData.mid(0, 2 * blockSize));
+        newData.append(randomData(100));
+
+        QFile source(dir.path() + "/source");
+        QVERIFY(source.open(QIODevice::WriteOnly));
+        source.write(oldData);
+        source.close();
+
+        const QString target = dir.path() + "/target";
+        const auto signatures = DeltaSync::serializeSignatures(
+            DeltaSync::computeSignatures(newData.constData(), newData.size(), blockSize));
+        const auto patch = DeltaSync::patchFile(source.fileName(), target, newData.size(), blockSize, signatures);
+        QVERIFY(patch._valid);
+
+        // Filling the missing ranges gives the new version
+        QFile result(target);
+        QVERIFY(result.open(QIODevice::ReadWrite));
+        QCOMPARE(result.size(), qint64(newData.size()));
+        qint64 missingBytes = 0;
+        for (const auto &segment : patch._missing) {
+            result.seek(segment._offset);
+            result.write(newData.mid(segment._offset, segment._size));
+            missingBytes += segment._size;
+        }
+        QVERIFY(result.seek(0));
+        QCOMPARE(result.readAll(), newData);
+        QCOMPARE(patch._reusedBytes + missingBytes, qint64(newData.size()));
+        // Only the new block and the tail are missing
+        QCOMPARE(patch._missing.size(), 2);
+        QCOMPARE(patch._missing[0]._offset, 10 * blockSize);
+        QCOMPARE(patch._missing[0]._size, blockSize);
+        QCOMPARE(patch._reusedBytes, 52 * blockSize);
+
+        // Signatures of another size are refused
+        QVERIFY(!DeltaSync::patchFile(source.fileName(), target, newData.size() + blockSize, blockSize, signatures)._valid);
+    }
+
+    void testDeltaDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "blockSignatures", "1.0" } } } });
+
+        int signatureRequests = 0;
+        int fullDownloads = 0;
+        QList<QByteArray> ranges;
+        SyncJournalDb::DownloadInfo rangeDownloadInfo;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation) {
+                if (request.hasRawHeader("OC-Block-Signatures")) {
+                    ++signatureRequests;
+                } else if (request.hasRawHeader("Range")) {
+                    ranges.append(request.rawHeader("Range"));
+                    rangeDownloadInfo = fakeFolder.syncJournal().getDownloadInfo("A/big");
+                } else {
+                    ++fullDownloads;
+                }
+            }
+            return nullptr;
+        });
+
+        const int size = 5 * 1000 * 1000;
+        fakeFolder.remoteModifier().insert("A/big", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(signatureRequests, 0);
+        QCOMPARE(fullDownloads, 1);
+
+        // Only the end of the file is downloaded
+        signatureRequests = fullDownloads = 0;
+        fakeFolder.remoteModifier().appendByte("A/big");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(signatureRequests, 1);
+        QCOMPARE(fullDownloads, 0);
+        const qint64 tailStart = (size + 1) / DeltaSync::blockSizeForFileSize(size + 1) * DeltaSync::blockSizeForFileSize(size + 1);
+        QCOMPARE(ranges, QList<QByteArray>() << "bytes=" + QByteArray::number(tailStart) + "-" + QByteArray::number(size));
+
+        // The temporary file was recorded while the ranges were downloaded, and is gone
+        QVERIFY(rangeDownloadInfo._valid);
+        QVERIFY(!QFileInfo::exists(fakeFolder.localPath() + rangeDownloadInfo._tmpfile));
+        QVERIFY(!fakeFolder.syncJournal().getDownloadInfo("A/big")._valid);
+
+        // New content has no blocks in common
+        signatureRequests = fullDownloads = 0;
+        ranges.clear();
+        fakeFolder.remoteModifier().setContents("A/big", 'X');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(signatureRequests, 1);
+        QCOMPARE(fullDownloads, 1);
+        QVERIFY(ranges.isEmpty());
+
+        // The blocks left behind by an interrupted delta download are not resumed
+        signatureRequests = fullDownloads = 0;
+        ranges.clear();
+        fakeFolder.remoteModifier().appendByte("A/big");
+        {
+            SyncJournalDb::DownloadInfo interrupted;
+            interrupted._etag = fakeFolder.currentRemoteState().find("A/big")->etag.toUtf8();
+            interrupted._tmpfile = "A/.big.~p1234";
+            interrupted._valid = true;
+            fakeFolder.syncJournal().setDownloadInfo("A/big", interrupted);
+            QFile leftover(fakeFolder.localPath() + interrupted._tmpfile);
+            QVERIFY(leftover.open(QFile::WriteOnly));
+            leftover.write(QByteArray(size + 2, 'Y'));
+        }
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!QFileInfo::exists(fakeFolder.localPath() + "A/.big.~p1234"));
+        QCOMPARE(signatureRequests, 1);
+
+        // Small files are downloaded as usual
+        signatureRequests = fullDownloads = 0;
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(signatureRequests, 0);
+        QCOMPARE(fullDownloads, 1);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestDeltaSync)
+#include "testdeltasync.moc"
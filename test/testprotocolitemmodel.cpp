@@ -0,0 +1,183 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+#include <QAbstractItemModelTester>
+#endif
+
+#include "protocolitemmodel.h"
+#include "activityitemdelegate.h"
+#include "folderman.h"
+
+using namespace OCC;
+
+// The real one needs the fonts of a gui application
+int ActivityItemDelegate::rowHeight()
+{
+    return 20;
+}
+
+static ProtocolItem fileLine(int i)
+{
+    SyncFileItem item;
+    item._file = QString("file%1").arg(i);
+    item._originalFile = item._file;
+    item._status = SyncFileItem::Success;
+    item._instruction = CSYNC_INSTRUCTION_NEW;
+    item._direction = SyncFileItem::Down;
+    return ProtocolItem::fromSyncFileItem("folder", item);
+}
+
+static QVector<ProtocolItem> fileLines(int first, int count)
+{
+    QVector<ProtocolItem> lines;
+    for (int i = first; i < first + count; ++i)
+        lines.append(fileLine(i));
+    return lines;
+}
+
+// The files of the rows, oldest first
+static QStringList rowFiles(const ProtocolItemModel &model)
+{
+    QStringList files;
+    for (int row = 0; row < model.rowCount(); ++row)
+        files.append(model.index(row, 1).data(Qt::ToolTipRole).toString());
+    return files;
+}
+
+static QStringList fileNames(int first, int count)
+{
+    QStringList files;
+    for (int i = first; i < first + count; ++i)
+        files.append(QString("file%1").arg(i));
+    return files;
+}
+
+class TestProtocolItemModel : public QObject
+{
+    Q_OBJECT
+
+    FolderMan _fm;
+
+    static QStringList headers() { return { "Time", "File", "Folder", "Action", "Size" }; }
+
+    static void attachTester(ProtocolItemModel *model)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        new QAbstractItemModelTester(model, QAbstractItemModelTester::FailureReportingMode::QtTest, model);
+#else
+        Q_UNUSED(model);
+#endif
+    }
+
+private slots:
+    void testFill()
+    {
+        ProtocolItemModel model(5, headers());
+        attachTester(&model);
+
+        model.addItems(fileLines(0, 2));
+        model.addItems(fileLines(2, 3));
+        QCOMPARE(model.rowCount(), 5);
+        QVERIFY(model.isFull());
+        QCOMPARE(rowFiles(model), fileNames(0, 5));
+    }
+
+    void testOverflow()
+    {
+        ProtocolItemModel model(5, headers());
+        attachTester(&model);
+        QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+
+        // Part of the batch fills the free rows, the rest replaces the oldest lines
+        model.addItems(fileLines(0, 3));
+        model.addItems(fileLines(3, 4));
+        QCOMPARE(rowFiles(model), fileNames(2, 5));
+        QCOMPARE(removed.count(), 1);
+
+        // Around the end of the buffer more than once
+        for (int i = 7; i < 20; i += 2) {
+            model.addItems(fileLines(i, 2));
+            QCOMPARE(rowFiles(model), fileNames(i - 3, 5));
+        }
+    }
+
+    void testBatchLargerThanCapacity()
+    {
+        ProtocolItemModel model(5, headers());
+        attachTester(&model);
+
+        // Only the newest lines of the batch are kept
+        model.addItems(fileLines(0, 12));
+        QCOMPARE(rowFiles(model), fileNames(7, 5));
+
+        model.addItems(fileLines(12, 2));
+        model.addItems(fileLines(14, 8));
+        QCOMPARE(rowFiles(model), fileNames(17, 5));
+
+        ProtocolItemModel partial(5, headers());
+        attachTester(&partial);
+        partial.addItems(fileLines(0, 2));
+        partial.addItems(fileLines(2, 9));
+        QCOMPARE(rowFiles(partial), fileNames(6, 5));
+    }
+
+    void testRemoveAfterWrap()
+    {
+        ProtocolItemModel model(5, headers());
+        attachTester(&model);
+
+        model.addItems(fileLines(0, 8));
+        QCOMPARE(rowFiles(model), fileNames(3, 5));
+
+        // The rows stay in order after the buffer was rotated back
+        model.removeItems([](const ProtocolItem &line) {
+            return line._file == "file4" || line._file == "file5" || line._file == "file7";
+        });
+        QCOMPARE(rowFiles(model), QStringList({ "file3", "file6" }));
+        QVERIFY(!model.isFull());
+
+        // The free rows are used again before the oldest lines are replaced
+        model.addItems(fileLines(8, 4));
+        QCOMPARE(rowFiles(model), QStringList({ "file6", "file8", "file9", "file10", "file11" }));
+
+        model.removeItems([](const ProtocolItem &) { return true; });
+        QCOMPARE(model.rowCount(), 0);
+        model.addItems(fileLines(12, 1));
+        QCOMPARE(rowFiles(model), fileNames(12, 1));
+    }
+
+    void testNewestOnTop()
+    {
+        ProtocolItemModel model(100, headers());
+        ProtocolSortFilterModel sortModel(&model);
+        sortModel.sort(0, Qt::DescendingOrder);
+
+        // Lines of a batch usually share the millisecond
+        QVector<ProtocolItem> lines = fileLines(0, 20);
+        for (auto &line : lines)
+            line._timestamp = lines.first()._timestamp;
+        model.addItems(lines);
+        model.addItems(fileLines(20, 3));
+
+        QCOMPARE(sortModel.rowCount(), 23);
+        for (int row = 0; row < sortModel.rowCount(); ++row) {
+            QCOMPARE(sortModel.item(sortModel.index(row, 0))._file, QString("file%1").arg(22 - row));
+        }
+
+        // Folder-wide errors go to the top, newest first as well
+        model.addItems({ ProtocolItem::fromError("folder", "first", ErrorCategory::Normal),
+            ProtocolItem::fromError("folder", "second", ErrorCategory::Normal) });
+        QCOMPARE(sortModel.item(sortModel.index(0, 0))._message, QString("second"));
+        QCOMPARE(sortModel.item(sortModel.index(1, 0))._message, QString("first"));
+        QCOMPARE(sortModel.item(sortModel.index(2, 0))._file, QString("file22"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestProtocolItemModel)
+#include "testprotocolitemmodel.moc"
@@ -31,6 +31,21 @@ bool itemDidCompleteSuccessfully(const QSignalSpy &spy, const QString &path)
     return false;
 }
 
+// A transfer that only fails once it is released
+class SlowTransferReply : public FakeHangingReply
+{
+public:
+    using FakeHangingReply::FakeHangingReply;
+
+    void release()
+    {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 503);
+        setError(InternalServerError, "Released slow transfer");
+        emit metaDataChanged();
+        emit finished();
+    }
+};
+
 class TestSyncEngine : public QObject
 {
     Q_OBJECT
@@ -510,6 +525,11 @@ private slots:
         QVERIFY(fakeFolder.syncOnce());
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
 
+        // The content checksum was computed during the download as well
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/a5"), &record));
+        QCOMPARE(record._checksumHeader, QByteArray("SHA1:19b1928d58a2030d08023f3d7054516dbc186f20"));
+
         // Invalid OC-Checksum is ignored
         checksumValue = "garbage";
         // contentMd5Value is still good
@@ -636,6 +656,308 @@ private slots:
 
         QTextCodec::setCodecForLocale(utf8Locale);
     }
+
+    // Big transfers must not hold back the creation of a new directory tree
+    void testMetadataRequestsBesideTransfers()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        for (int i = 0; i < 3; ++i)
+            fakeFolder.localModifier().insert(QString("A/big%1").arg(i), 1000 * 1000);
+        QStringList dirs;
+        for (int i = 0; i < 4; ++i) {
+            QString path = QString("T%1").arg(i);
+            for (int depth = 0; depth < 3; ++depth) {
+                fakeFolder.localModifier().mkdir(path);
+                dirs.append(path);
+                path += QString("/sub%1").arg(depth);
+            }
+        }
+
+        QObject parent;
+        QList<SlowTransferReply *> transfers;
+        int mkcolBesideTransfers = 0;
+        auto releaseTransfers = [&]() {
+            for (auto reply : transfers)
+                reply->release();
+            transfers.clear();
+        };
+        // Don't hang if the directories are never created
+        QTimer::singleShot(5000, &parent, releaseTransfers);
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                auto reply = new SlowTransferReply(op, request, &parent);
+                transfers.append(reply);
+                return reply;
+            }
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "MKCOL") {
+                if (transfers.size() == 3)
+                    ++mkcolBesideTransfers;
+                if (mkcolBesideTransfers == dirs.size())
+                    QTimer::singleShot(0, &parent, releaseTransfers);
+            }
+            return nullptr;
+        });
+
+        QVERIFY(!fakeFolder.syncOnce()); // the transfers fail
+        QCOMPARE(mkcolBesideTransfers, dirs.size());
+        for (const auto &dir : dirs)
+            QVERIFY(fakeFolder.currentRemoteState().find(dir));
+    }
+
+    // Useful files are propagated first, without breaking the directory order
+    void testPropagationPriority()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions syncOptions;
+        syncOptions._parallelNetworkJobs = false;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        QStringList putOrder;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation)
+                putOrder.append(request.url().path().section('/', -2));
+            return nullptr;
+        });
+
+        auto now = QDateTime::currentDateTimeUtc();
+        fakeFolder.localModifier().mkdir("N");
+        fakeFolder.localModifier().insert("N/a_medium", 200 * 1000);
+        fakeFolder.localModifier().insert("N/b_small", 10);
+        fakeFolder.localModifier().setModTime("N/b_small", now.addSecs(-3600));
+        fakeFolder.localModifier().insert("N/c_old", 10);
+        fakeFolder.localModifier().setModTime("N/c_old", now.addSecs(-7200));
+        fakeFolder.localModifier().insert("N/d_new", 10);
+        fakeFolder.localModifier().setModTime("N/d_new", now.addSecs(-10));
+        fakeFolder.localModifier().mkdir("P");
+        fakeFolder.localModifier().insert("P/y", 10);
+        fakeFolder.localModifier().mkdir("Q");
+        fakeFolder.localModifier().insert("Q/x", 10);
+
+        // The user looks at P
+        fakeFolder.syncEngine().prioritizePath("P/y");
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(putOrder.size(), 6);
+        QCOMPARE(putOrder.first(), QString("P/y"));
+        int first = putOrder.indexOf("N/d_new");
+        QVERIFY(first > 0);
+        QCOMPARE(putOrder.mid(first, 4), QStringList() << "N/d_new" << "N/b_small" << "N/c_old" << "N/a_medium");
+        QCOMPARE(putOrder.last(), QString("Q/x"));
+    }
+
+    // A directory the user starts looking at during the propagation goes next
+    void testPrioritizeWhilePropagating()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions syncOptions;
+        syncOptions._parallelNetworkJobs = false;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        QStringList putOrder;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                putOrder.append(request.url().path().section('/', -2));
+                if (putOrder.size() == 1)
+                    fakeFolder.syncEngine().prioritizePath("Q/x");
+            }
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().mkdir("N");
+        for (int i = 0; i < 3; ++i)
+            fakeFolder.localModifier().insert(QString("N/f%1").arg(i), 10);
+        fakeFolder.localModifier().mkdir("P");
+        fakeFolder.localModifier().insert("P/y", 10);
+        fakeFolder.localModifier().mkdir("Q");
+        fakeFolder.localModifier().insert("Q/x", 10);
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(putOrder.size(), 5);
+        QVERIFY(putOrder.first().startsWith("N/"));
+        QCOMPARE(putOrder.at(1), QString("Q/x"));
+        QCOMPARE(putOrder.last(), QString("P/y"));
+    }
+
+    void testNetworkLaneStats()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().insert("A/new", 100);
+        QVERIFY(fakeFolder.syncOnce());
+
+        auto stats = fakeFolder.syncEngine().account()->networkLaneStats();
+        QVERIFY(!stats.isEmpty());
+        QCOMPARE(stats.first()._name, QString("metadata"));
+        QVERIFY(stats.first()._requests > 0);
+        QCOMPARE(stats.first()._activeRequests, 0);
+    }
+
+    // File transfers are spread over the transfer lanes, metadata requests stay on the main one
+    void testTransferLanes()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path()); // we don't want to pollute the user's config file
+        QSettings(ConfigFile().configFile(), QSettings::IniFormat).setValue("transferNetworkManagers", 2);
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // Replies take a moment, so that the transfers overlap
+        FakeNetworkConditions conditions;
+        conditions.latencyMs = 50;
+        fakeFolder.setNetworkConditions(conditions);
+        int nTransfers = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation || op == QNetworkAccessManager::PutOperation)
+                ++nTransfers;
+            return nullptr;
+        });
+        auto before = fakeFolder.syncEngine().account()->networkLaneStats();
+        QCOMPARE(before.size(), 3);
+
+        fakeFolder.localModifier().insert("A/up1", 100);
+        fakeFolder.localModifier().insert("B/up2", 100);
+        fakeFolder.remoteModifier().insert("C/down1", 100);
+        fakeFolder.remoteModifier().insert("C/down2", 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        auto stats = fakeFolder.syncEngine().account()->networkLaneStats();
+        QCOMPARE(stats.at(0)._name, QString("metadata"));
+        QVERIFY(stats.at(0)._requests > before.at(0)._requests);
+        const qint64 lane1 = stats.at(1)._requests - before.at(1)._requests;
+        const qint64 lane2 = stats.at(2)._requests - before.at(2)._requests;
+        QCOMPARE(lane1 + lane2, qint64(nTransfers));
+        QCOMPARE(nTransfers, 4);
+        // The least busy lane is picked, so both of them carried transfers
+        QVERIFY(lane1 > 0);
+        QVERIFY(lane2 > 0);
+    }
+
+    void testDownloadFromLocalCopy()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        FileInfo &remoteInfo = dynamic_cast<FileInfo &>(fakeFolder.remoteModifier());
+
+        int nGET = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ++nGET;
+            return nullptr;
+        });
+
+        // The upload records the checksum of the content
+        const int size = 100 * 1000;
+        const QByteArray checksum = "SHA1:" + QCryptographicHash::hash(QByteArray(size, 'D'), QCryptographicHash::Sha1).toHex();
+        fakeFolder.localModifier().insert("A/data", size, 'D');
+        QVERIFY(fakeFolder.syncOnce());
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/data"), &record));
+        QCOMPARE(record._checksumHeader, checksum);
+
+        // The same content at another path is copied
+        fakeFolder.remoteModifier().insert("B/copy", size, 'D');
+        remoteInfo.find("B/copy")->checksums = checksum;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nGET, 0);
+
+        // A local file that changed unnoticed fails the validation
+        fakeFolder.localModifier().setContents("A/data", 'E');
+        fakeFolder.localModifier().setModTime("A/data", Utility::qDateTimeFromTime_t(record._modtime));
+        fakeFolder.localModifier().remove("B/copy");
+        fakeFolder.remoteModifier().insert("C/copy", size, 'D');
+        remoteInfo.find("C/copy")->checksums = checksum;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nGET, 1);
+        FileInfo localState = fakeFolder.currentLocalState();
+        FileInfo remoteState = fakeFolder.currentRemoteState();
+        QCOMPARE(*localState.find("C/copy"), *remoteState.find("C/copy"));
+    }
+
+    // The size totals are kept up to date as transfers progress and complete
+    void testProgressTotals()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().insert("A/big", 3 * 1000 * 1000);
+        fakeFolder.remoteModifier().insert("B/big", 2 * 1000 * 1000);
+        fakeFolder.localModifier().insert("C/small");
+
+        quint64 lastCompleted = 0;
+        bool monotonic = true;
+        auto con = QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress,
+            [&](const ProgressInfo &progress) {
+                if (progress.status() != ProgressInfo::Propagation)
+                    return;
+                monotonic = monotonic && progress.completedSize() >= lastCompleted
+                    && progress.completedSize() <= progress.totalSize();
+                lastCompleted = progress.completedSize();
+            });
+        QVERIFY(fakeFolder.syncOnce());
+        QObject::disconnect(con);
+        QVERIFY(monotonic);
+        QCOMPARE(lastCompleted, quint64(5 * 1000 * 1000 + 64));
+    }
+
+    // Only the given local paths are read from the disk, the rest comes from the journal
+    void testLocalDiscoveryStyle()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().mkdir("A/X");
+        fakeFolder.localModifier().mkdir("A/Y");
+        fakeFolder.localModifier().insert("A/X/x1");
+        fakeFolder.localModifier().insert("A/Y/y1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        fakeFolder.localModifier().insert("A/X/x2");
+        fakeFolder.localModifier().insert("A/Y/y2");
+        fakeFolder.localModifier().insert("B/b3");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, { "A/X/x2" });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentRemoteState().find("A/X/x2"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("A/Y/y2"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("B/b3"));
+        QVERIFY(!fakeFolder.syncEngine().isLocalDiscoveryIncomplete());
+
+        // A file that changed on disk is not removed because the server removed it
+        fakeFolder.localModifier().appendByte("C/c1");
+        fakeFolder.remoteModifier().remove("C/c1");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentLocalState().find("C/c1"));
+        QVERIFY(fakeFolder.syncEngine().isLocalDiscoveryIncomplete());
+        QCOMPARE(fakeFolder.syncEngine().isAnotherSyncNeeded(), ImmediateFollowUp);
+
+        // Reading everything from the disk catches up
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("B/b3"));
+        QCOMPARE(fakeFolder.currentRemoteState().find("C/c1")->size, 25);
+    }
+
+    // Entries read from the journal are checked against the disk while the rest is reconciled concurrently
+    void testLocalDiscoveryStyleParallelReconcile()
+    {
+        ScopedEnvironmentVariable threshold("OWNCLOUD_PARALLEL_RECONCILE_THRESHOLD", "0");
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.remoteModifier().remove("A");
+        fakeFolder.remoteModifier().remove("B");
+        fakeFolder.remoteModifier().appendByte("C/c1");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentLocalState().find("A/a1"));
+        QVERIFY(!fakeFolder.currentLocalState().find("B"));
+        QCOMPARE(*fakeFolder.currentLocalState().find("C/c1"), *fakeFolder.currentRemoteState().find("C/c1"));
+        QVERIFY(fakeFolder.syncEngine().isLocalDiscoveryIncomplete());
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("A/a1"));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
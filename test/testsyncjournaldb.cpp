@@ -6,6 +6,8 @@
 
 #include <QtTest>
 
+#include <algorithm>
+
 #include <sqlite3.h>
 
 #include "common/syncjournaldb.h"
@@ -170,6 +172,27 @@ private slots:
         QVERIFY(!wipedRecord._valid);
     }
 
+    void testBlockSignatures()
+    {
+        typedef SyncJournalDb::BlockSignatures Signatures;
+        QVERIFY(!_db.getBlockSignatures("nonexistant").isValid());
+
+        Signatures signatures;
+        signatures._etag = "etag";
+        signatures._blockSize = 65536;
+        signatures._signatures = QByteArray("\0\1\2binary\0", 10);
+        _db.setBlockSignatures("foo", signatures);
+
+        Signatures stored = _db.getBlockSignatures("foo");
+        QVERIFY(stored.isValid());
+        QCOMPARE(stored._etag, signatures._etag);
+        QCOMPARE(stored._blockSize, signatures._blockSize);
+        QCOMPARE(stored._signatures, signatures._signatures);
+
+        _db.setBlockSignatures("foo", Signatures());
+        QVERIFY(!_db.getBlockSignatures("foo").isValid());
+    }
+
     void testNumericId()
     {
         SyncJournalFileRecord record;
@@ -183,6 +206,180 @@ private slots:
         QCOMPARE(record.numericFileId(), QByteArray("123456789"));
     }
 
+    void testMaintenance()
+    {
+        SyncJournalFileRecord record;
+        record._modtime = dropMsecs(QDateTime::currentDateTime());
+        record._type = 0;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions("RW");
+        for (int i = 0; i < 500; ++i) {
+            record._path = QByteArray("maintenance/file") + QByteArray::number(i);
+            record._fileId = QByteArray("fileid") + QByteArray::number(i);
+            record._inode = 1000 + i;
+            QVERIFY(_db.setFileRecord(record));
+        }
+        _db.commit("test");
+        QVERIFY(_db.deleteFileRecord("maintenance", true));
+        record._path = "kept";
+        QVERIFY(_db.setFileRecord(record));
+        _db.commit("test");
+
+        auto before = _db.diagnostics();
+        QVERIFY(before._pageSize > 0);
+        QVERIFY(before._pageCount > 0);
+
+        const QDateTime maintenanceStart = QDateTime::currentDateTimeUtc().addSecs(-1);
+        QVERIFY(_db.performMaintenance());
+        QVERIFY(_db.lastMaintenanceTime() >= maintenanceStart);
+
+        auto after = _db.diagnostics();
+        QCOMPARE(after._freePageCount, qint64(0));
+        QVERIFY(after._pageCount < before._pageCount);
+        QVERIFY(after._lastMaintenanceMsecs >= 0);
+        QCOMPARE(after._fileRecordCount, before._fileRecordCount);
+
+        // The journal is still usable and lookups are accounted for
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("kept"), &storedRecord));
+        QVERIFY(storedRecord.isValid());
+        QCOMPARE(_db.diagnostics()._fileRecordQueries, after._fileRecordQueries + 1);
+
+        // A second run only does the incremental work
+        QVERIFY(_db.performMaintenance());
+        QCOMPARE(_db.diagnostics()._freePageCount, qint64(0));
+    }
+
+    void testMaintenanceSteps()
+    {
+        SyncJournalFileRecord record;
+        record._modtime = dropMsecs(QDateTime::currentDateTime());
+        record._type = 0;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions("RW");
+        for (int i = 0; i < 500; ++i) {
+            record._path = QByteArray("steps/file") + QByteArray::number(i);
+            record._fileId = QByteArray("stepsid") + QByteArray::number(i);
+            record._inode = 5000 + i;
+            QVERIFY(_db.setFileRecord(record));
+        }
+        _db.commit("test");
+        QVERIFY(_db.deleteFileRecord("steps", true));
+        _db.commit("test");
+        QVERIFY(_db.diagnostics()._freePageCount > 0);
+
+        // The journal stays usable between the steps
+        QList<SyncJournalDb::MaintenanceStep> steps;
+        SyncJournalDb::MaintenanceStep step = SyncJournalDb::MaintenanceStep::Start;
+        while (step != SyncJournalDb::MaintenanceStep::Done) {
+            steps.append(step);
+            step = _db.performMaintenanceStep(step);
+
+            record._path = QByteArray("between/file") + QByteArray::number(steps.size());
+            record._fileId = QByteArray("betweenid") + QByteArray::number(steps.size());
+            record._inode = 6000 + steps.size();
+            QVERIFY(_db.setFileRecord(record));
+            SyncJournalFileRecord storedRecord;
+            QVERIFY(_db.getFileRecord(record._path, &storedRecord));
+            QVERIFY(storedRecord.isValid());
+        }
+        QCOMPARE(steps.first(), SyncJournalDb::MaintenanceStep::Start);
+        QVERIFY(steps.contains(SyncJournalDb::MaintenanceStep::Vacuum));
+        QCOMPARE(steps.last(), SyncJournalDb::MaintenanceStep::Finish);
+        QCOMPARE(_db.diagnostics()._freePageCount, qint64(0));
+        QVERIFY(_db.diagnostics()._lastMaintenanceMsecs >= 0);
+    }
+
+    void testRenameIndex()
+    {
+        SyncJournalFileRecord record;
+        record._modtime = dropMsecs(QDateTime::currentDateTime());
+        record._type = 0;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions("RW");
+        for (int i = 0; i < 10; ++i) {
+            record._path = QByteArray("renameindex/file") + QByteArray::number(i);
+            record._fileId = QByteArray("renameindexid") + QByteArray::number(i % 5);
+            record._inode = 5000 + i;
+            QVERIFY(_db.setFileRecord(record));
+        }
+
+        auto lookup = [&](quint64 inode) {
+            SyncJournalFileRecord rec;
+            _db.getFileRecordByInode(inode, &rec);
+            return rec._path;
+        };
+        auto lookupFileId = [&](const QByteArray &fileId) {
+            QList<QByteArray> paths;
+            _db.getFileRecordsByFileId(fileId, [&](const SyncJournalFileRecord &rec) { paths.append(rec._path); });
+            std::sort(paths.begin(), paths.end());
+            return paths;
+        };
+
+        // The answers stay the same once the lookups go to the in-memory index
+        for (int round = 0; round < 30; ++round) {
+            QCOMPARE(lookup(5003), QByteArray("renameindex/file3"));
+            QVERIFY(lookup(4999).isEmpty());
+            QCOMPARE(lookupFileId("renameindexid2"),
+                QList<QByteArray>() << "renameindex/file2" << "renameindex/file7");
+            QVERIFY(lookupFileId("renameindexidX").isEmpty());
+        }
+
+        // Changes to the journal are seen right away
+        QVERIFY(_db.updateLocalMetadata("renameindex/file3", record._modtime, 1, 4999));
+        QCOMPARE(lookup(4999), QByteArray("renameindex/file3"));
+        QVERIFY(lookup(5003).isEmpty());
+        for (int round = 0; round < 30; ++round)
+            QCOMPARE(lookupFileId("renameindexid2").size(), 2);
+        QVERIFY(_db.deleteFileRecord("renameindex/file7"));
+        QCOMPARE(lookupFileId("renameindexid2"), QList<QByteArray>() << "renameindex/file2");
+
+        // Lookups still work once the index was released
+        for (int round = 0; round < 30; ++round)
+            QCOMPARE(lookup(4999), QByteArray("renameindex/file3"));
+        _db.releaseRenameIndex();
+        QCOMPARE(lookup(4999), QByteArray("renameindex/file3"));
+
+        QVERIFY(_db.deleteFileRecord("renameindex", true));
+    }
+
+    void testMoveFileRecords()
+    {
+        SyncJournalFileRecord record;
+        record._modtime = dropMsecs(QDateTime::currentDateTime());
+        record._type = 0;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions("RW");
+        for (const QByteArray path : { "movefrom", "movefrom/x", "movefrom/sub/y", "movefromother/z", "moveto/x" }) {
+            record._path = path;
+            record._fileId = path;
+            QVERIFY(_db.setFileRecord(record));
+        }
+
+        QVERIFY(_db.moveFileRecords("movefrom", "moveto/deeper"));
+
+        // Lookups by path go through the phash, which must have followed
+        auto exists = [&](const QByteArray &path) {
+            SyncJournalFileRecord rec;
+            return _db.getFileRecord(path, &rec) && rec.isValid() && rec._path == path;
+        };
+        QVERIFY(exists("movefrom"));
+        QVERIFY(!exists("movefrom/x"));
+        QVERIFY(!exists("movefrom/sub/y"));
+        QVERIFY(exists("moveto/deeper/x"));
+        QVERIFY(exists("moveto/deeper/sub/y"));
+        QVERIFY(exists("movefromother/z"));
+        QVERIFY(exists("moveto/x"));
+
+        SyncJournalFileRecord moved;
+        QVERIFY(_db.getFileRecord(QByteArray("moveto/deeper/sub/y"), &moved));
+        QCOMPARE(moved._fileId, QByteArray("movefrom/sub/y"));
+
+        QVERIFY(_db.deleteFileRecord("movefrom", true));
+        QVERIFY(_db.deleteFileRecord("movefromother", true));
+        QVERIFY(_db.deleteFileRecord("moveto", true));
+    }
+
 private:
     SyncJournalDb _db;
 };
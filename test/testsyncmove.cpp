@@ -555,6 +555,129 @@ private slots:
         QCOMPARE(nDELETE, 0);
     }
 
+    void testParallelReconcile()
+    {
+        // Reconcile even this small tree concurrently
+        ScopedEnvironmentVariable threshold("OWNCLOUD_PARALLEL_RECONCILE_THRESHOLD", "0");
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto &local = fakeFolder.localModifier();
+        auto &remote = fakeFolder.remoteModifier();
+
+        int nMOVE = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req) {
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE")
+                ++nMOVE;
+            return nullptr;
+        });
+
+        // Folder renames, which are reconciled one by one, next to plain changes
+        local.rename("A", "AM");
+        remote.rename("B", "BM");
+        remote.setContents("BM/b2", 'x');
+        local.rename("S/s2", "S/s2m");
+        local.appendByte("C/c1");
+        remote.insert("C/cnew");
+        remote.appendByte("S/s1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nMOVE, 2);
+        QVERIFY(remote.find("AM/a1"));
+        QVERIFY(!remote.find("A"));
+        QCOMPARE(remote.find("BM/b2")->contentChar, 'x');
+    }
+
+    void testMoveDirectoryRecords()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto &local = fakeFolder.localModifier();
+        auto &remote = fakeFolder.remoteModifier();
+        local.mkdir("A/sub");
+        local.insert("A/sub/s1");
+        local.insert("A/sub/s2");
+        QVERIFY(fakeFolder.syncOnce());
+
+        SyncJournalFileRecord before;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/sub/s1"), &before));
+        QVERIFY(before.isValid());
+
+        int nMOVE = 0;
+        int nTransfers = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &req) {
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE")
+                ++nMOVE;
+            if (op == QNetworkAccessManager::GetOperation || op == QNetworkAccessManager::PutOperation)
+                ++nTransfers;
+            return nullptr;
+        });
+
+        auto checkRecords = [&](const QByteArray &from, const QByteArray &to) {
+            SyncJournalFileRecord rec;
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(from + "/sub/s1", &rec));
+            QVERIFY(!rec.isValid());
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(to + "/sub/s1", &rec));
+            QVERIFY(rec.isValid());
+            QCOMPARE(rec._fileId, before._fileId);
+            QCOMPARE(rec._inode, before._inode);
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(to + "/a1", &rec));
+            QVERIFY(rec.isValid());
+        };
+
+        // A local directory move is a single MOVE and moves the records along
+        local.rename("A", "AM");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nMOVE, 1);
+        QCOMPARE(nTransfers, 0);
+        checkRecords("A", "AM");
+
+        // Same for a remote one
+        nMOVE = 0;
+        remote.rename("AM", "AR");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nMOVE, 0);
+        QCOMPARE(nTransfers, 0);
+        checkRecords("AM", "AR");
+
+        // A directory renamed inside a renamed directory: the parent's move
+        // already took the records along, the child's move starts from there
+        auto checkNestedRecords = [&](const QByteArray &from, const QByteArray &to) {
+            SyncJournalFileRecord rec;
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(from + "/s1", &rec));
+            QVERIFY(!rec.isValid());
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(to + "/s1", &rec));
+            QVERIFY(rec.isValid());
+            QCOMPARE(rec._fileId, before._fileId);
+            QCOMPARE(rec._inode, before._inode);
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(to, &rec));
+            QVERIFY(rec.isValid());
+        };
+        nMOVE = 0;
+        local.rename("AR", "AL");
+        local.rename("AL/sub", "AL/subL");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nMOVE, 2);
+        QCOMPARE(nTransfers, 0);
+        checkNestedRecords("AR/sub", "AL/subL");
+        checkNestedRecords("AL/sub", "AL/subL");
+
+        nMOVE = 0;
+        remote.rename("AL", "AS");
+        remote.rename("AS/subL", "AS/subS");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nMOVE, 0);
+        QCOMPARE(nTransfers, 0);
+        checkNestedRecords("AL/subL", "AS/subS");
+        checkNestedRecords("AS/subL", "AS/subS");
+
+        // Nothing is left to do afterwards
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nMOVE, 0);
+        QCOMPARE(nTransfers, 0);
+    }
+
     // Check interaction of moves with file type changes
     void testMoveAndTypeChange()
     {
@@ -0,0 +1,115 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "transfercompression.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+static QByteArray randomData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i)
+        data[i] = static_cast<char>(qrand());
+    return data;
+}
+
+class TestTransferCompression : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        if (!TransferCompression::isAvailable())
+            QSKIP("Built without zlib");
+    }
+
+    void testHeuristics()
+    {
+        const QByteArray text = QByteArray("timestamp;patient;value\n").repeated(200);
+        const QByteArray random = randomData(64 * 1024);
+
+        QCOMPARE(TransferCompression::entropy(QByteArray(100, 'x')), 0.0);
+        QVERIFY(TransferCompression::entropy(random) > 7.9);
+
+        QVERIFY(TransferCompression::isCompressible("data.csv", text));
+        QVERIFY(TransferCompression::isCompressible("noextension", text));
+        QVERIFY(!TransferCompression::isCompressible("archive.ZIP", text));
+        QVERIFY(!TransferCompression::isCompressible("data.bin", random));
+        QVERIFY(!TransferCompression::isCompressible("tiny.txt", "abc"));
+    }
+
+    void testRoundTrip()
+    {
+        const QByteArray data = QByteArray("<xml>content</xml>").repeated(1000) + randomData(100);
+        const QByteArray compressed = TransferCompression::gzip(data);
+        QVERIFY(!compressed.isEmpty());
+        QVERIFY(compressed.size() < data.size() / 2);
+        QCOMPARE(TransferCompression::gunzip(compressed), data);
+        QCOMPARE(TransferCompression::gunzip("not gzip"), QByteArray());
+    }
+
+    void testUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "uploadcompression", "1.0" } } } });
+
+        QStringList compressedPuts;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation && request.rawHeader("Content-Encoding") == "gzip")
+                compressedPuts.append(request.url().path().section('/', -2));
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/log.txt", 100 * 1000);
+        fakeFolder.localModifier().insert("A/photo.jpg", 100 * 1000);
+        fakeFolder.localModifier().insert("A/tiny.txt", 10);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(compressedPuts, QStringList() << "A/log.txt");
+
+        // The journal describes the uncompressed file
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/log.txt"), &record));
+        QCOMPARE(record._fileSize, qint64(100 * 1000));
+
+        // Without the capability nothing is compressed
+        compressedPuts.clear();
+        fakeFolder.syncEngine().account()->setCapabilities({});
+        fakeFolder.localModifier().insert("A/log2.txt", 100 * 1000);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(compressedPuts.isEmpty());
+    }
+
+    void testDownloadAcceptEncoding()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+
+        QMap<QString, QByteArray> acceptEncoding;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                acceptEncoding[request.url().path().section('/', -2)] = request.rawHeader("Accept-Encoding");
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().insert("A/data.csv", 1000);
+        fakeFolder.remoteModifier().insert("A/movie.mp4", 1000);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Left to the access manager, which negotiates gzip
+        QCOMPARE(acceptEncoding.value("A/data.csv"), QByteArray());
+        QCOMPARE(acceptEncoding.value("A/movie.mp4"), QByteArray("identity"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestTransferCompression)
+#include "testtransfercompression.moc"